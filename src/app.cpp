@@ -1,12 +1,29 @@
 #include "app.h"
+#include "batch_edit.h"
 #include "midi/midi_file.h"
+#include "midi/binary_io.h"
 #include <algorithm>
+#include <cstdio>
+#include <random>
+
+App::App() : history_(*this) {
+    std::string journalDir = EditJournal::defaultDirectory();
+    if (!journalDir.empty()) {
+        // A journal with edits whose instance is gone means that session
+        // didn't shut down cleanly. Its lock is held until it's recovered or
+        // discarded, so a second instance doesn't offer it as well.
+        recoveryPath_ = EditJournal::claimOrphan(journalDir, recoveryLock_);
+        recoveryAvailable_ = !recoveryPath_.empty();
+        journal_.open(EditJournal::instancePath(journalDir));
+    }
 
-App::App() {
     newProject();
 }
 
-App::~App() = default;
+App::~App() {
+    // Clean shutdown: nothing to recover next time
+    journal_.close(true);
+}
 
 void App::newProject() {
     project_ = midi::Project();
@@ -20,12 +37,17 @@ void App::newProject() {
     project_.tracks.push_back(track);
     
     selectedTrack_ = 0;
+    editingClip_ = -1;
     playheadTick_ = 0;
     playing_ = false;
+    recordArmed_ = false;
+    takeTrack_ = -1;
+    take_.clear();
     
-    undoStack_.clear();
-    redoStack_.clear();
+    history_.clear();
     clipboard_.clear();
+
+    journal_.begin(project_);
 }
 
 bool App::loadFile(const std::string& filepath) {
@@ -35,10 +57,14 @@ bool App::loadFile(const std::string& filepath) {
         project_.filepath = filepath;
         project_.modified = false;
         selectedTrack_ = project_.tracks.empty() ? -1 : 0;
+        editingClip_ = -1;
         playheadTick_ = 0;
         playing_ = false;
-        undoStack_.clear();
-        redoStack_.clear();
+        recordArmed_ = false;
+        takeTrack_ = -1;
+        take_.clear();
+        history_.clear();
+        journal_.begin(project_);
         return true;
     }
     return false;
@@ -55,6 +81,8 @@ bool App::saveFileAs(const std::string& filepath) {
     if (midi::saveMidiFile(filepath, project_)) {
         project_.filepath = filepath;
         project_.modified = false;
+        // The saved state becomes the new recovery snapshot
+        journal_.begin(project_);
         return true;
     }
     return false;
@@ -68,31 +96,117 @@ void App::addTrack() {
     project_.tracks.push_back(track);
     selectedTrack_ = static_cast<int>(project_.tracks.size()) - 1;
     project_.modified = true;
+    project_.touch();
+
+    if (!replayingJournal_) journal_.append(JournalOp::AddTrack);
 }
 
 void App::removeTrack(int index) {
     if (index >= 0 && index < static_cast<int>(project_.tracks.size())) {
+        endRecordedTake();
         project_.tracks.erase(project_.tracks.begin() + index);
         if (selectedTrack_ >= static_cast<int>(project_.tracks.size())) {
             selectedTrack_ = static_cast<int>(project_.tracks.size()) - 1;
         }
         project_.modified = true;
+        project_.touch();
+
+        if (!replayingJournal_) {
+            std::vector<uint8_t> payload;
+            midi::ByteWriter out(payload);
+            out.i32(index);
+            journal_.append(JournalOp::RemoveTrack, payload);
+        }
     }
 }
 
 void App::setSelectedTrack(int index) {
     if (index >= 0 && index < static_cast<int>(project_.tracks.size())) {
         selectedTrack_ = index;
+        editingClip_ = -1;
     }
 }
 
 midi::Track* App::getSelectedTrack() {
-    if (selectedTrack_ >= 0 && selectedTrack_ < static_cast<int>(project_.tracks.size())) {
-        return &project_.tracks[selectedTrack_];
+    return trackAt(getEditTargetIndex());
+}
+
+midi::Track* App::trackAt(int index) {
+    if (index >= 0) {
+        if (index < static_cast<int>(project_.tracks.size())) return &project_.tracks[index];
+        return nullptr;
+    }
+    int clip = -2 - index;
+    if (clip >= 0 && clip < static_cast<int>(project_.clips.size())) {
+        return &project_.clips[clip].content;
     }
     return nullptr;
 }
 
+int App::getEditTargetIndex() const {
+    int clip = getEditingClip();
+    return clip >= 0 ? clipTrackIndex(clip) : selectedTrack_;
+}
+
+// Clips
+
+void App::editClip(int clip) {
+    if (clip >= 0 && clip < static_cast<int>(project_.clips.size())) {
+        editingClip_ = clip;
+    }
+}
+
+int App::getEditingClip() const {
+    // Undo can remove the clip out from under the editor
+    if (editingClip_ >= static_cast<int>(project_.clips.size())) return -1;
+    return editingClip_;
+}
+
+void App::createClipFromSelection() {
+    if (getEditingClip() >= 0) return;
+    auto* track = trackAt(selectedTrack_);
+    if (!track) return;
+
+    std::vector<midi::Note> selected;
+    uint32_t endTick = 0;
+    for (const auto& note : track->notes) {
+        if (note.selected) {
+            selected.push_back(note);
+            endTick = std::max(endTick, note.endTick());
+        }
+    }
+    if (selected.empty()) return;
+
+    // Clips start on a bar line and span whole bars
+    uint32_t bar = static_cast<uint32_t>(std::max(1, project_.ticksPerBar()));
+    uint32_t clipStart = (selected.front().start_tick / bar) * bar;
+    uint32_t length = ((endTick - clipStart + bar - 1) / bar) * bar;
+
+    std::string name = "Clip " + std::to_string(project_.clips.size() + 1);
+    executeCommand(std::make_unique<CreateClipCommand>(*this, selectedTrack_, midi::PackedNotes(selected),
+                                                       clipStart, length, name));
+}
+
+void App::repeatLastClipInstance() {
+    auto* track = trackAt(selectedTrack_);
+    if (!track || track->clipInstances.empty()) return;
+
+    midi::ClipInstance inst = track->clipInstances.back();
+    if (inst.clip < 0 || inst.clip >= static_cast<int>(project_.clips.size())) return;
+    inst.offset += project_.clips[inst.clip].length;
+    executeCommand(std::make_unique<ClipInstanceCommand>(*this, selectedTrack_, inst, true));
+}
+
+void App::flattenClipInstances() {
+    auto* track = trackAt(selectedTrack_);
+    if (!track || track->clipInstances.empty()) return;
+
+    std::vector<midi::Note> notes;
+    project_.expandClips(*track, 0, UINT32_MAX, notes);
+    executeCommand(std::make_unique<FlattenClipsCommand>(*this, selectedTrack_, track->clipInstances,
+                                                         midi::PackedNotes(notes)));
+}
+
 void App::stop() {
     playing_ = false;
     playheadTick_ = 0;
@@ -107,7 +221,10 @@ void App::advancePlayhead(double deltaSeconds) {
     // Loop region support
     if (project_.loop_enabled && project_.loop_end > project_.loop_start) {
         if (playheadTick_ >= project_.loop_end) {
-            playheadTick_ = project_.loop_start;
+            // Keep the overshoot so the playhead stays in step with the
+            // player, which schedules the next pass ahead of time
+            uint32_t loopLength = project_.loop_end - project_.loop_start;
+            playheadTick_ = project_.loop_start + (playheadTick_ - project_.loop_end) % loopLength;
         }
     } else {
         // Loop back to start if we reach the end
@@ -118,47 +235,94 @@ void App::advancePlayhead(double deltaSeconds) {
     }
 }
 
+void App::appendRecordedNotes(const std::vector<midi::Note>& notes) {
+    if (notes.empty()) return;
+    if (takeTrack_ == -1) {
+        takeTrack_ = getEditTargetIndex();
+        take_.clear();
+    }
+    auto* track = trackAt(takeTrack_);
+    if (!track) return;
+
+    // Straight into the track so the take shows (and plays on the next loop
+    // pass) while recording; it goes through the command system at the end
+    track->insertSorted(notes);
+    take_.insert(take_.end(), notes.begin(), notes.end());
+    project_.modified = true;
+    project_.touch();
+}
+
+void App::endRecordedTake() {
+    if (takeTrack_ == -1) return;
+    int trackIndex = takeTrack_;
+    takeTrack_ = -1;
+    auto* track = trackAt(trackIndex);
+    if (!track || take_.empty()) {
+        take_.clear();
+        return;
+    }
+
+    // Swap the live notes for one command holding the whole take
+    track->removeNotes(take_);
+    executeCommand(std::make_unique<AddNotesCommand>(*this, trackIndex, midi::PackedNotes(take_)));
+    take_.clear();
+}
+
 void App::executeCommand(std::unique_ptr<Command> cmd) {
+    // Anything else that edits closes the take first, so its notes are
+    // already a command the new one sits on top of
+    if (takeTrack_ != -1) endRecordedTake();
     cmd->execute();
-    undoStack_.push_back(std::move(cmd));
-    
-    // Clear redo stack
-    redoStack_.clear();
-    
-    // Limit undo history
-    while (undoStack_.size() > MAX_UNDO_HISTORY) {
-        undoStack_.pop_front();
-    }
+    journalCommand(*cmd);
+    // Also clears the redo stack; old entries spill to disk past the budget
+    history_.push(std::move(cmd));
     
     project_.modified = true;
+    project_.touch();
 }
 
 void App::undo() {
-    if (!canUndo()) return;
+    endRecordedTake();
+    auto cmd = history_.popUndo();
+    if (!cmd) {
+        if (history_.takeLoadFailure()) {
+            historyError_ = "Could not read an undo step back from disk. It and all older steps were discarded.";
+        }
+        return;
+    }
     
-    auto cmd = std::move(undoStack_.back());
-    undoStack_.pop_back();
     cmd->undo();
-    redoStack_.push_back(std::move(cmd));
+    history_.pushRedo(std::move(cmd));
     project_.modified = true;
+    project_.touch();
+
+    if (!replayingJournal_) journal_.append(JournalOp::Undo);
 }
 
 void App::redo() {
-    if (!canRedo()) return;
+    endRecordedTake();
+    auto cmd = history_.popRedo();
+    if (!cmd) {
+        if (history_.takeLoadFailure()) {
+            historyError_ = "Could not read a redo step back from disk. It and all later steps were discarded.";
+        }
+        return;
+    }
     
-    auto cmd = std::move(redoStack_.back());
-    redoStack_.pop_back();
     cmd->execute();
-    undoStack_.push_back(std::move(cmd));
+    history_.pushUndo(std::move(cmd));
     project_.modified = true;
+    project_.touch();
+
+    if (!replayingJournal_) journal_.append(JournalOp::Redo);
 }
 
 bool App::canUndo() const {
-    return !undoStack_.empty();
+    return history_.canUndo();
 }
 
 bool App::canRedo() const {
-    return !redoStack_.empty();
+    return history_.canRedo();
 }
 
 void App::deleteSelectedNotes() {
@@ -173,7 +337,7 @@ void App::deleteSelectedNotes() {
     }
     
     if (!deleted.empty()) {
-        auto cmd = std::make_unique<DeleteNotesCommand>(*this, selectedTrack_, deleted);
+        auto cmd = std::make_unique<DeleteNotesCommand>(*this, getEditTargetIndex(), deleted);
         executeCommand(std::move(cmd));
     }
 }
@@ -220,188 +384,645 @@ void App::pasteNotes() {
         newNotes.push_back(note);
     }
     
-    auto cmd = std::make_unique<AddNotesCommand>(*this, selectedTrack_, newNotes);
+    auto cmd = std::make_unique<AddNotesCommand>(*this, getEditTargetIndex(), newNotes);
     executeCommand(std::move(cmd));
 }
 
 void App::quantizeSelectedNotes() {
-    auto* track = getSelectedTrack();
-    if (!track || gridSnap_ == midi::GridSnap::None) return;
+    if (gridSnap_ == midi::GridSnap::None) return;
     
-    for (auto& note : track->notes) {
-        if (note.selected) {
-            note.start_tick = midi::snapToGrid(note.start_tick, project_.ticks_per_quarter, gridSnap_);
+    BatchTransform transform;
+    transform.quantizeGrid = project_.ticks_per_quarter * 4 / static_cast<int>(gridSnap_);
+    applyBatchTransform(transform, "Quantize");
+}
+
+void App::transposeSelectedNotes(int semitones) {
+    BatchTransform transform;
+    transform.transpose = semitones;
+    applyBatchTransform(transform, "Transpose");
+}
+
+void App::humanizeSelectedNotes(uint32_t ticks, int velocity) {
+    static std::mt19937_64 rng(std::random_device{}());
+
+    BatchTransform transform;
+    transform.humanizeTicks = ticks;
+    transform.humanizeVelocity = velocity;
+    transform.seed = rng();
+    applyBatchTransform(transform, "Humanize");
+}
+
+void App::applyBatchTransform(const BatchTransform& transform, const std::string& name,
+                              const std::vector<int>& trackIndices) {
+    std::vector<int> tracks = trackIndices;
+    if (tracks.empty()) tracks.push_back(getEditTargetIndex());
+
+    auto cmd = BatchEditCommand::create(*this, tracks, transform, name);
+    if (cmd) {
+        executeCommand(std::move(cmd));
+    }
+}
+
+// Crash recovery
+
+void App::journalCommand(const Command& cmd) {
+    if (replayingJournal_ || !journal_.isOpen()) return;
+
+    std::vector<uint8_t> payload;
+    midi::ByteWriter out(payload);
+    cmd.write(out);
+    journal_.append(JournalOp::Execute, payload);
+}
+
+void App::journalNoteEdits(int trackIndex, const std::vector<size_t>& indices, bool resort) {
+    // Edited in place by the caller
+    project_.touch();
+
+    if (replayingJournal_ || !journal_.isOpen() || indices.empty()) return;
+    auto* track = trackAt(trackIndex);
+    if (!track) return;
+
+    const auto& notes = track->notes;
+    std::vector<uint8_t> payload;
+    midi::ByteWriter out(payload);
+    out.i32(trackIndex);
+    out.u8(resort ? 1 : 0);
+    out.u32(static_cast<uint32_t>(indices.size()));
+    for (size_t idx : indices) {
+        if (idx >= notes.size()) continue;
+        out.u32(static_cast<uint32_t>(idx));
+        out.note(notes[idx]);
+    }
+    journal_.append(JournalOp::NoteEdits, payload);
+}
+
+bool App::replayJournalRecord(JournalOp op, midi::ByteReader& in) {
+    switch (op) {
+        case JournalOp::Execute: {
+            auto cmd = Command::deserialize(*this, in);
+            if (!cmd || !in.ok()) return false;
+            executeCommand(std::move(cmd));
+            return true;
         }
+        case JournalOp::Undo:
+            undo();
+            return true;
+        case JournalOp::Redo:
+            redo();
+            return true;
+        case JournalOp::NoteEdits: {
+            int trackIndex = in.i32();
+            bool resort = in.u8() != 0;
+            uint32_t count = in.u32();
+            auto* target = trackAt(trackIndex);
+            if (!in.ok() || !target) return false;
+            auto& track = *target;
+            std::vector<size_t> changed;
+            for (uint32_t i = 0; i < count && in.ok(); ++i) {
+                uint32_t idx = in.u32();
+                midi::Note note = in.note();
+                if (in.ok() && idx < track.notes.size()) {
+                    track.notes[idx] = note;
+                    changed.push_back(idx);
+                }
+            }
+            if (resort) track.resortIndices(changed);
+            return in.ok();
+        }
+        case JournalOp::AddTrack:
+            addTrack();
+            return true;
+        case JournalOp::RemoveTrack:
+            removeTrack(in.i32());
+            return in.ok();
+        default:
+            return false;
+    }
+}
+
+bool App::recoverFromJournal() {
+    if (!recoveryAvailable_) return false;
+
+    bool haveSnapshot = false;
+    size_t replayed = 0;
+    replayingJournal_ = true;
+
+    bool complete = EditJournal::readFile(recoveryPath_, [&](JournalOp op, const uint8_t* data, size_t size) {
+        midi::ByteReader in(data, size);
+        if (op == JournalOp::Snapshot) {
+            midi::Project snapshot;
+            if (!in.project(snapshot)) return false;
+            project_ = std::move(snapshot);
+            selectedTrack_ = project_.tracks.empty() ? -1 : 0;
+            editingClip_ = -1;
+            history_.clear();
+            haveSnapshot = true;
+            return true;
+        }
+        if (!haveSnapshot) return false;
+        if (!replayJournalRecord(op, in)) return false;
+        ++replayed;
+        return true;
+    });
+
+    replayingJournal_ = false;
+
+    if (!haveSnapshot) {
+        fprintf(stderr, "Journal error: No usable snapshot in %s\n", recoveryPath_.c_str());
+        return false;
+    }
+    if (!complete) {
+        fprintf(stderr, "Journal: Recovery stopped at a damaged record, %zu edits restored\n", replayed);
+    } else {
+        fprintf(stderr, "Journal: Recovered %zu edits\n", replayed);
+    }
+
+    // Undo history does not survive the crash; start a clean journal from
+    // the recovered state
+    history_.clear();
+    playheadTick_ = 0;
+    playing_ = false;
+    if (selectedTrack_ >= static_cast<int>(project_.tracks.size())) {
+        selectedTrack_ = static_cast<int>(project_.tracks.size()) - 1;
     }
     project_.modified = true;
+    journal_.begin(project_);
+
+    discardRecoveryData();
+    return true;
+}
+
+void App::discardRecoveryData() {
+    if (!recoveryPath_.empty()) {
+        std::remove(recoveryPath_.c_str());
+        recoveryPath_.clear();
+    }
+    recoveryLock_.release();
+    recoveryAvailable_ = false;
+}
+
+// Command serialization (edit journal, undo spill file)
+
+void Command::write(midi::ByteWriter& out) const {
+    out.u8(static_cast<uint8_t>(getType()));
+    serialize(out);
+}
+
+std::unique_ptr<Command> Command::deserialize(App& app, midi::ByteReader& in) {
+    auto type = static_cast<CommandType>(in.u8());
+    if (type == CommandType::BatchEdit) {
+        return BatchEditCommand::read(app, in);
+    }
+
+    int trackIndex = in.i32();
+    if (!in.ok()) return nullptr;
+
+    switch (type) {
+        case CommandType::AddNotes: {
+            midi::PackedNotes notes;
+            if (!notes.read(in)) return nullptr;
+            return std::make_unique<AddNotesCommand>(app, trackIndex, std::move(notes));
+        }
+        case CommandType::DeleteNotes: {
+            midi::PackedNotes notes;
+            if (!notes.read(in)) return nullptr;
+            return std::make_unique<DeleteNotesCommand>(app, trackIndex, std::move(notes));
+        }
+        case CommandType::MoveNotes: {
+            midi::PackedInts indices;
+            indices.read(in);
+            int pitchDelta = in.i32();
+            int32_t tickDelta = in.i32();
+            if (!in.ok()) return nullptr;
+            return std::make_unique<MoveNotesCommand>(app, trackIndex, std::move(indices), pitchDelta, tickDelta);
+        }
+        case CommandType::ResizeNotes: {
+            midi::PackedInts indices, oldDurations, newDurations;
+            indices.read(in);
+            oldDurations.read(in);
+            newDurations.read(in);
+            if (!in.ok()) return nullptr;
+            return std::make_unique<ResizeNotesCommand>(app, trackIndex, std::move(indices),
+                                                        std::move(oldDurations), std::move(newDurations));
+        }
+        case CommandType::ChangeVelocity: {
+            midi::PackedInts indices, oldVelocities, newVelocities;
+            indices.read(in);
+            oldVelocities.read(in);
+            newVelocities.read(in);
+            if (!in.ok()) return nullptr;
+            return std::make_unique<ChangeVelocityCommand>(app, trackIndex, std::move(indices),
+                                                           std::move(oldVelocities), std::move(newVelocities));
+        }
+        case CommandType::ChangeInstrument: {
+            int oldProgram = in.i32();
+            int newProgram = in.i32();
+            if (!in.ok()) return nullptr;
+            return std::make_unique<ChangeInstrumentCommand>(app, trackIndex, oldProgram, newProgram);
+        }
+        case CommandType::CreateClip: {
+            midi::PackedNotes notes;
+            notes.read(in);
+            uint32_t clipStart = in.u32();
+            uint32_t length = in.u32();
+            std::string name = in.str();
+            if (!in.ok()) return nullptr;
+            return std::make_unique<CreateClipCommand>(app, trackIndex, std::move(notes), clipStart, length, name);
+        }
+        case CommandType::ClipInstance: {
+            midi::ClipInstance inst = in.clipInstance();
+            bool add = in.u8() != 0;
+            if (!in.ok()) return nullptr;
+            return std::make_unique<ClipInstanceCommand>(app, trackIndex, inst, add);
+        }
+        case CommandType::FlattenClips: {
+            uint32_t count = in.varint();
+            std::vector<midi::ClipInstance> instances;
+            for (uint32_t i = 0; i < count && in.ok(); ++i) {
+                instances.push_back(in.clipInstance());
+            }
+            midi::PackedNotes notes;
+            notes.read(in);
+            if (!in.ok()) return nullptr;
+            return std::make_unique<FlattenClipsCommand>(app, trackIndex, std::move(instances), std::move(notes));
+        }
+        case CommandType::BatchEdit:
+            break;
+    }
+    fprintf(stderr, "Journal error: Unknown command type %d\n", static_cast<int>(type));
+    return nullptr;
 }
 
 // Command implementations
+//
+// Note lists, indices and old/new values are stored packed (delta + varint)
+// so long undo histories stay small; they're unpacked only while the
+// command actually runs.
 
-AddNotesCommand::AddNotesCommand(App& app, int trackIndex, std::vector<midi::Note> notes)
+AddNotesCommand::AddNotesCommand(App& app, int trackIndex, const std::vector<midi::Note>& notes)
+    : app_(app), trackIndex_(trackIndex), notes_(notes) {}
+
+AddNotesCommand::AddNotesCommand(App& app, int trackIndex, midi::PackedNotes notes)
     : app_(app), trackIndex_(trackIndex), notes_(std::move(notes)) {}
 
 void AddNotesCommand::execute() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        for (const auto& note : notes_) {
-            tracks[trackIndex_].notes.push_back(note);
-        }
-        tracks[trackIndex_].sortNotes();
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->insertSorted(notes_.unpack());
     }
 }
 
 void AddNotesCommand::undo() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (const auto& note : notes_) {
-            auto it = std::find_if(trackNotes.begin(), trackNotes.end(), [&](const midi::Note& n) {
-                return n.pitch == note.pitch && n.start_tick == note.start_tick && 
-                       n.duration == note.duration && n.velocity == note.velocity;
-            });
-            if (it != trackNotes.end()) {
-                trackNotes.erase(it);
-            }
-        }
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->removeNotes(notes_.unpack());
     }
 }
 
-DeleteNotesCommand::DeleteNotesCommand(App& app, int trackIndex, std::vector<midi::Note> notes)
+void AddNotesCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    notes_.write(out);
+}
+
+size_t AddNotesCommand::memoryUsage() const {
+    return sizeof(*this) + notes_.memoryUsage();
+}
+
+DeleteNotesCommand::DeleteNotesCommand(App& app, int trackIndex, const std::vector<midi::Note>& notes)
+    : app_(app), trackIndex_(trackIndex), notes_(notes) {}
+
+DeleteNotesCommand::DeleteNotesCommand(App& app, int trackIndex, midi::PackedNotes notes)
     : app_(app), trackIndex_(trackIndex), notes_(std::move(notes)) {}
 
 void DeleteNotesCommand::execute() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (const auto& note : notes_) {
-            auto it = std::find_if(trackNotes.begin(), trackNotes.end(), [&](const midi::Note& n) {
-                return n.pitch == note.pitch && n.start_tick == note.start_tick && 
-                       n.duration == note.duration;
-            });
-            if (it != trackNotes.end()) {
-                trackNotes.erase(it);
-            }
-        }
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->removeNotes(notes_.unpack());
     }
 }
 
 void DeleteNotesCommand::undo() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        for (const auto& note : notes_) {
-            tracks[trackIndex_].notes.push_back(note);
-        }
-        tracks[trackIndex_].sortNotes();
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->insertSorted(notes_.unpack());
     }
 }
 
-MoveNotesCommand::MoveNotesCommand(App& app, int trackIndex, std::vector<size_t> noteIndices,
+void DeleteNotesCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    notes_.write(out);
+}
+
+size_t DeleteNotesCommand::memoryUsage() const {
+    return sizeof(*this) + notes_.memoryUsage();
+}
+
+MoveNotesCommand::MoveNotesCommand(App& app, int trackIndex, const std::vector<size_t>& noteIndices,
+                                   int pitchDelta, int32_t tickDelta)
+    : app_(app), trackIndex_(trackIndex), noteIndices_(noteIndices),
+      pitchDelta_(pitchDelta), tickDelta_(tickDelta) {}
+
+MoveNotesCommand::MoveNotesCommand(App& app, int trackIndex, midi::PackedInts noteIndices,
                                    int pitchDelta, int32_t tickDelta)
     : app_(app), trackIndex_(trackIndex), noteIndices_(std::move(noteIndices)),
       pitchDelta_(pitchDelta), tickDelta_(tickDelta) {}
 
 void MoveNotesCommand::execute() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (size_t idx : noteIndices_) {
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        auto& trackNotes = track->notes;
+        auto indices = noteIndices_.unpack<size_t>();
+        for (size_t idx : indices) {
             if (idx < trackNotes.size()) {
                 trackNotes[idx].pitch = std::clamp(trackNotes[idx].pitch + pitchDelta_, 0, 127);
                 int32_t newTick = static_cast<int32_t>(trackNotes[idx].start_tick) + tickDelta_;
                 trackNotes[idx].start_tick = static_cast<uint32_t>(std::max(0, newTick));
             }
         }
-        tracks[trackIndex_].sortNotes();
+        track->resortIndices(indices);
     }
 }
 
 void MoveNotesCommand::undo() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (size_t idx : noteIndices_) {
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        auto& trackNotes = track->notes;
+        auto indices = noteIndices_.unpack<size_t>();
+        for (size_t idx : indices) {
             if (idx < trackNotes.size()) {
                 trackNotes[idx].pitch = std::clamp(trackNotes[idx].pitch - pitchDelta_, 0, 127);
                 int32_t newTick = static_cast<int32_t>(trackNotes[idx].start_tick) - tickDelta_;
                 trackNotes[idx].start_tick = static_cast<uint32_t>(std::max(0, newTick));
             }
         }
-        tracks[trackIndex_].sortNotes();
+        track->resortIndices(indices);
     }
 }
 
-ResizeNotesCommand::ResizeNotesCommand(App& app, int trackIndex, std::vector<size_t> noteIndices,
-                                       std::vector<uint32_t> oldDurations, std::vector<uint32_t> newDurations)
+void MoveNotesCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    noteIndices_.write(out);
+    out.i32(pitchDelta_);
+    out.i32(tickDelta_);
+}
+
+size_t MoveNotesCommand::memoryUsage() const {
+    return sizeof(*this) + noteIndices_.memoryUsage();
+}
+
+ResizeNotesCommand::ResizeNotesCommand(App& app, int trackIndex, const std::vector<size_t>& noteIndices,
+                                       const std::vector<uint32_t>& oldDurations,
+                                       const std::vector<uint32_t>& newDurations)
+    : app_(app), trackIndex_(trackIndex), noteIndices_(noteIndices),
+      oldDurations_(oldDurations), newDurations_(newDurations) {}
+
+ResizeNotesCommand::ResizeNotesCommand(App& app, int trackIndex, midi::PackedInts noteIndices,
+                                       midi::PackedInts oldDurations, midi::PackedInts newDurations)
     : app_(app), trackIndex_(trackIndex), noteIndices_(std::move(noteIndices)),
       oldDurations_(std::move(oldDurations)), newDurations_(std::move(newDurations)) {}
 
 void ResizeNotesCommand::execute() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (size_t i = 0; i < noteIndices_.size(); ++i) {
-            if (noteIndices_[i] < trackNotes.size() && i < newDurations_.size()) {
-                trackNotes[noteIndices_[i]].duration = newDurations_[i];
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        auto& trackNotes = track->notes;
+        auto indices = noteIndices_.unpack<size_t>();
+        auto durations = newDurations_.unpack<uint32_t>();
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] < trackNotes.size() && i < durations.size()) {
+                trackNotes[indices[i]].duration = durations[i];
             }
         }
     }
 }
 
 void ResizeNotesCommand::undo() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (size_t i = 0; i < noteIndices_.size(); ++i) {
-            if (noteIndices_[i] < trackNotes.size() && i < oldDurations_.size()) {
-                trackNotes[noteIndices_[i]].duration = oldDurations_[i];
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        auto& trackNotes = track->notes;
+        auto indices = noteIndices_.unpack<size_t>();
+        auto durations = oldDurations_.unpack<uint32_t>();
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] < trackNotes.size() && i < durations.size()) {
+                trackNotes[indices[i]].duration = durations[i];
             }
         }
     }
 }
 
-ChangeVelocityCommand::ChangeVelocityCommand(App& app, int trackIndex, std::vector<size_t> noteIndices,
-                                             std::vector<int> oldVelocities, std::vector<int> newVelocities)
+void ResizeNotesCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    noteIndices_.write(out);
+    oldDurations_.write(out);
+    newDurations_.write(out);
+}
+
+size_t ResizeNotesCommand::memoryUsage() const {
+    return sizeof(*this) + noteIndices_.memoryUsage() +
+           oldDurations_.memoryUsage() + newDurations_.memoryUsage();
+}
+
+ChangeVelocityCommand::ChangeVelocityCommand(App& app, int trackIndex, const std::vector<size_t>& noteIndices,
+                                             const std::vector<int>& oldVelocities,
+                                             const std::vector<int>& newVelocities)
+    : app_(app), trackIndex_(trackIndex), noteIndices_(noteIndices),
+      oldVelocities_(oldVelocities), newVelocities_(newVelocities) {}
+
+ChangeVelocityCommand::ChangeVelocityCommand(App& app, int trackIndex, midi::PackedInts noteIndices,
+                                             midi::PackedInts oldVelocities, midi::PackedInts newVelocities)
     : app_(app), trackIndex_(trackIndex), noteIndices_(std::move(noteIndices)),
       oldVelocities_(std::move(oldVelocities)), newVelocities_(std::move(newVelocities)) {}
 
 void ChangeVelocityCommand::execute() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (size_t i = 0; i < noteIndices_.size(); ++i) {
-            if (noteIndices_[i] < trackNotes.size() && i < newVelocities_.size()) {
-                trackNotes[noteIndices_[i]].velocity = newVelocities_[i];
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        auto& trackNotes = track->notes;
+        auto indices = noteIndices_.unpack<size_t>();
+        auto velocities = newVelocities_.unpack<int>();
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] < trackNotes.size() && i < velocities.size()) {
+                trackNotes[indices[i]].velocity = velocities[i];
             }
         }
     }
 }
 
 void ChangeVelocityCommand::undo() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        auto& trackNotes = tracks[trackIndex_].notes;
-        for (size_t i = 0; i < noteIndices_.size(); ++i) {
-            if (noteIndices_[i] < trackNotes.size() && i < oldVelocities_.size()) {
-                trackNotes[noteIndices_[i]].velocity = oldVelocities_[i];
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        auto& trackNotes = track->notes;
+        auto indices = noteIndices_.unpack<size_t>();
+        auto velocities = oldVelocities_.unpack<int>();
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] < trackNotes.size() && i < velocities.size()) {
+                trackNotes[indices[i]].velocity = velocities[i];
             }
         }
     }
 }
 
+void ChangeVelocityCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    noteIndices_.write(out);
+    oldVelocities_.write(out);
+    newVelocities_.write(out);
+}
+
+size_t ChangeVelocityCommand::memoryUsage() const {
+    return sizeof(*this) + noteIndices_.memoryUsage() +
+           oldVelocities_.memoryUsage() + newVelocities_.memoryUsage();
+}
+
 ChangeInstrumentCommand::ChangeInstrumentCommand(App& app, int trackIndex, int oldProgram, int newProgram)
     : app_(app), trackIndex_(trackIndex), oldProgram_(oldProgram), newProgram_(newProgram) {}
 
 void ChangeInstrumentCommand::execute() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        tracks[trackIndex_].program = newProgram_;
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->program = newProgram_;
     }
 }
 
 void ChangeInstrumentCommand::undo() {
-    auto& tracks = app_.getProject().tracks;
-    if (trackIndex_ >= 0 && trackIndex_ < static_cast<int>(tracks.size())) {
-        tracks[trackIndex_].program = oldProgram_;
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->program = oldProgram_;
+    }
+}
+
+void ChangeInstrumentCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    out.i32(oldProgram_);
+    out.i32(newProgram_);
+}
+
+size_t ChangeInstrumentCommand::memoryUsage() const {
+    return sizeof(*this);
+}
+
+// Clip commands
+
+static void insertClipInstance(midi::Track& track, const midi::ClipInstance& inst) {
+    auto it = std::upper_bound(track.clipInstances.begin(), track.clipInstances.end(), inst,
+        [](const midi::ClipInstance& a, const midi::ClipInstance& b) { return a.offset < b.offset; });
+    track.clipInstances.insert(it, inst);
+}
+
+static void removeClipInstance(midi::Track& track, const midi::ClipInstance& inst) {
+    auto it = std::find_if(track.clipInstances.begin(), track.clipInstances.end(), [&](const midi::ClipInstance& c) {
+        return c.clip == inst.clip && c.offset == inst.offset &&
+               c.transpose == inst.transpose && c.velocityScale == inst.velocityScale;
+    });
+    if (it != track.clipInstances.end()) {
+        track.clipInstances.erase(it);
+    }
+}
+
+CreateClipCommand::CreateClipCommand(App& app, int trackIndex, midi::PackedNotes notes,
+                                     uint32_t clipStart, uint32_t length, std::string name)
+    : app_(app), trackIndex_(trackIndex), notes_(std::move(notes)),
+      clipStart_(clipStart), length_(length), name_(std::move(name)) {}
+
+void CreateClipCommand::execute() {
+    auto* track = app_.trackAt(trackIndex_);
+    if (!track) return;
+
+    auto notes = notes_.unpack();
+    track->removeNotes(notes);
+
+    midi::Clip clip;
+    clip.name = name_;
+    clip.length = length_;
+    for (auto note : notes) {
+        note.start_tick -= clipStart_;
+        note.selected = false;
+        clip.content.notes.push_back(note);
     }
+    clip.content.sortNotes();
+
+    // Clips are only ever appended, and undo runs in reverse order, so this
+    // clip always lands at the same index
+    auto& clips = app_.getProject().clips;
+    midi::ClipInstance inst;
+    inst.clip = static_cast<int>(clips.size());
+    inst.offset = clipStart_;
+    clips.push_back(std::move(clip));
+    insertClipInstance(*track, inst);
+}
+
+void CreateClipCommand::undo() {
+    auto* track = app_.trackAt(trackIndex_);
+    auto& clips = app_.getProject().clips;
+    if (!track || clips.empty()) return;
+
+    int clip = static_cast<int>(clips.size()) - 1;
+    auto& instances = track->clipInstances;
+    instances.erase(std::remove_if(instances.begin(), instances.end(),
+                                   [clip](const midi::ClipInstance& c) { return c.clip == clip; }),
+                    instances.end());
+    clips.pop_back();
+    track->insertSorted(notes_.unpack());
+}
+
+void CreateClipCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    notes_.write(out);
+    out.u32(clipStart_);
+    out.u32(length_);
+    out.str(name_);
+}
+
+size_t CreateClipCommand::memoryUsage() const {
+    return sizeof(*this) + notes_.memoryUsage() + name_.capacity();
+}
+
+ClipInstanceCommand::ClipInstanceCommand(App& app, int trackIndex, midi::ClipInstance instance, bool add)
+    : app_(app), trackIndex_(trackIndex), instance_(instance), add_(add) {}
+
+void ClipInstanceCommand::insert() {
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        insertClipInstance(*track, instance_);
+    }
+}
+
+void ClipInstanceCommand::remove() {
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        removeClipInstance(*track, instance_);
+    }
+}
+
+void ClipInstanceCommand::execute() {
+    if (add_) insert(); else remove();
+}
+
+void ClipInstanceCommand::undo() {
+    if (add_) remove(); else insert();
+}
+
+void ClipInstanceCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    out.clipInstance(instance_);
+    out.u8(add_ ? 1 : 0);
+}
+
+size_t ClipInstanceCommand::memoryUsage() const {
+    return sizeof(*this);
+}
+
+FlattenClipsCommand::FlattenClipsCommand(App& app, int trackIndex, std::vector<midi::ClipInstance> instances,
+                                         midi::PackedNotes notes)
+    : app_(app), trackIndex_(trackIndex), instances_(std::move(instances)), notes_(std::move(notes)) {}
+
+void FlattenClipsCommand::execute() {
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->clipInstances.clear();
+        track->insertSorted(notes_.unpack());
+    }
+}
+
+void FlattenClipsCommand::undo() {
+    if (auto* track = app_.trackAt(trackIndex_)) {
+        track->removeNotes(notes_.unpack());
+        track->clipInstances = instances_;
+    }
+}
+
+void FlattenClipsCommand::serialize(midi::ByteWriter& out) const {
+    out.i32(trackIndex_);
+    out.varint(static_cast<uint32_t>(instances_.size()));
+    for (const auto& inst : instances_) {
+        out.clipInstance(inst);
+    }
+    notes_.write(out);
+}
+
+size_t FlattenClipsCommand::memoryUsage() const {
+    return sizeof(*this) + instances_.capacity() * sizeof(midi::ClipInstance) + notes_.memoryUsage();
 }
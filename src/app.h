@@ -1,12 +1,16 @@
 #pragma once
 
 #include "midi/types.h"
+#include "midi/binary_io.h"
+#include "edit_journal.h"
+#include "undo_history.h"
 #include <memory>
 #include <deque>
 #include <functional>
 
 // Forward declarations
 class Command;
+struct BatchTransform;
 
 class App {
 public:
@@ -28,8 +32,25 @@ public:
     void removeTrack(int index);
     int getSelectedTrackIndex() const { return selectedTrack_; }
     void setSelectedTrack(int index);
+    // The track the piano roll edits: the selected track, or the clip
+    // being edited
     midi::Track* getSelectedTrack();
 
+    // Commands address tracks by index. Clip contents get negative indices
+    // (-2 - clip) so every note command can edit a clip as well.
+    static int clipTrackIndex(int clip) { return -2 - clip; }
+    midi::Track* trackAt(int index);
+    // Index for commands that edit what getSelectedTrack() returns
+    int getEditTargetIndex() const;
+
+    // Clips
+    void editClip(int clip);
+    void stopEditingClip() { editingClip_ = -1; }
+    int getEditingClip() const;
+    void createClipFromSelection();
+    void repeatLastClipInstance();
+    void flattenClipInstances();
+
     // Playback state
     bool isPlaying() const { return playing_; }
     void setPlaying(bool playing) { playing_ = playing; }
@@ -40,6 +61,14 @@ public:
     void setPlayheadTick(uint32_t tick) { playheadTick_ = tick; }
     void advancePlayhead(double deltaSeconds);
 
+    // Recording. While armed and playing, recorded notes are appended to
+    // the edit target as they arrive (the take's track is fixed by its first
+    // batch); endRecordedTake() turns the whole take into one undo step.
+    bool isRecordArmed() const { return recordArmed_; }
+    void setRecordArmed(bool armed) { recordArmed_ = armed; }
+    void appendRecordedNotes(const std::vector<midi::Note>& notes);
+    void endRecordedTake();
+
     // Editing state
     midi::GridSnap getGridSnap() const { return gridSnap_; }
     void setGridSnap(midi::GridSnap snap) { gridSnap_ = snap; }
@@ -50,6 +79,9 @@ public:
     void redo();
     bool canUndo() const;
     bool canRedo() const;
+    // Set when undo/redo history had to be thrown away; for the UI to show
+    const std::string& getHistoryError() const { return historyError_; }
+    void clearHistoryError() { historyError_.clear(); }
 
     // Note editing helpers
     void deleteSelectedNotes();
@@ -57,29 +89,76 @@ public:
     void copySelectedNotes();
     void pasteNotes();
     void quantizeSelectedNotes();
+    void transposeSelectedNotes(int semitones);
+    void humanizeSelectedNotes(uint32_t ticks, int velocity);
+
+    // Run a transform over the selected notes as one undoable batch edit.
+    // With no track list it applies to the selected track.
+    void applyBatchTransform(const BatchTransform& transform, const std::string& name,
+                             const std::vector<int>& trackIndices = {});
 
     // Clipboard
     bool hasClipboard() const { return !clipboard_.empty(); }
 
+    // Crash recovery
+    bool hasRecoveryData() const { return recoveryAvailable_; }
+    bool recoverFromJournal();
+    void discardRecoveryData();
+
+    // Record direct note edits that bypass the command system (drag, resize,
+    // velocity lane). Call after changing the notes at `indices` and before
+    // re-sorting; `resort` replays the re-sort that follows.
+    void journalNoteEdits(int trackIndex, const std::vector<size_t>& indices, bool resort);
+
 private:
+    void journalCommand(const Command& cmd);
+    bool replayJournalRecord(JournalOp op, midi::ByteReader& in);
+
     midi::Project project_;
     int selectedTrack_ = 0;
+    int editingClip_ = -1;
 
     // Playback
     bool playing_ = false;
     uint32_t playheadTick_ = 0;
 
+    // Recording take in progress: notes already inserted live into
+    // trackAt(takeTrack_), not yet on the undo stack
+    bool recordArmed_ = false;
+    int takeTrack_ = -1;
+    std::vector<midi::Note> take_;
+
     // Editing
     midi::GridSnap gridSnap_ = midi::GridSnap::Sixteenth;
 
     // Undo/Redo
-    std::deque<std::unique_ptr<Command>> undoStack_;
-    std::deque<std::unique_ptr<Command>> redoStack_;
-    static const size_t MAX_UNDO_HISTORY = 100;
+    UndoHistory history_;
+    std::string historyError_;
 
     // Clipboard (for copy/paste)
     std::vector<midi::Note> clipboard_;
     uint32_t clipboardBaseTime_ = 0;
+
+    // Crash recovery journal
+    EditJournal journal_;
+    std::string recoveryPath_;  // Another instance's journal, if it left one
+    EditJournal::OwnerLock recoveryLock_;
+    bool recoveryAvailable_ = false;
+    bool replayingJournal_ = false;
+};
+
+// Serialized command type tags (stored in the edit journal, never reorder)
+enum class CommandType : uint8_t {
+    AddNotes = 1,
+    DeleteNotes,
+    MoveNotes,
+    ResizeNotes,
+    ChangeVelocity,
+    ChangeInstrument,
+    BatchEdit,
+    CreateClip,
+    ClipInstance,
+    FlattenClips
 };
 
 // Command pattern for undo/redo
@@ -89,49 +168,72 @@ public:
     virtual void execute() = 0;
     virtual void undo() = 0;
     virtual std::string getName() const = 0;
+
+    // Bytes held by this command, used for the undo history budget
+    virtual size_t memoryUsage() const = 0;
+
+    // Serialization (edit journal and undo spill file)
+    virtual CommandType getType() const = 0;
+    virtual void serialize(midi::ByteWriter& out) const = 0;
+    // Type tag followed by serialize(); what deserialize() expects
+    void write(midi::ByteWriter& out) const;
+    static std::unique_ptr<Command> deserialize(App& app, midi::ByteReader& in);
 };
 
 // Add notes command
 class AddNotesCommand : public Command {
 public:
-    AddNotesCommand(App& app, int trackIndex, std::vector<midi::Note> notes);
+    AddNotesCommand(App& app, int trackIndex, const std::vector<midi::Note>& notes);
+    AddNotesCommand(App& app, int trackIndex, midi::PackedNotes notes);
     void execute() override;
     void undo() override;
     std::string getName() const override { return "Add Notes"; }
+    CommandType getType() const override { return CommandType::AddNotes; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
 
 private:
     App& app_;
     int trackIndex_;
-    std::vector<midi::Note> notes_;
+    midi::PackedNotes notes_;
 };
 
 // Delete notes command
 class DeleteNotesCommand : public Command {
 public:
-    DeleteNotesCommand(App& app, int trackIndex, std::vector<midi::Note> notes);
+    DeleteNotesCommand(App& app, int trackIndex, const std::vector<midi::Note>& notes);
+    DeleteNotesCommand(App& app, int trackIndex, midi::PackedNotes notes);
     void execute() override;
     void undo() override;
     std::string getName() const override { return "Delete Notes"; }
+    CommandType getType() const override { return CommandType::DeleteNotes; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
 
 private:
     App& app_;
     int trackIndex_;
-    std::vector<midi::Note> notes_;
+    midi::PackedNotes notes_;
 };
 
 // Move notes command
 class MoveNotesCommand : public Command {
 public:
-    MoveNotesCommand(App& app, int trackIndex, std::vector<size_t> noteIndices,
+    MoveNotesCommand(App& app, int trackIndex, const std::vector<size_t>& noteIndices,
+                     int pitchDelta, int32_t tickDelta);
+    MoveNotesCommand(App& app, int trackIndex, midi::PackedInts noteIndices,
                      int pitchDelta, int32_t tickDelta);
     void execute() override;
     void undo() override;
     std::string getName() const override { return "Move Notes"; }
+    CommandType getType() const override { return CommandType::MoveNotes; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
 
 private:
     App& app_;
     int trackIndex_;
-    std::vector<size_t> noteIndices_;
+    midi::PackedInts noteIndices_;
     int pitchDelta_;
     int32_t tickDelta_;
 };
@@ -139,35 +241,45 @@ private:
 // Resize notes command
 class ResizeNotesCommand : public Command {
 public:
-    ResizeNotesCommand(App& app, int trackIndex, std::vector<size_t> noteIndices,
-                       std::vector<uint32_t> oldDurations, std::vector<uint32_t> newDurations);
+    ResizeNotesCommand(App& app, int trackIndex, const std::vector<size_t>& noteIndices,
+                       const std::vector<uint32_t>& oldDurations, const std::vector<uint32_t>& newDurations);
+    ResizeNotesCommand(App& app, int trackIndex, midi::PackedInts noteIndices,
+                       midi::PackedInts oldDurations, midi::PackedInts newDurations);
     void execute() override;
     void undo() override;
     std::string getName() const override { return "Resize Notes"; }
+    CommandType getType() const override { return CommandType::ResizeNotes; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
 
 private:
     App& app_;
     int trackIndex_;
-    std::vector<size_t> noteIndices_;
-    std::vector<uint32_t> oldDurations_;
-    std::vector<uint32_t> newDurations_;
+    midi::PackedInts noteIndices_;
+    midi::PackedInts oldDurations_;
+    midi::PackedInts newDurations_;
 };
 
 // Change velocity command
 class ChangeVelocityCommand : public Command {
 public:
-    ChangeVelocityCommand(App& app, int trackIndex, std::vector<size_t> noteIndices,
-                          std::vector<int> oldVelocities, std::vector<int> newVelocities);
+    ChangeVelocityCommand(App& app, int trackIndex, const std::vector<size_t>& noteIndices,
+                          const std::vector<int>& oldVelocities, const std::vector<int>& newVelocities);
+    ChangeVelocityCommand(App& app, int trackIndex, midi::PackedInts noteIndices,
+                          midi::PackedInts oldVelocities, midi::PackedInts newVelocities);
     void execute() override;
     void undo() override;
     std::string getName() const override { return "Change Velocity"; }
+    CommandType getType() const override { return CommandType::ChangeVelocity; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
 
 private:
     App& app_;
     int trackIndex_;
-    std::vector<size_t> noteIndices_;
-    std::vector<int> oldVelocities_;
-    std::vector<int> newVelocities_;
+    midi::PackedInts noteIndices_;
+    midi::PackedInts oldVelocities_;
+    midi::PackedInts newVelocities_;
 };
 
 // Change track instrument command
@@ -177,6 +289,9 @@ public:
     void execute() override;
     void undo() override;
     std::string getName() const override { return "Change Instrument"; }
+    CommandType getType() const override { return CommandType::ChangeInstrument; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
 
 private:
     App& app_;
@@ -184,3 +299,64 @@ private:
     int oldProgram_;
     int newProgram_;
 };
+
+// Move notes from a track into a new clip and place one instance of it
+class CreateClipCommand : public Command {
+public:
+    CreateClipCommand(App& app, int trackIndex, midi::PackedNotes notes,
+                      uint32_t clipStart, uint32_t length, std::string name);
+    void execute() override;
+    void undo() override;
+    std::string getName() const override { return "Create Clip"; }
+    CommandType getType() const override { return CommandType::CreateClip; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
+
+private:
+    App& app_;
+    int trackIndex_;
+    midi::PackedNotes notes_;   // Absolute positions, as they were on the track
+    uint32_t clipStart_;
+    uint32_t length_;
+    std::string name_;
+};
+
+// Add or remove one clip instance
+class ClipInstanceCommand : public Command {
+public:
+    ClipInstanceCommand(App& app, int trackIndex, midi::ClipInstance instance, bool add);
+    void execute() override;
+    void undo() override;
+    std::string getName() const override { return add_ ? "Add Clip Instance" : "Remove Clip Instance"; }
+    CommandType getType() const override { return CommandType::ClipInstance; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
+
+private:
+    void insert();
+    void remove();
+
+    App& app_;
+    int trackIndex_;
+    midi::ClipInstance instance_;
+    bool add_;
+};
+
+// Turn all clip instances on a track into plain notes
+class FlattenClipsCommand : public Command {
+public:
+    FlattenClipsCommand(App& app, int trackIndex, std::vector<midi::ClipInstance> instances,
+                        midi::PackedNotes notes);
+    void execute() override;
+    void undo() override;
+    std::string getName() const override { return "Flatten Clips"; }
+    CommandType getType() const override { return CommandType::FlattenClips; }
+    void serialize(midi::ByteWriter& out) const override;
+    size_t memoryUsage() const override;
+
+private:
+    App& app_;
+    int trackIndex_;
+    std::vector<midi::ClipInstance> instances_;
+    midi::PackedNotes notes_;
+};
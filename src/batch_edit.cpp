@@ -0,0 +1,270 @@
+#include "batch_edit.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Selections smaller than this are handled on the calling thread
+static constexpr size_t PARALLEL_THRESHOLD = 1 << 16;
+
+// Split [0, count) into one chunk per worker (just one when it's small)
+static std::vector<size_t> chunkBounds(size_t count) {
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    if (count < PARALLEL_THRESHOLD) workers = 1;
+    workers = std::max<size_t>(1, std::min(workers, count / (PARALLEL_THRESHOLD / 4)));
+
+    std::vector<size_t> bounds;
+    size_t chunk = (count + workers - 1) / std::max<size_t>(1, workers);
+    for (size_t b = 0; b < count; b += chunk) bounds.push_back(b);
+    bounds.push_back(count);
+    return bounds;
+}
+
+template <typename Fn>
+static void parallelChunks(const std::vector<size_t>& bounds, Fn fn) {
+    if (bounds.size() <= 2) {
+        if (bounds.size() == 2) fn(bounds[0], bounds[1]);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (size_t c = 1; c + 1 < bounds.size(); ++c) {
+        threads.emplace_back(fn, bounds[c], bounds[c + 1]);
+    }
+    fn(bounds[0], bounds[1]);
+    for (auto& t : threads) t.join();
+}
+
+// Sort chunks in parallel, then merge them back together
+static void sortBatch(std::vector<midi::Note>& notes) {
+    if (std::is_sorted(notes.begin(), notes.end(), midi::noteOrder)) return;
+
+    auto bounds = chunkBounds(notes.size());
+    parallelChunks(bounds, [&](size_t begin, size_t end) {
+        std::sort(notes.begin() + begin, notes.begin() + end, midi::noteOrder);
+    });
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        for (size_t c = 0; c + 2 < bounds.size(); c += 2) {
+            std::inplace_merge(notes.begin() + bounds[c], notes.begin() + bounds[c + 1],
+                               notes.begin() + bounds[c + 2], midi::noteOrder);
+            merged.push_back(bounds[c]);
+        }
+        if (bounds.size() % 2 == 0) merged.push_back(bounds[bounds.size() - 2]);
+        merged.push_back(bounds.back());
+        bounds.swap(merged);
+    }
+}
+
+static bool sameNote(const midi::Note& a, const midi::Note& b) {
+    return a.start_tick == b.start_tick && a.pitch == b.pitch &&
+           a.duration == b.duration && a.velocity == b.velocity;
+}
+
+// Remove `remove` from the track and merge `insert` in. Both lists are
+// sorted by noteOrder, as is the track, so this is one linear pass plus a
+// merge. Notes that share a start tick and pitch are matched on duration
+// and velocity too.
+static void replaceNotes(midi::Track& track, const std::vector<midi::Note>& remove,
+                         const std::vector<midi::Note>& insert) {
+    auto& notes = track.notes;
+    std::vector<midi::Note> kept;
+    kept.reserve(notes.size());
+    std::vector<bool> used(remove.size(), false);
+    size_t matched = 0;
+
+    size_t r = 0;
+    for (const auto& note : notes) {
+        while (r < remove.size() && midi::noteOrder(remove[r], note)) ++r;
+
+        bool found = false;
+        for (size_t k = r; k < remove.size() && !midi::noteOrder(note, remove[k]); ++k) {
+            if (!used[k] && sameNote(remove[k], note)) {
+                used[k] = true;
+                found = true;
+                ++matched;
+                break;
+            }
+        }
+        if (!found) kept.push_back(note);
+    }
+
+    // Anything not found in place means the track wasn't in note order
+    // (edited behind the command's back); fall back to a plain search
+    if (matched < remove.size()) {
+        for (size_t k = 0; k < remove.size(); ++k) {
+            if (used[k]) continue;
+            auto it = std::find_if(kept.begin(), kept.end(), [&](const midi::Note& n) {
+                return sameNote(n, remove[k]);
+            });
+            if (it != kept.end()) kept.erase(it);
+        }
+        std::sort(kept.begin(), kept.end(), midi::noteOrder);
+    }
+
+    notes.clear();
+    notes.reserve(kept.size() + insert.size());
+    std::merge(kept.begin(), kept.end(), insert.begin(), insert.end(),
+               std::back_inserter(notes), midi::noteOrder);
+}
+
+// splitmix64
+static uint64_t mixBits(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static int64_t randomOffset(uint64_t hash, int64_t range) {
+    return static_cast<int64_t>(hash % static_cast<uint64_t>(range * 2 + 1)) - range;
+}
+
+midi::Note BatchTransform::apply(const midi::Note& note, size_t n) const {
+    midi::Note out = note;
+
+    if (transpose != 0) {
+        out.pitch = std::clamp(out.pitch + transpose, 0, 127);
+    }
+    if (timeShift != 0) {
+        int64_t start = static_cast<int64_t>(out.start_tick) + timeShift;
+        out.start_tick = static_cast<uint32_t>(std::max<int64_t>(0, start));
+    }
+    if (resizeDelta != 0) {
+        if (resizeFromLeft) {
+            int64_t end = out.endTick();
+            int64_t start = std::clamp<int64_t>(static_cast<int64_t>(out.start_tick) + resizeDelta, 0, end - 1);
+            out.start_tick = static_cast<uint32_t>(start);
+            out.duration = static_cast<uint32_t>(end - start);
+        } else {
+            int64_t duration = static_cast<int64_t>(out.duration) + resizeDelta;
+            out.duration = static_cast<uint32_t>(std::max<int64_t>(1, duration));
+        }
+    }
+    if (quantizeGrid > 0) {
+        out.start_tick = (out.start_tick / quantizeGrid) * quantizeGrid;
+    }
+    if (velocityScale != 1.0f) {
+        out.velocity = std::clamp(static_cast<int>(std::lround(out.velocity * velocityScale)), 1, 127);
+    }
+    if (humanizeTicks > 0 || humanizeVelocity > 0) {
+        uint64_t h = mixBits(seed ^ mixBits(n));
+        if (humanizeTicks > 0) {
+            int64_t start = static_cast<int64_t>(out.start_tick) + randomOffset(h, humanizeTicks);
+            out.start_tick = static_cast<uint32_t>(std::max<int64_t>(0, start));
+        }
+        if (humanizeVelocity > 0) {
+            int vel = out.velocity + static_cast<int>(randomOffset(mixBits(h), humanizeVelocity));
+            out.velocity = std::clamp(vel, 1, 127);
+        }
+    }
+    return out;
+}
+
+BatchEditCommand::BatchEditCommand(App& app, std::string name, std::vector<TrackEdit> edits)
+    : app_(app), name_(std::move(name)), edits_(std::move(edits)) {}
+
+std::unique_ptr<BatchEditCommand> BatchEditCommand::create(App& app, const std::vector<int>& trackIndices,
+                                                           const BatchTransform& transform, std::string name) {
+    std::vector<TrackEdit> edits;
+    size_t selectionOffset = 0;
+
+    for (int trackIndex : trackIndices) {
+        auto* track = app.trackAt(trackIndex);
+        if (!track) continue;
+
+        std::vector<midi::Note> before;
+        for (const auto& note : track->notes) {
+            if (note.selected) before.push_back(note);
+        }
+        if (before.empty()) continue;
+
+        std::vector<midi::Note> after(before.size());
+        parallelChunks(chunkBounds(before.size()), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                after[i] = transform.apply(before[i], selectionOffset + i);
+            }
+        });
+        selectionOffset += before.size();
+
+        // Only keep what the transform actually changed
+        size_t count = 0;
+        for (size_t i = 0; i < before.size(); ++i) {
+            if (!sameNote(before[i], after[i])) {
+                before[count] = before[i];
+                after[count] = after[i];
+                ++count;
+            }
+        }
+        if (count == 0) continue;
+        before.resize(count);
+        after.resize(count);
+
+        sortBatch(before);
+        sortBatch(after);
+
+        TrackEdit edit;
+        edit.trackIndex = trackIndex;
+        edit.before = midi::PackedNotes(before);
+        edit.after = midi::PackedNotes(after);
+        edits.push_back(std::move(edit));
+    }
+
+    if (edits.empty()) return nullptr;
+    return std::unique_ptr<BatchEditCommand>(new BatchEditCommand(app, std::move(name), std::move(edits)));
+}
+
+void BatchEditCommand::apply(bool forward) {
+    for (const auto& edit : edits_) {
+        auto* track = app_.trackAt(edit.trackIndex);
+        if (!track) continue;
+        const auto& from = forward ? edit.before : edit.after;
+        const auto& to = forward ? edit.after : edit.before;
+        replaceNotes(*track, from.unpack(), to.unpack());
+    }
+}
+
+void BatchEditCommand::execute() {
+    apply(true);
+}
+
+void BatchEditCommand::undo() {
+    apply(false);
+}
+
+size_t BatchEditCommand::noteCount() const {
+    size_t count = 0;
+    for (const auto& edit : edits_) count += edit.before.size();
+    return count;
+}
+
+size_t BatchEditCommand::memoryUsage() const {
+    size_t bytes = sizeof(*this) + name_.capacity() + edits_.capacity() * sizeof(TrackEdit);
+    for (const auto& edit : edits_) {
+        bytes += edit.before.memoryUsage() + edit.after.memoryUsage();
+    }
+    return bytes;
+}
+
+void BatchEditCommand::serialize(midi::ByteWriter& out) const {
+    out.str(name_);
+    out.varint(static_cast<uint32_t>(edits_.size()));
+    for (const auto& edit : edits_) {
+        out.i32(edit.trackIndex);
+        edit.before.write(out);
+        edit.after.write(out);
+    }
+}
+
+std::unique_ptr<BatchEditCommand> BatchEditCommand::read(App& app, midi::ByteReader& in) {
+    std::string name = in.str();
+    uint32_t count = in.varint();
+    if (!in.ok() || count > in.remaining()) return nullptr;
+
+    std::vector<TrackEdit> edits(count);
+    for (auto& edit : edits) {
+        edit.trackIndex = in.i32();
+        edit.before.read(in);
+        edit.after.read(in);
+    }
+    if (!in.ok()) return nullptr;
+    return std::unique_ptr<BatchEditCommand>(new BatchEditCommand(app, std::move(name), std::move(edits)));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "app.h"
+#include <string>
+#include <vector>
+
+// Per-note transform for a batch edit. Steps run in the order listed here;
+// anything left at its default is skipped.
+struct BatchTransform {
+    int transpose = 0;              // Semitones
+    int32_t timeShift = 0;          // Ticks, start clamps at 0
+    int32_t resizeDelta = 0;        // Ticks added to the right edge...
+    bool resizeFromLeft = false;    // ...or to the start, keeping the end fixed
+    uint32_t quantizeGrid = 0;      // Snap start down to this many ticks, 0 = off
+    float velocityScale = 1.0f;
+    uint32_t humanizeTicks = 0;     // Random start offset, +/- this many ticks
+    int humanizeVelocity = 0;       // Random velocity offset, +/- this much
+    uint64_t seed = 0;              // Humanize seed
+
+    // `n` is the note's position in the selection. Humanize hashes it with
+    // the seed, so results don't depend on how the work was split up.
+    midi::Note apply(const midi::Note& note, size_t n) const;
+};
+
+// One undoable command for a transform over the selected notes of one or
+// more tracks. The transform runs once, in create() (split across threads
+// for very large selections); the command then only stores the notes that
+// actually changed, as packed before/after lists in track order. Execute
+// and undo swap one list for the other with a linear remove + merge, so
+// the track never needs a full re-sort.
+class BatchEditCommand : public Command {
+public:
+    // Returns null when no selected note would change
+    static std::unique_ptr<BatchEditCommand> create(App& app, const std::vector<int>& trackIndices,
+                                                    const BatchTransform& transform, std::string name);
+    static std::unique_ptr<BatchEditCommand> read(App& app, midi::ByteReader& in);
+
+    void execute() override;
+    void undo() override;
+    std::string getName() const override { return name_; }
+    size_t memoryUsage() const override;
+    CommandType getType() const override { return CommandType::BatchEdit; }
+    void serialize(midi::ByteWriter& out) const override;
+
+    size_t noteCount() const;
+
+private:
+    struct TrackEdit {
+        int trackIndex = 0;
+        midi::PackedNotes before;
+        midi::PackedNotes after;
+    };
+
+    BatchEditCommand(App& app, std::string name, std::vector<TrackEdit> edits);
+    void apply(bool forward);
+
+    App& app_;
+    std::string name_;
+    std::vector<TrackEdit> edits_;
+};
@@ -0,0 +1,397 @@
+#include "edit_journal.h"
+#include "midi/binary_io.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char JOURNAL_MAGIC[4] = {'M', 'E', 'J', '1'};
+static constexpr uint32_t JOURNAL_VERSION = 4;
+static constexpr size_t JOURNAL_HEADER_SIZE = 8;
+static constexpr size_t RECORD_HEADER_SIZE = 5;
+static constexpr auto RETRY_WAIT = std::chrono::seconds(1);  // After a failed write
+
+EditJournal::EditJournal() = default;
+
+EditJournal::~EditJournal() {
+    close(false);
+}
+
+bool EditJournal::open(const std::string& path) {
+    if (open_) close(false);
+    if (path.empty()) return false;
+
+    if (!lock_.acquire(path + ".lock")) {
+        fprintf(stderr, "Journal error: %s is in use by another instance\n", path.c_str());
+        return false;
+    }
+
+    path_ = path;
+    stop_ = false;
+    truncatePending_ = false;
+    pending_.clear();
+    queuedGeneration_ = 0;
+    writtenGeneration_ = 0;
+
+    writer_ = std::thread(&EditJournal::writerLoop, this);
+    open_ = true;
+    return true;
+}
+
+void EditJournal::close(bool removeFile) {
+    if (!open_) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    open_ = false;
+
+    if (removeFile) {
+        std::remove(path_.c_str());
+    }
+    lock_.release();
+}
+
+void EditJournal::begin(const midi::Project& project) {
+    if (!open_) return;
+
+    // Serialize outside the lock so the writer thread is never held up
+    std::vector<uint8_t> snapshot;
+    midi::ByteWriter writer(snapshot);
+    writer.project(project);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.clear();
+        pending_.insert(pending_.end(), JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+        midi::ByteWriter header(pending_);
+        header.u32(JOURNAL_VERSION);
+        appendRecord(pending_, JournalOp::Snapshot, snapshot.data(), snapshot.size());
+        truncatePending_ = true;
+        ++queuedGeneration_;
+    }
+    wake_.notify_one();
+}
+
+void EditJournal::append(JournalOp op, const std::vector<uint8_t>& payload) {
+    if (!open_) return;
+
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wasEmpty = pending_.empty();
+        appendRecord(pending_, op, payload.data(), payload.size());
+        ++queuedGeneration_;
+    }
+    // The writer drains everything pending in one go, so it only needs a
+    // wake-up for the first record of a batch
+    if (wasEmpty) wake_.notify_one();
+}
+
+void EditJournal::flush() {
+    if (!open_) return;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = queuedGeneration_;
+    flushed_.wait(lock, [&] { return writtenGeneration_ >= target || stop_; });
+}
+
+void EditJournal::appendRecord(std::vector<uint8_t>& buffer, JournalOp op,
+                               const uint8_t* data, size_t size) {
+    midi::ByteWriter writer(buffer);
+    writer.u8(static_cast<uint8_t>(op));
+    writer.u32(static_cast<uint32_t>(size));
+    if (size > 0) writer.bytes(data, size);
+}
+
+void EditJournal::writerLoop() {
+    std::FILE* file = nullptr;
+    bool started = false;    // The file has its header and snapshot
+    uint64_t goodSize = 0;   // Whole batches written so far
+    bool failed = false;
+    bool reportedError = false;
+    std::vector<uint8_t> batch;
+
+    while (true) {
+        bool truncate;
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (failed) {
+                // Give the disk a moment before trying again
+                wake_.wait_for(lock, RETRY_WAIT, [&] { return stop_; });
+            }
+            wake_.wait(lock, [&] { return stop_ || truncatePending_ || !pending_.empty(); });
+            if (stop_ && (failed || (pending_.empty() && !truncatePending_))) break;
+
+            batch.swap(pending_);
+            truncate = truncatePending_;
+            truncatePending_ = false;
+            generation = queuedGeneration_;
+        }
+
+        // begin() always truncates: a stale journal from an earlier
+        // session must never get new records appended to it. Records
+        // queued before a snapshot made it to disk have nothing to replay
+        // onto, so they're dropped.
+        bool ok = true;
+        if (truncate) {
+            if (file) std::fclose(file);
+            file = std::fopen(path_.c_str(), "wb");
+            started = false;
+            goodSize = 0;
+            ok = file != nullptr;
+        } else if (!file && started) {
+            file = std::fopen(path_.c_str(), "ab");
+            ok = file != nullptr;
+        }
+
+        if (file && !batch.empty()) {
+            ok = std::fwrite(batch.data(), 1, batch.size(), file) == batch.size() && std::fflush(file) == 0;
+            if (ok) {
+                goodSize += batch.size();
+                started = true;
+            } else {
+                // Cut off the part that made it, or the records after it
+                // would be read from the middle of one
+                std::fclose(file);
+                file = nullptr;
+                std::error_code ec;
+                std::filesystem::resize_file(path_, goodSize, ec);
+                if (ec) started = false;
+            }
+        }
+
+        if (!ok) {
+            if (!reportedError) {
+                fprintf(stderr, "Journal error: Cannot write %s\n", path_.c_str());
+                reportedError = true;
+            }
+            // Keep the batch (with the header and snapshot, if it had them)
+            // for the next try, unless begin() has started over meanwhile
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!truncatePending_ && (started || truncate)) {
+                batch.insert(batch.end(), pending_.begin(), pending_.end());
+                pending_.swap(batch);
+                truncatePending_ = truncate || !started;
+            }
+        } else {
+            reportedError = false;
+        }
+        failed = !ok;
+        batch.clear();
+
+        {
+            // flush() doesn't wait out a failing disk
+            std::lock_guard<std::mutex> lock(mutex_);
+            writtenGeneration_ = generation;
+        }
+        flushed_.notify_all();
+    }
+
+    if (file) std::fclose(file);
+    flushed_.notify_all();
+}
+
+bool EditJournal::readFile(const std::string& path, const RecordCallback& callback) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < JOURNAL_HEADER_SIZE || std::memcmp(data.data(), JOURNAL_MAGIC, 4) != 0) {
+        fprintf(stderr, "Journal error: %s is not a journal file\n", path.c_str());
+        return false;
+    }
+
+    midi::ByteReader header(data.data() + 4, 4);
+    if (header.u32() != JOURNAL_VERSION) {
+        fprintf(stderr, "Journal error: Unsupported journal version in %s\n", path.c_str());
+        return false;
+    }
+
+    size_t pos = JOURNAL_HEADER_SIZE;
+    while (data.size() - pos >= RECORD_HEADER_SIZE) {
+        midi::ByteReader rec(data.data() + pos, RECORD_HEADER_SIZE);
+        JournalOp op = static_cast<JournalOp>(rec.u8());
+        uint32_t size = rec.u32();
+        pos += RECORD_HEADER_SIZE;
+
+        // Incomplete trailing record: the crash happened mid-write
+        if (data.size() - pos < size) break;
+
+        if (!callback(op, data.data() + pos, size)) return false;
+        pos += size;
+    }
+    return true;
+}
+
+bool EditJournal::hasEdits(const std::string& path) {
+    int records = 0;
+    readFile(path, [&](JournalOp, const uint8_t*, size_t) {
+        return ++records < 2;
+    });
+    return records >= 2;
+}
+
+bool EditJournal::OwnerLock::acquire(const std::string& path) {
+    release();
+#ifdef _WIN32
+    // No sharing: nobody else can open it while we have it
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    handle_ = handle;
+    path_ = path;
+    return true;
+#else
+    // release() deletes the file while it still holds the lock, so one
+    // opened before that can be locked once it's gone. Only a lock on the
+    // file that's at the path now counts; otherwise try the new one.
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) return false;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(fd);
+            return false;
+        }
+        struct stat locked, current;
+        if (fstat(fd, &locked) == 0 && stat(path.c_str(), &current) == 0 &&
+            locked.st_dev == current.st_dev && locked.st_ino == current.st_ino) {
+            fd_ = fd;
+            path_ = path;
+            return true;
+        }
+        ::close(fd);
+    }
+    return false;
+#endif
+}
+
+void EditJournal::OwnerLock::release() {
+    if (path_.empty()) return;
+#ifdef _WIN32
+    // Anyone who opened it meanwhile has it without sharing, which makes
+    // the delete fail rather than pull it from under them
+    CloseHandle(static_cast<HANDLE>(handle_));
+    handle_ = nullptr;
+    DeleteFileA(path_.c_str());
+#else
+    // Delete it before unlocking (see acquire)
+    unlink(path_.c_str());
+    ::close(fd_);
+    fd_ = -1;
+#endif
+    path_.clear();
+}
+
+void EditJournal::OwnerLock::swap(OwnerLock& other) noexcept {
+    std::swap(path_, other.path_);
+#ifdef _WIN32
+    std::swap(handle_, other.handle_);
+#else
+    std::swap(fd_, other.fd_);
+#endif
+}
+
+std::string EditJournal::defaultDirectory() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+
+    // The platform's place for per-user app state, then the temp directory
+    std::vector<fs::path> candidates;
+#ifdef _WIN32
+    if (const char* local = std::getenv("LOCALAPPDATA")) candidates.push_back(fs::path(local) / "midi_editor");
+#elif defined(__APPLE__)
+    if (const char* home = std::getenv("HOME")) {
+        candidates.push_back(fs::path(home) / "Library" / "Application Support" / "midi_editor");
+    }
+#else
+    const char* state = std::getenv("XDG_STATE_HOME");
+    const char* home = std::getenv("HOME");
+    if (state && *state) candidates.push_back(fs::path(state) / "midi_editor");
+    else if (home && *home) candidates.push_back(fs::path(home) / ".local" / "state" / "midi_editor");
+#endif
+    fs::path temp = fs::temp_directory_path(ec);
+    if (!ec) {
+#ifdef _WIN32
+        candidates.push_back(temp / "midi_editor");  // Already per user
+#else
+        candidates.push_back(temp / ("midi_editor-" + std::to_string(getuid())));
+#endif
+    }
+
+    for (const auto& candidate : candidates) {
+        fs::path dir = candidate / "journal";
+        fs::create_directories(dir, ec);
+        if (ec) continue;
+        // Edits are nobody else's business
+        fs::permissions(candidate, fs::perms::owner_all, ec);
+        fs::permissions(dir, fs::perms::owner_all, ec);
+        return dir.string();
+    }
+    fprintf(stderr, "Journal error: No directory for the edit journal\n");
+    return "";
+}
+
+std::string EditJournal::instancePath(const std::string& directory) {
+#ifdef _WIN32
+    std::string base = "journal-" + std::to_string(GetCurrentProcessId());
+#else
+    std::string base = "journal-" + std::to_string(getpid());
+#endif
+    // A dead process with the same pid may have left one behind
+    std::filesystem::path dir(directory);
+    std::error_code ec;
+    for (int n = 0;; ++n) {
+        std::filesystem::path path = dir / (n == 0 ? base + ".bin" : base + "-" + std::to_string(n) + ".bin");
+        if (!std::filesystem::exists(path, ec)) return path.string();
+    }
+}
+
+std::string EditJournal::claimOrphan(const std::string& directory, OwnerLock& lock) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::string newest;
+    fs::file_time_type newestTime{};
+
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("journal-", 0) != 0 || entry.path().extension() != ".bin") continue;
+        std::string path = entry.path().string();
+
+        OwnerLock owner;
+        if (!owner.acquire(path + ".lock")) continue;  // Its instance is still running, or it's claimed
+        if (!hasEdits(path)) {
+            std::remove(path.c_str());
+            continue;
+        }
+        // The best so far stays locked, so no other instance can claim it
+        // between the scan and the caller taking it over
+        auto time = fs::last_write_time(entry.path(), ec);
+        if (newest.empty() || time > newestTime) {
+            newest = path;
+            newestTime = time;
+            lock = std::move(owner);
+        }
+    }
+    return newest;
+}
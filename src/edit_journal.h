@@ -0,0 +1,131 @@
+#pragma once
+
+#include "midi/types.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Record types stored in the edit journal
+enum class JournalOp : uint8_t {
+    Snapshot = 1,   // Full project state, always the first record
+    Execute,        // A Command passed through App::executeCommand
+    Undo,
+    Redo,
+    NoteEdits,      // Direct note edits (piano roll drag/resize, velocity lane)
+    AddTrack,
+    RemoveTrack
+};
+
+// Append-only crash recovery journal.
+//
+// The UI thread only appends small binary records to an in-memory buffer;
+// a background thread writes them to disk and flushes. Every time the
+// project is loaded, saved or reset the journal is restarted with a fresh
+// snapshot, so recovery is "last snapshot + replay of the records after it".
+//
+// File layout: "MEJ1" magic, u32 version, then records of
+// [u8 op][u32 payload size][payload].
+//
+// Journals live in a per-user directory, one per running instance
+// (journal-<pid>.bin). The instance holds an OS lock on <journal>.lock
+// while it runs, which goes away with the process, so a journal whose
+// lock can be taken was left behind by a session that's gone.
+class EditJournal {
+public:
+    // Exclusive, non-blocking lock on a file; deleted on release
+    class OwnerLock {
+    public:
+        OwnerLock() = default;
+        ~OwnerLock() { release(); }
+        OwnerLock(const OwnerLock&) = delete;
+        OwnerLock& operator=(const OwnerLock&) = delete;
+        OwnerLock(OwnerLock&& other) noexcept { swap(other); }
+        OwnerLock& operator=(OwnerLock&& other) noexcept {
+            release();
+            swap(other);
+            return *this;
+        }
+
+        bool acquire(const std::string& path);  // False if someone else holds it
+        void release();
+        bool held() const { return !path_.empty(); }
+
+    private:
+        void swap(OwnerLock& other) noexcept;
+
+        std::string path_;
+#ifdef _WIN32
+        void* handle_ = nullptr;
+#else
+        int fd_ = -1;
+#endif
+    };
+
+    EditJournal();
+    ~EditJournal();
+
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    // Start the writer thread and take the journal's lock. Nothing is
+    // written until begin() is called.
+    bool open(const std::string& path);
+    // Stop the writer thread after flushing. Optionally delete the file
+    // (clean shutdown, nothing to recover).
+    void close(bool removeFile);
+    bool isOpen() const { return open_; }
+    const std::string& getPath() const { return path_; }
+
+    // Truncate the journal and write a full snapshot of the project
+    void begin(const midi::Project& project);
+
+    // Queue a record. Cheap: just a copy into the pending buffer.
+    void append(JournalOp op, const std::vector<uint8_t>& payload);
+    void append(JournalOp op) { append(op, {}); }
+
+    // Block until everything queued so far has been written and flushed
+    void flush();
+
+    // Read a journal file back. The callback gets each complete record in
+    // order; a truncated trailing record (crash mid-write) is ignored.
+    using RecordCallback = std::function<bool(JournalOp op, const uint8_t* data, size_t size)>;
+    static bool readFile(const std::string& path, const RecordCallback& callback);
+
+    // True if the file holds any edits on top of its snapshot
+    static bool hasEdits(const std::string& path);
+
+    // This user's journal directory (created if needed), "" if there's
+    // nowhere to put it
+    static std::string defaultDirectory();
+    // A file name in `directory` for this instance's journal
+    static std::string instancePath(const std::string& directory);
+    // The newest journal in `directory` with edits whose instance is gone,
+    // with its lock taken into `lock` so no other instance offers it too.
+    // Leftovers without edits are deleted. "" if there's none.
+    static std::string claimOrphan(const std::string& directory, OwnerLock& lock);
+
+private:
+    void writerLoop();
+    void appendRecord(std::vector<uint8_t>& buffer, JournalOp op,
+                      const uint8_t* data, size_t size);
+
+    std::string path_;
+    bool open_ = false;
+    OwnerLock lock_;
+
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+
+    // Guarded by mutex_
+    std::vector<uint8_t> pending_;
+    bool truncatePending_ = false;
+    bool stop_ = false;
+    uint64_t queuedGeneration_ = 0;
+    uint64_t writtenGeneration_ = 0;
+};
@@ -1,4 +1,6 @@
 #include "app.h"
+#include "profiler.h"
+#include "startup_timeline.h"
 #include "ui/main_window.h"
 
 #include <imgui.h>
@@ -15,6 +17,14 @@ static void glfw_error_callback(int error, const char* description) {
 }
 
 int main(int argc, char** argv) {
+    auto& timeline = StartupTimeline::get();
+    auto phaseStart = timeline.launchTime();
+    auto endPhase = [&](const char* phase) {
+        auto now = StartupTimeline::Clock::now();
+        timeline.record(phase, phaseStart, now);
+        phaseStart = now;
+    };
+
     // Setup GLFW
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit()) {
@@ -38,6 +48,7 @@ int main(int argc, char** argv) {
     }
     glfwMakeContextCurrent(window);
     glfwSwapInterval(1); // Enable vsync
+    endPhase("window");
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
@@ -61,6 +72,7 @@ int main(int argc, char** argv) {
     // Setup Platform/Renderer backends
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
+    endPhase("imgui");
 
     // Initialize application
     App app;
@@ -70,9 +82,12 @@ int main(int argc, char** argv) {
     if (argc > 1) {
         app.loadFile(argv[1]);
     }
+    endPhase("app");
+    bool firstFrame = true;
 
     // Main loop
     while (!glfwWindowShouldClose(window)) {
+        PROFILE_FRAME();
         glfwPollEvents();
 
         // Start the Dear ImGui frame
@@ -81,18 +96,35 @@ int main(int argc, char** argv) {
         ImGui::NewFrame();
 
         // Render main window
-        mainWindow.render();
+        {
+            PROFILE_SCOPE("UI");
+            mainWindow.render();
+        }
 
         // Rendering
-        ImGui::Render();
-        int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
-        glViewport(0, 0, display_w, display_h);
-        glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("GL submit");
+            ImGui::Render();
+            int display_w, display_h;
+            glfwGetFramebufferSize(window, &display_w, &display_h);
+            glViewport(0, 0, display_w, display_h);
+            glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        // Includes the vsync wait
+        {
+            PROFILE_SCOPE("Swap");
+            glfwSwapBuffers(window);
+        }
+
+        // Audio and MIDI come up once there's something on screen
+        if (firstFrame) {
+            endPhase("first frame");
+            mainWindow.startAudio();
+            firstFrame = false;
+        }
     }
 
     // Cleanup
@@ -0,0 +1,67 @@
+#include "alloc_trap.h"
+
+#ifdef AUDIO_ALLOC_TRAP
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace midi {
+
+static thread_local int armed = 0;
+
+NoAllocScope::NoAllocScope() {
+    ++armed;
+}
+
+NoAllocScope::~NoAllocScope() {
+    --armed;
+}
+
+void checkAlloc(const char* what) {
+    if (armed == 0) return;
+    armed = 0;  // fprintf below may allocate itself
+    fprintf(stderr, "Audio error: %s on a real-time thread\n", what);
+    std::abort();
+}
+
+} // namespace midi
+
+// Replacements for the global allocation functions (nothing here uses the
+// aligned forms)
+void* operator new(std::size_t size) {
+    midi::checkAlloc("operator new");
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    midi::checkAlloc("operator new");
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    midi::checkAlloc("operator delete");
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+#endif
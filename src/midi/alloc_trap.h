@@ -0,0 +1,30 @@
+#pragma once
+
+// Debug check that real-time code never touches the heap. With
+// AUDIO_ALLOC_TRAP defined (-DENABLE_ALLOC_TRAP=ON), AUDIO_NO_ALLOC_SCOPE()
+// arms the trap on the calling thread for the rest of the block, and any
+// operator new/delete (or checkAlloc() from a C allocator hook) while it's
+// armed prints what happened and aborts. Compiles to nothing otherwise.
+namespace midi {
+
+#ifdef AUDIO_ALLOC_TRAP
+class NoAllocScope {
+public:
+    NoAllocScope();
+    ~NoAllocScope();
+    NoAllocScope(const NoAllocScope&) = delete;
+    NoAllocScope& operator=(const NoAllocScope&) = delete;
+};
+
+void checkAlloc(const char* what);
+#else
+inline void checkAlloc(const char*) {}
+#endif
+
+} // namespace midi
+
+#ifdef AUDIO_ALLOC_TRAP
+#define AUDIO_NO_ALLOC_SCOPE() midi::NoAllocScope noAllocScope_
+#else
+#define AUDIO_NO_ALLOC_SCOPE() do {} while (0)
+#endif
@@ -9,14 +9,35 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "../../third_party/miniaudio.h"
 
+// Sample data comes from a SamplePager instead of being converted up front
+struct tsf_riffchunk;
+struct tsf_stream;
+namespace midi {
+static int loadSamplesPaged(float** pFloatBuffer, unsigned int* pSmplCount, tsf_riffchunk* chunk, tsf_stream* stream);
+}
+#define TSF_LOAD_SAMPLES midi::loadSamplesPaged
+#define TSF_FREE_SAMPLES(p) ((void)(p))  // Owned by the SamplePager
+
+// tsf's allocations go through the real-time allocation check too
+#include "alloc_trap.h"
+#include <stdlib.h>
+#define TSF_MALLOC(size) (midi::checkAlloc("tsf malloc"), malloc(size))
+#define TSF_REALLOC(p, size) (midi::checkAlloc("tsf realloc"), realloc(p, size))
+#define TSF_FREE(p) (midi::checkAlloc("tsf free"), free(p))
+
 #define TSF_IMPLEMENTATION
 #include "../../third_party/tsf.h"
 
 #include "audio_synth.h"
+#include "sample_pager.h"
+#include "render_workers.h"
 #include <cmath>
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 
 namespace midi {
 
@@ -39,51 +60,507 @@ namespace midi {
         return 0.0;
 }
 
-// Simple oscillator for when no SoundFont is loaded
+// Simple oscillator for when no SoundFont is loaded. Each note is bound
+// to its program category's kernel when it starts, with the frequency and
+// velocity gain worked out then, so rendering a sample is one indirect
+// call with no per-sample lookups or category switch.
+//
+// The envelope is a recurrence: `level` moves by `slope` each sample and
+// the held fade multiplies by `fadeMul`, so a sample costs a multiply-add
+// and a multiply. The stage (attack, decay, sustain, fade, release) only
+// changes when `sample` reaches `stageEnd`, worked out in samples when the
+// stage starts.
 struct SimpleVoice {
+    using Kernel = float (*)(SimpleVoice&);
+
     bool active = false;
     int pitch = 60;
     int velocity = 0;
     int channel = 0;
+    Kernel kernel = nullptr;
     double phase = 0.0;
-    double releasePhase = 0.0;
+    double phaseInc = 0.0;  // Frequency over the sample rate
+    double dt = 0.0;        // Seconds per sample
+    float gain = 0.0f;      // Velocity curve
     bool releasing = false;
+    bool inRelease = false;  // The release stage has started
+    double level = 0.0;
+    double slope = 0.0;
+    double fade = 1.0;
+    double fadeMul = 1.0;
+    uint64_t sample = 0;    // Samples since the note started
+    uint64_t stageEnd = 1;  // Sample the next stage starts at
+
+    // Back to the attack: the kernel sets it up on the next sample
+    void restart() {
+        releasing = false;
+        inRelease = false;
+        sample = 0;
+        stageEnd = 1;
+    }
+    // Into the release from the next sample
+    void release() {
+        releasing = true;
+        inRelease = false;
+        stageEnd = sample + 1;
+    }
+};
+
+// The envelope every category shares: ADSR, plus an optional exponential
+// fade while held (fadeRate per second, from fadeStart seconds)
+struct SimpleEnvelope {
+    static constexpr double attackTime = 0.01;
+    static constexpr double decayTime = 0.1;
+    static constexpr double sustainLevel = 0.7;
+    static constexpr double releaseTime = 0.3;
+    static constexpr double fadeStart = 0.0;
+    static constexpr double fadeRate = 0.0;
+};
+
+template <size_t N>
+static double sumPartials(const std::array<double, N>& amps, double phase) {
+    double sample = 0.0;
+    for (size_t k = 0; k < N; ++k) sample += amps[k] * std::sin(2.0 * M_PI * static_cast<double>(k + 1) * phase);
+    return sample;
+}
+
+// Band-limited square: sawtooth minus a phase-shifted sawtooth
+static double polyBlepSquare(double phase, double phaseInc) {
+    double saw1 = 2.0 * phase - 1.0;
+    saw1 -= polyBlep(phase, phaseInc);
+    double phase2 = phase + 0.5;
+    phase2 -= std::floor(phase2);
+    double saw2 = 2.0 * phase2 - 1.0;
+    saw2 -= polyBlep(phase2, phaseInc);
+    return saw1 - saw2;
+}
+
+// Timbres per program category (program / 8). wave() gets the phase
+// (0..1), the phase increment and the time since the note started.
+//see https://en.wikipedia.org/wiki/Additive_synthesis for a detailed explanation.
+//  We mix sine waves to create the "timbre" or "color" of the sound.
+struct PianoTimbre : SimpleEnvelope {  // Piano, Chromatic Percussion
+    static constexpr double fadeStart = 0.5;  // Quick decay for piano-like sounds
+    static constexpr double fadeRate = 2.0;
+    static constexpr std::array<double, 3> partials{{0.5, 0.25, 0.125}};
+    static double wave(double phase, double, double) { return sumPartials(partials, phase); }
+};
+
+struct OrganTimbre : SimpleEnvelope {  // Additive harmonics
+    static constexpr std::array<double, 4> partials{{0.4, 0.3, 0.2, 0.1}};
+    static double wave(double phase, double, double) { return sumPartials(partials, phase); }
+};
+
+struct PluckedTimbre : SimpleEnvelope {  // Guitar, Bass
+    static constexpr double fadeStart = 0.1;
+    static constexpr double fadeRate = 3.0;
+    static double wave(double phase, double, double) {
+        return std::sin(2.0 * M_PI * phase) * (1.0 + 0.3 * std::sin(4.0 * M_PI * phase));
+    }
+};
+
+struct EnsembleTimbre : SimpleEnvelope {  // Strings, Ensemble
+    // Slight detuning for string ensemble effect
+    static double wave(double phase, double, double) {
+        return 0.5 * std::sin(2.0 * M_PI * phase) +
+               0.3 * std::sin(2.0 * M_PI * phase * 1.002) +
+               0.2 * std::sin(2.0 * M_PI * phase * 0.998);
+    }
+};
+
+struct ReedTimbre : SimpleEnvelope {  // Brass, Reed -- PolyBLEP sawtooth
+    static double wave(double phase, double phaseInc, double) {
+        double sample = 2.0 * phase - 1.0;
+        sample -= polyBlep(phase, phaseInc);
+        return sample * 0.7 + 0.3 * std::sin(2.0 * M_PI * phase);
+    }
+};
+
+struct PipeTimbre : SimpleEnvelope {  // Pure sine with slight vibrato
+    static double wave(double phase, double, double time) {
+        return std::sin(2.0 * M_PI * phase + 0.02 * std::sin(5.0 * time));
+    }
+};
+
+struct SynthTimbre : SimpleEnvelope {  // Synth Lead, Synth Pad -- PolyBLEP square
+    static double wave(double phase, double phaseInc, double) { return 0.8 * polyBlepSquare(phase, phaseInc); }
+};
+
+struct TriangleTimbre : SimpleEnvelope {  // Effects, Ethnic, Percussive, Sound Effects
+    static double wave(double phase, double phaseInc, double) {
+        // Triangle blended with the band-limited square for better quality
+        double triangle = 4.0 * std::abs(phase - 0.5) - 1.0;
+        return 0.5 * triangle + 0.5 * polyBlepSquare(phase, phaseInc);
+    }
+};
+
+// First sample at or past `seconds`
+static uint64_t stageSample(double seconds, double dt) {
+    return static_cast<uint64_t>(std::ceil(seconds / dt));
+}
+
+// Set up the envelope stage starting at voice.sample, so that the next
+// `level += slope` lands on it. False once the release is over.
+template <typename T>
+static bool nextStage(SimpleVoice& voice) {
+    const double dt = voice.dt;
+    const uint64_t n = voice.sample;
+
+    if (voice.releasing) {
+        if (voice.inRelease) {
+            voice.active = false;
+            return false;
+        }
+        // Down from the sustain level, wherever the envelope was
+        voice.inRelease = true;
+        voice.slope = -T::sustainLevel * dt / T::releaseTime;
+        voice.level = T::sustainLevel;
+        voice.fade = 1.0;
+        voice.fadeMul = 1.0;
+        voice.stageEnd = n - 1 + stageSample(T::releaseTime, dt);
+        return true;
+    }
+
+    const uint64_t attackEnd = stageSample(T::attackTime, dt);
+    const uint64_t decayEnd = stageSample(T::attackTime + T::decayTime, dt);
+    const double time = static_cast<double>(n) * dt;
+    double value;
+    if (n < attackEnd) {
+        voice.slope = dt / T::attackTime;
+        value = time / T::attackTime;
+        voice.stageEnd = attackEnd;
+    } else if (n < decayEnd) {
+        voice.slope = -(1.0 - T::sustainLevel) * dt / T::decayTime;
+        value = 1.0 - (1.0 - T::sustainLevel) * (time - T::attackTime) / T::decayTime;
+        voice.stageEnd = decayEnd;
+    } else {
+        voice.slope = 0.0;
+        value = T::sustainLevel;
+        voice.stageEnd = UINT64_MAX;
+    }
+    voice.level = value - voice.slope;
+
+    voice.fade = 1.0;
+    voice.fadeMul = 1.0;
+    if constexpr (T::fadeRate > 0.0) {
+        const uint64_t fadeFrom = static_cast<uint64_t>(std::floor(T::fadeStart / dt)) + 1;  // First sample past fadeStart
+        if (n >= fadeFrom) {
+            voice.fadeMul = std::exp(-T::fadeRate * dt);
+            voice.fade = std::exp(-T::fadeRate * (time - T::fadeStart)) / voice.fadeMul;
+        } else {
+            voice.stageEnd = std::min(voice.stageEnd, fadeFrom);
+        }
+    }
+    return true;
+}
 
-    // ADSR envelope
-    double envelope = 0.0;
-    double attackTime = 0.01;
-    double decayTime = 0.1;
-    double sustainLevel = 0.7;
-    double releaseTime = 0.3;
-    double time = 0.0;
+// One sample of a voice with timbre T
+template <typename T>
+static float simpleKernel(SimpleVoice& voice) {
+    if (++voice.sample == voice.stageEnd && !nextStage<T>(voice)) return 0.0f;
+    voice.level += voice.slope;
+    voice.fade *= voice.fadeMul;
+
+    voice.phase += voice.phaseInc;
+    voice.phase -= std::floor(voice.phase);  // Modulo 1.0 without drift
+
+    const double time = static_cast<double>(voice.sample) * voice.dt;  // Only the vibrato uses it
+    return static_cast<float>(T::wave(voice.phase, voice.phaseInc, time) * voice.level * voice.fade) * voice.gain;
+}
+
+static constexpr std::array<SimpleVoice::Kernel, 16> SIMPLE_KERNELS{{
+    &simpleKernel<PianoTimbre>, &simpleKernel<PianoTimbre>,
+    &simpleKernel<OrganTimbre>,
+    &simpleKernel<PluckedTimbre>, &simpleKernel<PluckedTimbre>,
+    &simpleKernel<EnsembleTimbre>, &simpleKernel<EnsembleTimbre>,
+    &simpleKernel<ReedTimbre>, &simpleKernel<ReedTimbre>,
+    &simpleKernel<PipeTimbre>,
+    &simpleKernel<SynthTimbre>, &simpleKernel<SynthTimbre>,
+    &simpleKernel<TriangleTimbre>, &simpleKernel<TriangleTimbre>,
+    &simpleKernel<TriangleTimbre>, &simpleKernel<TriangleTimbre>,
+}};
+
+// tsf_stream over a file, in chunks so a big sample chunk still moves
+// the progress along; reads fail once the load is cancelled
+struct LoadStream {
+    FILE* file;
+    size_t size;
+    size_t done;  // Also the file position
+    std::atomic<float>* progress;
+    std::atomic<bool>* cancel;
+    std::string path;
+    SamplePager* pager;  // Gets the sample chunk
+
+    static constexpr size_t CHUNK = 1 << 20;
+
+    static int read(void* data, void* ptr, unsigned int size) {
+        auto* stream = static_cast<LoadStream*>(data);
+        auto* out = static_cast<char*>(ptr);
+        size_t total = 0;
+        while (total < size) {
+            if (stream->cancel->load(std::memory_order_relaxed)) return 0;
+            size_t n = fread(out + total, 1, std::min<size_t>(CHUNK, size - total), stream->file);
+            if (n == 0) break;
+            total += n;
+            stream->advance(n);
+        }
+        return static_cast<int>(total);
+    }
+
+    static int skip(void* data, unsigned int count) {
+        auto* stream = static_cast<LoadStream*>(data);
+        if (stream->cancel->load(std::memory_order_relaxed)) return 0;
+        if (fseek(stream->file, count, SEEK_CUR) != 0) return 0;
+        stream->advance(count);
+        return 1;
+    }
+
+    void advance(size_t n) {
+        done += n;
+        progress->store(std::min(1.0f, static_cast<float>(done) / size), std::memory_order_relaxed);
+    }
 };
 
+// TSF_LOAD_SAMPLES: map the sample chunk where it is in the file and skip it
+static int loadSamplesPaged(float** pFloatBuffer, unsigned int* pSmplCount, tsf_riffchunk* chunk, tsf_stream* stream) {
+    auto* load = static_cast<LoadStream*>(stream->data);
+    uint32_t count = chunk->size / sizeof(int16_t);
+    if (!load->pager->open(load->path, load->done, count)) return 0;
+    if (!stream->skip(stream->data, chunk->size)) return 0;
+    *pFloatBuffer = load->pager->samples();
+    *pSmplCount = count;
+    return 1;
+}
+
+// The preset tsf_channel_set_presetnumber() picks for `program` (bank 0)
+static int presetIndex(const tsf* sf, int channel, int program) {
+    int index = -1;
+    if (channel == 9) {
+        index = tsf_get_presetindex(sf, 128, program);
+        if (index == -1) index = tsf_get_presetindex(sf, 128, 0);
+    }
+    if (index == -1) index = tsf_get_presetindex(sf, 0, program);
+    return index;
+}
+
+static void pageRegion(SamplePager& pager, const tsf_region& region) {
+    uint32_t first = region.offset, end = region.end;
+    if (region.loop_start < region.loop_end) {
+        first = std::min(first, region.loop_start);
+        end = std::max(end, region.loop_end);
+    }
+    // One past the end: tsf interpolates with the next sample
+    pager.pageIn(first, end + 2);
+}
+
 struct AudioSynth::Impl {
+    ma_context context;
     ma_device device;
     ma_device_config deviceConfig;
 
-    // SoundFont pointer -- guarded by sfMutex
-    tsf* soundFont = nullptr;
-    std::mutex sfMutex;
+    // The SoundFont in use. Once swapped in only the audio thread touches
+    // it (tsf isn't thread-safe): notes and program changes get there
+    // through liveQueue. The pointer is swapped without a lock and read
+    // once per callback, so one swapped out can go once a callback that
+    // started after the swap has finished (see reclaimFonts).
+    std::atomic<tsf*> soundFont{nullptr};
+    tsf* activeFont = nullptr;  // Audio thread: soundFont for this callback
+    tsf* lastFont = nullptr;    // Audio thread: the one set up for (see adoptFont)
+    std::atomic<bool> deviceRunning{false};  // Else nothing can be using a retired one
+
+    // The font as loaded, which soundFont is a copy of: same presets and
+    // samples, but never played, so paging and renderOffline can read it.
+    // Swapped along with it and its sample data under pagerMutex. A paging
+    // thread keeps what the channels and the project's programs play paged
+    // in, and the least recently used rest within sampleCacheBytes.
+    tsf* baseFont = nullptr;
+    std::unique_ptr<SamplePager> pager;
+    std::mutex pagerMutex;
+    struct RetiredFont {
+        tsf* font;
+        tsf* base;
+        std::unique_ptr<SamplePager> pager;
+        uint64_t frame;  // framesRendered at the swap
+    };
+    std::vector<RetiredFont> retiredFonts;  // Under pagerMutex
+    static constexpr auto RECLAIM_WAIT = std::chrono::milliseconds(50);
+    std::atomic<size_t> sampleCacheBytes{64u << 20};
+    std::atomic<size_t> sampleBytesResident{0};  // As of the last pass
+    std::atomic<size_t> sampleBytesTotal{0};
+    std::thread pagingThread;
+    std::mutex pagingMutex;  // Guards the three below
+    std::condition_variable pagingWake;
+    bool pagingRunning = true;
+    bool pagingPending = false;
+    std::vector<std::pair<int, int>> projectPrograms;  // (channel, program)
 
     AudioSynth* parent = nullptr;
 
-    // Simple synth voices (polyphony)
+    // Simple synth voices (polyphony); audio thread
     static constexpr int MAX_VOICES = 64;
     std::array<SimpleVoice, MAX_VOICES> voices;
-    std::mutex voicesMutex;
+
+    // Presets the SoundFont's voices are sounding, as of the last callback,
+    // for the paging thread: a voice can outlive its channel's program
+    // change. -1 ends the list.
+    static constexpr int MAX_SOUNDING_PRESETS = 64;
+    std::array<std::atomic<int>, MAX_SOUNDING_PRESETS> soundingPresets;
 
     // Per-channel program and volume/pan
-    std::array<int, 16> channelPrograms{};
-    std::array<float, 16> channelVolume{};
-    std::array<float, 16> channelPan{};  // 0.0=left, 0.5=center, 1.0=right
+    std::array<std::atomic<int>, 16> channelPrograms{};  // Also read by the loader
+    // Volume/pan targets, stored only when they change. The audio thread
+    // glides towards them so steps don't zipper: per sample for the simple
+    // synth, per MIX_BLOCK frames through tsf's channel volume/pan.
+    static constexpr double MIX_SMOOTHING = 0.01;  // Seconds
+    static constexpr ma_uint32 MIX_BLOCK = 64;
+    std::array<std::atomic<float>, 16> channelVolume{};
+    std::array<std::atomic<float>, 16> channelPan{};  // 0.0=left, 0.5=center, 1.0=right
+    // Audio thread only
+    std::array<float, 16> volumeTarget{}, panTarget{};  // This callback's targets
+    std::array<float, 16> mixVolume{}, mixPan{};        // Smoothed
+    // What the SoundFont's channels were last set to; -1 makes the next
+    // block set them
+    std::array<float, 16> fontVolume{}, fontPan{};
+
+    // SoundFont voices split across threads for high polyphony. Each part
+    // renders a run of sounding voices into its own block buffer, and the
+    // buffers are added up in part order, so the output doesn't depend on
+    // which thread finished first. Running with fewer sounding voices than
+    // VOICES_PER_PART per part isn't worth waking a thread for.
+    static constexpr int MAX_RENDER_THREADS = 8;
+    static constexpr int VOICES_PER_PART = 32;
+    RenderWorkers renderWorkers;  // Started with the device
+    int renderThreads = 1;        // Workers plus the audio thread
+    // Audio thread, for the parts of one block
+    std::array<std::array<float, MIX_BLOCK * 2>, MAX_RENDER_THREADS> partBuffers{};
+    std::array<int, MAX_RENDER_THREADS + 1> partVoices{};  // First voice index of each part
+    float* partOut = nullptr;
+    int partFrames = 0;
+
+    std::atomic<int> sampleRate{44100};  // The device's, set by openDevice() before the callback runs
+
+    // Audio clock: frames handed to the device so far
+    std::atomic<uint64_t> framesRendered{0};
+    // Stand-in clock while there's no audio device
+    std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+    // Clock reference, written by the audio thread under a sequence lock
+    std::atomic<uint32_t> clockSeq{0};
+    std::atomic<uint64_t> clockFrame{0};
+    std::atomic<int64_t> clockTime{0};
+    uint32_t latencyFrames = 0;  // Device buffering after the callback
+
+    // DSP load, published by the audio thread
+    static constexpr double LOAD_SMOOTHING = 0.3;  // Seconds
+    std::atomic<float> dspLoad{0.0f};
+    std::atomic<float> dspPeak{0.0f};
+    std::atomic<uint32_t> lateCallbacks{0};
+    std::atomic<uint32_t> underruns{0};
+    std::array<std::atomic<float>, 16> channelLoad{};
+    // Audio thread only
+    std::chrono::steady_clock::time_point lastCallbackEnd{};
+    double bufferedSeconds = 0.0;  // Estimated audio left in the device
+    double peakWindow = 0.0;       // Seconds into the current peak window
+    float windowPeak = 0.0f;
+    std::array<uint32_t, 16> voiceFrames{};
+
+    // Scheduled events: single-producer ring from the UI thread, moved into
+    // a heap ordered by (frame, seq) on the audio thread
+    struct ScheduledEvent {
+        uint64_t frame;
+        uint32_t seq;
+        uint32_t generation;
+        bool on;
+        uint8_t channel;
+        uint8_t pitch;
+        uint8_t velocity;
+    };
+    static constexpr size_t EVENT_QUEUE_SIZE = 8192;  // Power of two
+    std::array<ScheduledEvent, EVENT_QUEUE_SIZE> eventQueue;
+    std::atomic<size_t> eventHead{0};  // Written by the audio thread
+    std::atomic<size_t> eventTail{0};  // Written by the UI thread
+    std::atomic<uint32_t> generation{0};
+    uint32_t nextSeq = 0;              // UI thread
+    std::vector<ScheduledEvent> pending;  // Audio thread
+    uint32_t pendingGeneration = 0;       // Audio thread
+
+    static bool laterEvent(const ScheduledEvent& a, const ScheduledEvent& b) {
+        return a.frame != b.frame ? a.frame > b.frame : a.seq > b.seq;
+    }
 
-    int sampleRate = 44100;
+    // Notes and program changes to play now, from any thread (the UI, MIDI
+    // input). Producers take turns on liveMutex, which the audio thread
+    // never takes; it just drains the ring at the start of each callback.
+    enum LiveType : uint8_t { LIVE_NOTE_ON, LIVE_NOTE_OFF, LIVE_ALL_OFF, LIVE_PROGRAM };
+    struct LiveEvent {
+        LiveType type;
+        uint8_t channel;
+        uint8_t pitch;
+        uint8_t velocity;
+    };
+    static constexpr size_t LIVE_QUEUE_SIZE = 1024;  // Power of two
+    std::array<LiveEvent, LIVE_QUEUE_SIZE> liveQueue;
+    std::atomic<size_t> liveHead{0};  // Written by the audio thread
+    std::atomic<size_t> liveTail{0};  // Written under liveMutex
+    std::mutex liveMutex;
+
+    // Frozen tracks. The mix is swapped without a lock and read once per
+    // callback, so one swapped out can go once a callback that started
+    // after the swap has finished (see reclaimFrozen).
+    struct FrozenMix {
+        struct Track {
+            int channel;
+            std::vector<const float*> chunks;
+        };
+        std::vector<Track> tracks;
+        std::vector<AudioSynth::FreezeChunk> owned;  // Keeps the chunks alive
+    };
+    std::atomic<FrozenMix*> frozenMix{nullptr};
+    std::vector<std::pair<FrozenMix*, uint64_t>> retiredMixes;  // UI thread: (mix, framesRendered at the swap)
+    // Where on the song to play them: single-producer ring like eventQueue
+    struct FrozenSegment {
+        uint64_t frame;
+        uint64_t songFrame;
+        uint32_t frames;
+        uint32_t generation;
+    };
+    static constexpr size_t SEGMENT_QUEUE_SIZE = 256;  // Power of two
+    static constexpr uint64_t SEGMENT_JOIN_FRAMES = 32;  // Rounding slack for a segment continuing the last
+    std::array<FrozenSegment, SEGMENT_QUEUE_SIZE> segmentQueue;
+    std::atomic<size_t> segmentHead{0};  // Written by the audio thread
+    std::atomic<size_t> segmentTail{0};  // Written by the UI thread
+    // Audio thread
+    uint32_t segmentGeneration = 0;
+    bool streaming = false;    // The next segment may join the last one
+    uint64_t streamSong = 0;   // Song frame of the next frame out
+    uint64_t streamLeft = 0;   // Frames left in the current segment
 
     Impl() {
-        channelPrograms.fill(0);
-        channelVolume.fill(1.0f);
-        channelPan.fill(0.5f);
+        for (int ch = 0; ch < 16; ++ch) {
+            channelVolume[ch].store(1.0f, std::memory_order_relaxed);
+            channelPan[ch].store(0.5f, std::memory_order_relaxed);
+        }
+        mixVolume.fill(1.0f);
+        mixPan.fill(0.5f);
+        fontVolume.fill(-1.0f);
+        fontPan.fill(-1.0f);
+        for (auto& preset : soundingPresets) preset.store(-1, std::memory_order_relaxed);
+        pending.reserve(EVENT_QUEUE_SIZE);
+        pagingThread = std::thread(&Impl::pagingLoop, this);
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(pagingMutex);
+            pagingRunning = false;
+        }
+        pagingWake.notify_one();
+        pagingThread.join();
+        for (const auto& retired : retiredFonts) {
+            tsf_close(retired.font);
+            tsf_close(retired.base);
+        }
+        delete frozenMix.load();
+        for (const auto& retired : retiredMixes) delete retired.first;
     }
 
     SimpleVoice* findFreeVoice() {
@@ -108,185 +585,628 @@ struct AudioSynth::Impl {
         return nullptr;
     }
 
-    static double pitchToFreq(int pitch) {
-        return 440.0 * std::pow(2.0, (pitch - 69) / 12.0);
+    // Audio thread
+    void startVoice(int channel, int pitch, int velocity) {
+        // Check if note is already playing
+        auto* existing = findVoice(channel, pitch);
+        if (existing) {
+            existing->velocity = velocity;
+            existing->restart();
+            bindVoice(*existing);
+            return;
+        }
+
+        auto* voice = findFreeVoice();
+        if (voice) {
+            voice->active = true;
+            voice->pitch = pitch;
+            voice->velocity = velocity;
+            voice->channel = channel;
+            voice->phase = 0.0;
+            voice->restart();
+            bindVoice(*voice);
+        }
     }
 
-    // Generate a sample for a voice
-    float generateSample(SimpleVoice& voice, double dt) {
-        if (!voice.active) return 0.0f;
+    // Pick the kernel for the channel's program and precompute what it
+    // needs. A program change applies from the next note.
+    void bindVoice(SimpleVoice& voice) {
+        int program = channelPrograms[voice.channel & 0x0F].load(std::memory_order_relaxed);
+        voice.kernel = SIMPLE_KERNELS[std::max(0, std::min(127, program)) / 8];
+        voice.dt = 1.0 / sampleRate;
+        voice.phaseInc = pitchToFreq(voice.pitch) * voice.dt;
+        // Exponential velocity curve
+        voice.gain = static_cast<float>(std::pow(voice.velocity / 127.0, 2.0) * 0.5);
+    }
 
-        double freq = pitchToFreq(voice.pitch);
-        int ch = voice.channel;
-        int program = (ch >= 0 && ch < 16) ? channelPrograms[ch] : 0;
+    void releaseVoice(int channel, int pitch) {
+        for (auto& voice : voices) {
+            if (voice.active && voice.channel == channel && voice.pitch == pitch && !voice.releasing) {
+                voice.release();
+            }
+        }
+    }
 
-        voice.time += dt;
+    static double pitchToFreq(int pitch) {
+        return 440.0 * std::pow(2.0, (pitch - 69) / 12.0);
+    }
 
-        if (!voice.releasing) {
-            if (voice.time < voice.attackTime) {
-                voice.envelope = voice.time / voice.attackTime;
-            } else if (voice.time < voice.attackTime + voice.decayTime) {
-                double decayProgress = (voice.time - voice.attackTime) / voice.decayTime;
-                voice.envelope = 1.0 - (1.0 - voice.sustainLevel) * decayProgress;
-            } else {
-                voice.envelope = voice.sustainLevel;
+    // Create and start the device for `config`; false leaves nothing open
+    bool openDevice(const AudioConfig& config) {
+        ma_backend backend = ma_backend_null;
+        bool pickBackend = false;
+        if (!config.backend.empty()) {
+            ma_backend backends[MA_BACKEND_COUNT];
+            size_t count = 0;
+            ma_get_enabled_backends(backends, MA_BACKEND_COUNT, &count);
+            for (size_t i = 0; i < count; ++i) {
+                if (config.backend == ma_get_backend_name(backends[i])) {
+                    backend = backends[i];
+                    pickBackend = true;
+                }
             }
-        } else {
-            voice.releasePhase += dt;
-            double releaseProgress = voice.releasePhase / voice.releaseTime;
-            if (releaseProgress >= 1.0) {
-                voice.active = false;
-                return 0.0f;
+            if (!pickBackend) {
+                fprintf(stderr, "Audio error: Backend not available: %s\n", config.backend.c_str());
+                return false;
             }
-            voice.envelope = voice.sustainLevel * (1.0 - releaseProgress);
+        }
+        if (ma_context_init(pickBackend ? &backend : nullptr, pickBackend ? 1 : 0, nullptr, &context) != MA_SUCCESS) {
+            fprintf(stderr, "Audio error: Failed to initialize audio backend\n");
+            return false;
         }
 
-        // Generate waveform based on program category
-        double sample = 0.0;
-        int category = program / 8;
+        deviceConfig = ma_device_config_init(ma_device_type_playback);
+        deviceConfig.playback.format = ma_format_f32;
+        deviceConfig.playback.channels = 2;
+        deviceConfig.sampleRate = static_cast<ma_uint32>(std::max(0, config.sampleRate));
+        deviceConfig.periodSizeInFrames = config.periodFrames;
+        deviceConfig.periods = config.periods;
+        if (config.periodFrames > 0 && config.periodFrames <= 256) {
+            deviceConfig.performanceProfile = ma_performance_profile_low_latency;
+        }
+        deviceConfig.dataCallback = audioCallback;
+        deviceConfig.pUserData = this;
+        lastCallbackEnd = {};  // Underrun estimate starts over
+
+        if (ma_device_init(&context, &deviceConfig, &device) != MA_SUCCESS) {
+            fprintf(stderr, "Audio error: Failed to initialize audio device\n");
+            ma_context_uninit(&context);
+            return false;
+        }
 
-        // Phase increment for PolyBLEP
-        double phaseInc = freq * dt;
+        // Everything the callback reads is set before it starts. A rate
+        // of 0 asked for the device's own.
+        sampleRate.store(static_cast<int>(device.sampleRate));
+        const auto& playback = device.playback;
+        latencyFrames = static_cast<uint32_t>(static_cast<uint64_t>(playback.internalPeriodSizeInFrames) *
+                                              playback.internalPeriods * device.sampleRate /
+                                              std::max<ma_uint32>(1, playback.internalSampleRate));
+        lastFont = nullptr;  // The first callback sets the SoundFont up for this rate
+
+        renderThreads = config.renderThreads > 0
+                            ? std::min(config.renderThreads, MAX_RENDER_THREADS)
+                            : static_cast<int>(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+        renderWorkers.start(renderThreads - 1);
+
+        deviceRunning.store(true);
+        if (ma_device_start(&device) != MA_SUCCESS) {
+            fprintf(stderr, "Audio error: Failed to start audio device\n");
+            closeDevice();
+            return false;
+        }
+        return true;
+    }
 
-        voice.phase += phaseInc;
-        voice.phase -= std::floor(voice.phase);  // Modulo 1.0 without drift
+    void closeDevice() {
+        ma_device_uninit(&device);
+        deviceRunning.store(false);
+        ma_context_uninit(&context);
+        renderWorkers.stop();
+    }
 
-        double phase = voice.phase;
+    // Hand a swapped out SoundFont (with its base and samples) over to
+    // reclaimFonts. Caller holds pagerMutex.
+    void retireSoundFont(tsf* font, tsf* base, std::unique_ptr<SamplePager> samplePager) {
+        if (!font) return;
+        // Sequentially consistent, with the callback's load and
+        // framesRendered store
+        retiredFonts.push_back({font, base, std::move(samplePager), framesRendered.load()});
+        reclaimFonts();
+    }
+
+    // Free retired SoundFonts no callback can still be playing, the same
+    // way as reclaimFrozen. Caller holds pagerMutex: closing a copy drops
+    // the count the presets are shared by, as renderOffline's copies do.
+    void reclaimFonts() {
+        bool running = deviceRunning.load();
+        uint64_t now = framesRendered.load();
+        for (size_t i = 0; i < retiredFonts.size();) {
+            RetiredFont& retired = retiredFonts[i];
+            if (running && retired.frame >= now) {
+                ++i;
+                continue;
+            }
+            tsf_close(retired.font);
+            tsf_close(retired.base);
+            retiredFonts.erase(retiredFonts.begin() + i);
+        }
+    }
 
-        //see https://en.wikipedia.org/wiki/Additive_synthesis for a detailed explanation.
-        //  We mix sine waves to create the "timbre" or "color" of the sound.
-        switch (category)
+    // Swap out the SoundFont and its pager, and free them
+    void dropSoundFont() {
         {
-        case 0: // Piano - combination of harmonics
-        case 1: // Chromatic Percussion
-            sample = 0.5 * std::sin(2.0 * M_PI * phase) +
-                     0.25 * std::sin(4.0 * M_PI * phase) +
-                     0.125 * std::sin(6.0 * M_PI * phase);
-            // Quick decay for piano-like sounds
-            if (!voice.releasing && voice.time > 0.5)
+            std::lock_guard<std::mutex> lock(pagerMutex);
+            tsf* old = soundFont.exchange(nullptr);
+            if (old) ++parent->soundFontSerial_;
+            retireSoundFont(old, baseFont, std::move(pager));
+            baseFont = nullptr;
+        }
+        sampleBytesResident = 0;
+        sampleBytesTotal = 0;
+    }
+
+    // Page in the presets of the channels' programs, `programs` and the
+    // voices still sounding, then trim the rest to the cache budget.
+    // Caller holds pagerMutex, or owns a SoundFont nobody else sees yet;
+    // `sf` is never one being played.
+    void pageSamples(tsf* sf, SamplePager& samplePager, const std::vector<std::pair<int, int>>& programs) {
+        samplePager.beginPass();
+        auto pagePreset = [&](int index) {
+            if (index < 0 || index >= sf->presetNum) return;
+            const tsf_preset& preset = sf->presets[index];
+            for (int i = 0; i < preset.regionNum; ++i) pageRegion(samplePager, preset.regions[i]);
+        };
+        for (const auto& program : programs) pagePreset(presetIndex(sf, program.first, program.second));
+        for (int ch = 0; ch < 16; ++ch) pagePreset(presetIndex(sf, ch, channelPrograms[ch]));
+        for (const auto& preset : soundingPresets) {
+            int index = preset.load(std::memory_order_relaxed);
+            if (index < 0) break;
+            pagePreset(index);
+        }
+
+        samplePager.evictTo(sampleCacheBytes);
+        sampleBytesResident = samplePager.residentBytes();
+    }
+
+    void requestPaging() {
+        {
+            std::lock_guard<std::mutex> lock(pagingMutex);
+            pagingPending = true;
+        }
+        pagingWake.notify_one();
+    }
+
+    // Also frees retired SoundFonts, checking back every RECLAIM_WAIT
+    // while any are left
+    void pagingLoop() {
+        std::unique_lock<std::mutex> lock(pagingMutex);
+        bool retired = false;
+        while (pagingRunning) {
+            auto woken = [this] { return !pagingRunning || pagingPending; };
+            if (retired) {
+                pagingWake.wait_for(lock, RECLAIM_WAIT, woken);
+            } else {
+                pagingWake.wait(lock, woken);
+            }
+            if (!pagingRunning) break;
+            bool page = pagingPending;
+            pagingPending = false;
+            auto programs = projectPrograms;
+            lock.unlock();
             {
-                voice.envelope *= std::exp(-2.0 * (voice.time - 0.5));
+                std::lock_guard<std::mutex> pagerLock(pagerMutex);
+                reclaimFonts();
+                retired = !retiredFonts.empty();
+                if (page && baseFont && pager) pageSamples(baseFont, *pager, programs);
             }
-            break;
+            lock.lock();
+        }
+    }
 
-        case 2: // Organ - additive harmonics.
-            sample = 0.4 * std::sin(2.0 * M_PI * phase) +
-                     0.3 * std::sin(4.0 * M_PI * phase) +
-                     0.2 * std::sin(6.0 * M_PI * phase) +
-                     0.1 * std::sin(8.0 * M_PI * phase);
-            break;
+    // Page in `program`'s samples on `channel`; caller holds pagerMutex
+    void pageProgram(tsf* sf, int channel, int program) {
+        int index = presetIndex(sf, channel, program);
+        if (index < 0 || !pager) return;
+        const tsf_preset& preset = sf->presets[index];
+        for (int i = 0; i < preset.regionNum; ++i) pageRegion(*pager, preset.regions[i]);
+    }
 
-        case 3: // Guitar
-        case 4: // Bass
-            sample = std::sin(2.0 * M_PI * phase) *
-                     (1.0 + 0.3 * std::sin(4.0 * M_PI * phase));
-            if (!voice.releasing && voice.time > 0.1)
-            {
-                voice.envelope *= std::exp(-3.0 * (voice.time - 0.1));
+    // UI thread: free swapped out mixes no callback can still be reading.
+    // The callback loads the mix before it bumps framesRendered at its end,
+    // so once framesRendered has moved past its value at the swap, the
+    // callback running then (if any) is done and later ones see the new mix.
+    void reclaimFrozen() {
+        uint64_t now = framesRendered.load();
+        retiredMixes.erase(std::remove_if(retiredMixes.begin(), retiredMixes.end(),
+                                          [now](const std::pair<FrozenMix*, uint64_t>& retired) {
+                                              if (retired.second >= now) return false;
+                                              delete retired.first;
+                                              return true;
+                                          }),
+                           retiredMixes.end());
+    }
+
+    // Audio thread: add the frozen tracks from `songFrame` on, with their
+    // channels' volume/pan
+    void addFrozen(const FrozenMix& mix, float* out, uint64_t songFrame, ma_uint32 frames, float volume) {
+        for (const auto& track : mix.tracks) {
+            float gain = mixVolume[track.channel] * volume;
+            // Constant power around centre, like tsf's pan on a centred region
+            float left = gain * std::sqrt(2.0f * (1.0f - mixPan[track.channel]));
+            float right = gain * std::sqrt(2.0f * mixPan[track.channel]);
+            uint64_t song = songFrame;
+            for (ma_uint32 done = 0; done < frames;) {
+                uint64_t chunk = song / FREEZE_CHUNK_FRAMES;
+                uint32_t offset = static_cast<uint32_t>(song % FREEZE_CHUNK_FRAMES);
+                ma_uint32 n = std::min<ma_uint32>(frames - done, FREEZE_CHUNK_FRAMES - offset);
+                if (chunk < track.chunks.size() && track.chunks[chunk]) {
+                    const float* in = track.chunks[chunk] + static_cast<size_t>(offset) * 2;
+                    float* dst = out + static_cast<size_t>(done) * 2;
+                    for (ma_uint32 i = 0; i < n; ++i) {
+                        dst[i * 2] += in[i * 2] * left;
+                        dst[i * 2 + 1] += in[i * 2 + 1] * right;
+                    }
+                }
+                done += n;
+                song += n;
             }
-            break;
+        }
+    }
 
-        case 5: // Strings
-        case 6: // Ensemble
-            // Slight detuning for string ensemble effect
-            sample = 0.5 * std::sin(2.0 * M_PI * phase) +
-                     0.3 * std::sin(2.0 * M_PI * phase * 1.002) +
-                     0.2 * std::sin(2.0 * M_PI * phase * 0.998);
-            break;
+    // Audio thread: play the scheduled segments of frozen audio that fall
+    // in this buffer
+    void mixFrozen(float* out, uint64_t firstFrame, ma_uint32 frameCount, float volume) {
+        uint32_t gen = generation.load(std::memory_order_acquire);
+        if (gen != segmentGeneration) {
+            streaming = false;
+            streamLeft = 0;
+            segmentGeneration = gen;
+        }
+        const FrozenMix* mix = frozenMix.load();
+
+        size_t head = segmentHead.load(std::memory_order_relaxed);
+        size_t tail = segmentTail.load(std::memory_order_acquire);
+        uint64_t frame = firstFrame;
+        const uint64_t end = firstFrame + frameCount;
+        while (frame < end) {
+            if (streamLeft == 0) {
+                if (head == tail) break;
+                const auto& seg = segmentQueue[head & (SEGMENT_QUEUE_SIZE - 1)];
+                if (seg.generation != gen) {
+                    ++head;
+                    continue;
+                }
+                // One picking up where the last left off plays right on, so
+                // rounding in its frame can't click
+                bool joins = streaming && seg.songFrame == streamSong && seg.frame <= frame + SEGMENT_JOIN_FRAMES;
+                if (!joins && seg.frame > frame) {
+                    streaming = false;
+                    frame = std::min(end, seg.frame);
+                    continue;
+                }
+                streamSong = seg.songFrame;
+                streamLeft = seg.frames;
+                if (!joins) {
+                    // Late: skip what should already have played
+                    uint64_t late = std::min<uint64_t>(frame - seg.frame, streamLeft);
+                    streamSong += late;
+                    streamLeft -= late;
+                }
+                streaming = true;
+                ++head;
+                continue;
+            }
 
-        case 7: // Brass
-        case 8:
-        { // Reed -- PolyBLEP sawtooth
-            sample = 2.0 * phase - 1.0;
-            sample -= polyBlep(phase, phaseInc);
-            sample = sample * 0.7 + 0.3 * std::sin(2.0 * M_PI * phase);
-            break;
+            ma_uint32 n = static_cast<ma_uint32>(std::min<uint64_t>(streamLeft, end - frame));
+            if (mix) addFrozen(*mix, out + (frame - firstFrame) * 2, streamSong, n, volume);
+            frame += n;
+            streamSong += n;
+            streamLeft -= n;
+        }
+        segmentHead.store(head, std::memory_order_release);
+    }
+
+    // Audio thread: credit `frames` to the channel of every sounding voice
+    void countVoiceFrames(bool useSoundFont, ma_uint32 frames) {
+        if (useSoundFont) {
+            for (int i = 0; i < activeFont->voiceNum; ++i) {
+                const tsf_voice& voice = activeFont->voices[i];
+                if (voice.playingPreset != -1) voiceFrames[voice.playingChannel & 0x0F] += frames;
+            }
+        } else {
+            for (const auto& voice : voices) {
+                if (voice.active) voiceFrames[voice.channel & 0x0F] += frames;
             }
+        }
+    }
 
-            case 9: // Pipe
-                // Pure sine with slight vibrato
-                sample = std::sin(2.0 * M_PI * phase + 0.02 * std::sin(5.0 * voice.time));
-                break;
+    // Audio thread, at the end of each callback
+    void accountLoad(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+                     ma_uint32 frameCount) {
+        double bufferSeconds = static_cast<double>(frameCount) / sampleRate;
+        float load = static_cast<float>(std::chrono::duration<double>(end - start).count() / bufferSeconds);
+        if (load > 1.0f) lateCallbacks.fetch_add(1, std::memory_order_relaxed);
+
+        // The device drains what it holds between callbacks and gets this
+        // buffer at the end of one. No callback for longer than it held
+        // means it played silence.
+        if (lastCallbackEnd.time_since_epoch().count() == 0) {
+            bufferedSeconds = static_cast<double>(latencyFrames) / sampleRate;
+        } else {
+            bufferedSeconds -= std::chrono::duration<double>(end - lastCallbackEnd).count();
+            if (bufferedSeconds < 0.0) {
+                underruns.fetch_add(1, std::memory_order_relaxed);
+                bufferedSeconds = 0.0;
+            }
+        }
+        bufferedSeconds = std::min(bufferedSeconds + bufferSeconds,
+                                   std::max(static_cast<double>(latencyFrames) / sampleRate, bufferSeconds));
+        lastCallbackEnd = end;
+
+        float alpha = static_cast<float>(1.0 - std::exp(-bufferSeconds / LOAD_SMOOTHING));
+        float smoothed = dspLoad.load(std::memory_order_relaxed);
+        dspLoad.store(smoothed + alpha * (load - smoothed), std::memory_order_relaxed);
+
+        windowPeak = std::max(windowPeak, load);
+        peakWindow += bufferSeconds;
+        if (peakWindow >= 1.0) {
+            dspPeak.store(windowPeak, std::memory_order_relaxed);
+            windowPeak = 0.0f;
+            peakWindow = 0.0;
+        }
 
-            case 10: // Synth Lead
-            case 11: { // Synth Pad -- PolyBLEP square
-                // Band-limited square: sawtooth - phase-shifted sawtooth
-                double saw1 = 2.0 * phase - 1.0;
-                saw1 -= polyBlep(phase, phaseInc);
-                double phase2 = phase + 0.5;
-                phase2 -= std::floor(phase2);
-                double saw2 = 2.0 * phase2 - 1.0;
-                saw2 -= polyBlep(phase2, phaseInc);
-                sample = 0.8 * (saw1 - saw2);
-                break;
+        uint32_t totalFrames = 0;
+        for (uint32_t frames : voiceFrames) totalFrames += frames;
+        for (int ch = 0; ch < 16; ++ch) {
+            float share = totalFrames > 0 ? load * voiceFrames[ch] / totalFrames : 0.0f;
+            float current = channelLoad[ch].load(std::memory_order_relaxed);
+            channelLoad[ch].store(current + alpha * (share - current), std::memory_order_relaxed);
+        }
+        voiceFrames.fill(0);
+    }
+
+    // Audio thread
+    void applyEvent(const ScheduledEvent& ev, bool useSoundFont) {
+        if (useSoundFont) {
+            if (ev.on) tsf_channel_note_on(activeFont, ev.channel, ev.pitch, ev.velocity / 127.0f);
+            else tsf_channel_note_off(activeFont, ev.channel, ev.pitch);
+        } else {
+            if (ev.on) startVoice(ev.channel, ev.pitch, ev.velocity);
+            else releaseVoice(ev.channel, ev.pitch);
+        }
+    }
+
+    // UI thread
+    void schedule(bool on, int channel, int pitch, int velocity, uint64_t frame) {
+        size_t tail = eventTail.load(std::memory_order_relaxed);
+        if (tail - eventHead.load(std::memory_order_acquire) >= EVENT_QUEUE_SIZE) {
+            fprintf(stderr, "Audio error: Event queue full, dropping scheduled event\n");
+            return;
+        }
+        auto& ev = eventQueue[tail & (EVENT_QUEUE_SIZE - 1)];
+        ev.frame = frame;
+        ev.seq = nextSeq++;
+        ev.generation = generation.load(std::memory_order_relaxed);
+        ev.on = on;
+        ev.channel = static_cast<uint8_t>(channel & 0x0F);
+        ev.pitch = static_cast<uint8_t>(pitch & 0x7F);
+        ev.velocity = static_cast<uint8_t>(velocity & 0x7F);
+        eventTail.store(tail + 1, std::memory_order_release);
+    }
+
+    // Move newly scheduled events into the heap. Events from before the
+    // last cancel are dropped, except note-offs, which apply immediately so
+    // nothing is left hanging.
+    void takeScheduled(bool useSoundFont) {
+        uint32_t gen = generation.load(std::memory_order_acquire);
+        if (gen != pendingGeneration) {
+            for (const auto& ev : pending) {
+                if (!ev.on) applyEvent(ev, useSoundFont);
+            }
+            pending.clear();
+            pendingGeneration = gen;
+        }
+
+        size_t head = eventHead.load(std::memory_order_relaxed);
+        size_t tail = eventTail.load(std::memory_order_acquire);
+        while (head != tail && pending.size() < pending.capacity()) {
+            const auto& ev = eventQueue[head & (EVENT_QUEUE_SIZE - 1)];
+            if (ev.generation == gen) {
+                pending.push_back(ev);
+                std::push_heap(pending.begin(), pending.end(), laterEvent);
+            } else if (!ev.on) {
+                applyEvent(ev, useSoundFont);
             }
+            ++head;
+        }
+        eventHead.store(head, std::memory_order_release);
+    }
+
+    // Any thread
+    void sendLive(LiveType type, int channel, int pitch, int velocity) {
+        std::lock_guard<std::mutex> lock(liveMutex);
+        size_t tail = liveTail.load(std::memory_order_relaxed);
+        if (tail - liveHead.load(std::memory_order_acquire) >= LIVE_QUEUE_SIZE) {
+            fprintf(stderr, "Audio error: Live event queue full, dropping event\n");
+            return;
+        }
+        auto& ev = liveQueue[tail & (LIVE_QUEUE_SIZE - 1)];
+        ev.type = type;
+        ev.channel = static_cast<uint8_t>(channel & 0x0F);
+        ev.pitch = static_cast<uint8_t>(pitch & 0x7F);
+        ev.velocity = static_cast<uint8_t>(velocity & 0x7F);
+        liveTail.store(tail + 1, std::memory_order_release);
+    }
 
-            case 12: // Synth Effects
-            case 13: // Ethnic
-            case 14: // Percussive
-            case 15: // Sound Effects
-            default: {
-                // PolyBLEP triangle (integrated square)
-                double saw1 = 2.0 * phase - 1.0;
-                saw1 -= polyBlep(phase, phaseInc);
-                double phase2 = phase + 0.5;
-                phase2 -= std::floor(phase2);
-                double saw2 = 2.0 * phase2 - 1.0;
-                saw2 -= polyBlep(phase2, phaseInc);
-                double sq = saw1 - saw2;
-                // Integrate square to get triangle (approximation)
-                sample = 4.0 * std::abs(phase - 0.5) - 1.0;
-                // Blend with integrated PolyBLEP square for better quality
-                sample = 0.5 * sample + 0.5 * sq;
+    // Audio thread: play what came in since the last callback
+    void takeLive(bool useSoundFont) {
+        size_t head = liveHead.load(std::memory_order_relaxed);
+        size_t tail = liveTail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const auto& ev = liveQueue[head & (LIVE_QUEUE_SIZE - 1)];
+            switch (ev.type) {
+            case LIVE_NOTE_ON:
+                if (useSoundFont) tsf_channel_note_on(activeFont, ev.channel, ev.pitch, ev.velocity / 127.0f);
+                else startVoice(ev.channel, ev.pitch, ev.velocity);
+                break;
+            case LIVE_NOTE_OFF:
+                if (useSoundFont) tsf_channel_note_off(activeFont, ev.channel, ev.pitch);
+                else releaseVoice(ev.channel, ev.pitch);
+                break;
+            case LIVE_ALL_OFF:
+                if (useSoundFont) tsf_note_off_all(activeFont);
+                for (auto& voice : voices) {
+                    if (voice.active) voice.release();
+                }
+                break;
+            case LIVE_PROGRAM:
+                // The simple synth reads channelPrograms at each note
+                if (useSoundFont) {
+                    tsf_channel_set_presetnumber(activeFont, ev.channel, channelPrograms[ev.channel], ev.channel == 9);
+                }
                 break;
             }
+        }
+        liveHead.store(head, std::memory_order_release);
+    }
+
+    // Audio thread: bring a SoundFont that's new to this callback up to
+    // date. It was set up by the loader, but the device may have restarted
+    // at another rate, or a program changed, in between.
+    void adoptFont() {
+        lastFont = activeFont;
+        if (!activeFont) return;
+        if (activeFont->outSampleRate != static_cast<float>(sampleRate)) {
+            tsf_set_output(activeFont, TSF_STEREO_INTERLEAVED, sampleRate, 0);
+        }
+        for (int ch = 0; ch < 16; ++ch) {
+            tsf_channel_set_presetnumber(activeFont, ch, channelPrograms[ch], ch == 9);
+        }
+        // Its channels start at full volume, centred
+        fontVolume.fill(-1.0f);
+        fontPan.fill(-1.0f);
+    }
+
+    // Audio thread: list the presets with voices sounding
+    void publishSounding() {
+        int count = 0;
+        for (int i = 0; activeFont && i < activeFont->voiceNum && count < MAX_SOUNDING_PRESETS; ++i) {
+            int index = activeFont->voices[i].playingPreset;
+            if (index == -1) continue;
+            bool listed = false;
+            for (int j = 0; j < count && !listed; ++j) {
+                listed = soundingPresets[j].load(std::memory_order_relaxed) == index;
             }
+            if (!listed) soundingPresets[count++].store(index, std::memory_order_relaxed);
+        }
+        if (count < MAX_SOUNDING_PRESETS) soundingPresets[count].store(-1, std::memory_order_relaxed);
+    }
 
-        // Apply envelope and exponential velocity curve
-        float velocityScale = static_cast<float>(std::pow(voice.velocity / 127.0, 2.0));
-        return static_cast<float>(sample * voice.envelope * velocityScale * 0.5);
+    // Audio thread: pick up the volume/pan targets for this callback
+    void loadMixTargets() {
+        for (int ch = 0; ch < 16; ++ch) {
+            volumeTarget[ch] = channelVolume[ch].load(std::memory_order_relaxed);
+            panTarget[ch] = channelPan[ch].load(std::memory_order_relaxed);
+        }
     }
 
-    // Audio callback - static method to be passed to miniaudio
-    static void audioCallback(ma_device* device, void* output, const void* input, ma_uint32 frameCount) {
-        Impl* impl = static_cast<Impl*>(device->pUserData);
-        float* out = static_cast<float*>(output);
-        float volume = impl->parent->getMasterVolume();
+    // Move the smoothed volume/pan `frames` worth towards the targets
+    float mixStep(ma_uint32 frames) const {
+        return static_cast<float>(1.0 - std::exp(-static_cast<double>(frames) / (MIX_SMOOTHING * sampleRate)));
+    }
 
-        // Try to lock soundFont, if we can't use simple synth.
-        {
-            std::unique_lock<std::mutex> sfLock(impl->sfMutex, std::try_to_lock);
-            if (sfLock.owns_lock() && impl->soundFont) {
-                // Use TinySoundFont
-                tsf_render_float(impl->soundFont, out, static_cast<int>(frameCount), 0);
-
-                // Apply master volume.
-                // There is still a wee thing not quite right here.
-                for (ma_uint32 i = 0; i < frameCount * 2; ++i) {
-                    out[i] *= volume;
+    void glideMix(float step) {
+        for (int ch = 0; ch < 16; ++ch) {
+            mixVolume[ch] += (volumeTarget[ch] - mixVolume[ch]) * step;
+            mixPan[ch] += (panTarget[ch] - mixPan[ch]) * step;
+        }
+    }
+
+    void renderSoundFont(float* out, ma_uint32 frameCount, float volume) {
+        // In short blocks so the channel volume/pan can follow the glide
+        float step = mixStep(MIX_BLOCK);
+        for (ma_uint32 done = 0; done < frameCount; done += MIX_BLOCK) {
+            glideMix(step);
+            for (int ch = 0; ch < 16; ++ch) {
+                if (std::abs(mixVolume[ch] - fontVolume[ch]) > 1e-4f) {
+                    tsf_channel_set_volume(activeFont, ch, mixVolume[ch]);
+                    fontVolume[ch] = mixVolume[ch];
+                }
+                if (std::abs(mixPan[ch] - fontPan[ch]) > 1e-4f) {
+                    tsf_channel_set_pan(activeFont, ch, mixPan[ch]);
+                    fontPan[ch] = mixPan[ch];
                 }
-                return;
             }
+            ma_uint32 frames = std::min(MIX_BLOCK, frameCount - done);
+            renderFontBlock(out + done * 2, frames);
+        }
+
+        // Apply master volume.
+        // There is still a wee thing not quite right here.
+        for (ma_uint32 i = 0; i < frameCount * 2; ++i) {
+            out[i] *= volume;
+        }
+    }
+
+    // Audio thread: up to MIX_BLOCK frames of the SoundFont's voices
+    void renderFontBlock(float* out, ma_uint32 frames) {
+        int sounding = 0;
+        for (int i = 0; i < activeFont->voiceNum; ++i) {
+            if (activeFont->voices[i].playingPreset != -1) ++sounding;
+        }
+        int parts = std::min(renderThreads, sounding / VOICES_PER_PART);
+        if (parts <= 1) {
+            tsf_render_float(activeFont, out, static_cast<int>(frames), 0);
+            return;
         }
 
-        // Use simple synth
-        double dt = 1.0 / impl->sampleRate;
+        // An even share of the sounding voices per part, as voice index
+        // ranges worked out up front: a voice ending mid-block changes
+        // nothing another thread looks at
+        int rank = 0, part = 0;
+        for (int i = 0; i < activeFont->voiceNum && part < parts; ++i) {
+            if (activeFont->voices[i].playingPreset == -1) continue;
+            if (rank++ == sounding * part / parts) partVoices[part++] = i;
+        }
+        partVoices[parts] = activeFont->voiceNum;
+        partOut = out;
+        partFrames = static_cast<int>(frames);
+        renderWorkers.run(&Impl::renderFontPart, this, parts);
+
+        for (int p = 1; p < parts; ++p) {
+            const float* buffer = partBuffers[p].data();
+            for (int i = 0; i < partFrames * 2; ++i) out[i] += buffer[i];
+        }
+    }
+
+    // Any render thread: part `part` of renderFontBlock
+    static void renderFontPart(void* context, int part) {
+        Impl* impl = static_cast<Impl*>(context);
+        float* out = part == 0 ? impl->partOut : impl->partBuffers[part].data();
+        std::fill(out, out + impl->partFrames * 2, 0.0f);
+        tsf* sf = impl->activeFont;
+        for (int i = impl->partVoices[part]; i < impl->partVoices[part + 1]; ++i) {
+            if (sf->voices[i].playingPreset != -1) tsf_voice_render(sf, &sf->voices[i], out, impl->partFrames);
+        }
+    }
 
-        std::lock_guard<std::mutex> lock(impl->voicesMutex);
+    void renderSimple(float* out, ma_uint32 frameCount, float volume) {
+        float step = mixStep(1);
 
         for (ma_uint32 i = 0; i < frameCount; ++i) {
             float sampleL = 0.0f;
             float sampleR = 0.0f;
+            glideMix(step);
 
-            for (auto& voice : impl->voices) {
+            for (auto& voice : voices) {
                 if (voice.active) {
-                    float s = impl->generateSample(voice, dt);
+                    float s = voice.kernel(voice);
 
                     // Apply per-channel volume and pan
                     int ch = voice.channel;
                     if (ch >= 0 && ch < 16) {
-                        s *= impl->channelVolume[ch];
-                        float pan = impl->channelPan[ch];
+                        s *= mixVolume[ch];
+                        float pan = mixPan[ch];
                         sampleL += s * (1.0f - pan);
                         sampleR += s * pan;
                     } else {
@@ -307,6 +1227,73 @@ struct AudioSynth::Impl {
             out[i * 2 + 1] = softClip(sampleR * volume);
         }
     }
+
+    // Audio callback - static method to be passed to miniaudio
+    static void audioCallback(ma_device* device, void* output, const void* input, ma_uint32 frameCount) {
+        AUDIO_NO_ALLOC_SCOPE();
+        auto callbackStart = std::chrono::steady_clock::now();
+        Impl* impl = static_cast<Impl*>(device->pUserData);
+        float* out = static_cast<float*>(output);
+        float volume = impl->parent->getMasterVolume();
+        uint64_t firstFrame = impl->framesRendered.load(std::memory_order_relaxed);
+        impl->loadMixTargets();
+
+        uint32_t seq = impl->clockSeq.load(std::memory_order_relaxed);
+        impl->clockSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto heardAt = callbackStart +
+                       std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(static_cast<double>(impl->latencyFrames) / impl->sampleRate));
+        impl->clockFrame.store(firstFrame, std::memory_order_relaxed);
+        impl->clockTime.store(heardAt.time_since_epoch().count(), std::memory_order_relaxed);
+        impl->clockSeq.store(seq + 2, std::memory_order_release);
+
+        // The SoundFont if there is one, else the simple synth. Sequentially
+        // consistent, with the framesRendered store, for reclaimFonts().
+        impl->activeFont = impl->soundFont.load();
+        bool useSoundFont = impl->activeFont != nullptr;
+        if (impl->activeFont != impl->lastFont) impl->adoptFont();
+        impl->takeLive(useSoundFont);
+        impl->takeScheduled(useSoundFont);
+
+        // Timing samples are stamped on the output timeline
+        const int64_t heardAtNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            heardAt.time_since_epoch()).count();
+        const double nsPerFrame = 1e9 / impl->sampleRate;
+        auto frameNs = [&](uint64_t frame) {
+            return heardAtNs + static_cast<int64_t>((static_cast<double>(frame) - static_cast<double>(firstFrame)) * nsPerFrame);
+        };
+
+        // Render up to each event's frame, apply it, carry on
+        ma_uint32 done = 0;
+        while (done < frameCount) {
+            ma_uint32 end = frameCount;
+            while (!impl->pending.empty()) {
+                const auto& ev = impl->pending.front();
+                if (ev.frame > firstFrame + done) {
+                    end = static_cast<ma_uint32>(std::min<uint64_t>(end, ev.frame - firstFrame));
+                    break;
+                }
+                impl->applyEvent(ev, useSoundFont);
+                impl->parent->timing_.record(frameNs(ev.frame), frameNs(firstFrame + done));
+                std::pop_heap(impl->pending.begin(), impl->pending.end(), laterEvent);
+                impl->pending.pop_back();
+            }
+
+            impl->countVoiceFrames(useSoundFont, end - done);
+            if (useSoundFont) {
+                impl->renderSoundFont(out + done * 2, end - done, volume);
+            } else {
+                impl->renderSimple(out + done * 2, end - done, volume);
+            }
+            done = end;
+        }
+        impl->mixFrozen(out, firstFrame, frameCount, volume);
+        impl->publishSounding();
+
+        impl->framesRendered.store(firstFrame + frameCount);
+        impl->accountLoad(callbackStart, std::chrono::steady_clock::now(), frameCount);
+    }
 };
 
 AudioSynth::AudioSynth() : impl_(std::make_unique<Impl>()) {
@@ -315,181 +1302,301 @@ AudioSynth::AudioSynth() : impl_(std::make_unique<Impl>()) {
 
 AudioSynth::~AudioSynth() {
     shutdown();
+    stopLoader();
+    impl_->dropSoundFont();
 }
 
 bool AudioSynth::init() {
     if (initialized_) return true;
 
-    impl_->deviceConfig = ma_device_config_init(ma_device_type_playback);
-    impl_->deviceConfig.playback.format = ma_format_f32;
-    impl_->deviceConfig.playback.channels = 2;
-    impl_->deviceConfig.sampleRate = impl_->sampleRate;
-    impl_->deviceConfig.dataCallback = Impl::audioCallback;
-    impl_->deviceConfig.pUserData = impl_.get();
-
-    if (ma_device_init(nullptr, &impl_->deviceConfig, &impl_->device) != MA_SUCCESS) {
-        fprintf(stderr, "Audio error: Failed to initialize audio device\n");
-        return false;
-    }
-
-    if (ma_device_start(&impl_->device) != MA_SUCCESS) {
-        fprintf(stderr, "Audio error: Failed to start audio device\n");
-        ma_device_uninit(&impl_->device);
-        return false;
+    if (!impl_->openDevice(config_)) {
+        AudioConfig defaults;
+        if (config_.sampleRate == defaults.sampleRate && config_.periodFrames == defaults.periodFrames &&
+            config_.periods == defaults.periods && config_.backend == defaults.backend) {
+            return false;
+        }
+        fprintf(stderr, "Audio error: Audio config refused, using the defaults\n");
+        if (!impl_->openDevice(defaults)) return false;
     }
 
-    fprintf(stderr, "Audio: Initialized at %d Hz\n", impl_->sampleRate);
+    auto info = getDeviceInfoUnchecked();
+    fprintf(stderr, "Audio: Initialized at %d Hz (%s, %u x %u frames, %.1f ms)\n", info.sampleRate,
+            info.backend.c_str(), info.periods, info.periodFrames, info.latencyMs);
     initialized_ = true;
     return true;
 }
 
+bool AudioSynth::reconfigure(const AudioConfig& config) {
+    config_ = config;
+    if (!initialized_) return true;  // init() picks it up
+
+    allNotesOff();
+    initialized_ = false;
+    impl_->closeDevice();
+    return init();
+}
+
 void AudioSynth::shutdown() {
     if (!initialized_) return;
 
     // Stop and uninit audio device first (ensures callback won't run after)
-    ma_device_uninit(&impl_->device);
+    impl_->closeDevice();
 
-    {
-        std::lock_guard<std::mutex> lock(impl_->sfMutex);
-        if (impl_->soundFont) {
-            tsf_close(impl_->soundFont);
-            impl_->soundFont = nullptr;
-        }
-    }
+    stopLoader();
+    impl_->dropSoundFont();
 
     initialized_ = false;
     soundFontLoaded_ = false;
 }
 
+AudioDeviceInfo AudioSynth::getDeviceInfo() const {
+    if (!initialized_) return AudioDeviceInfo();
+    return getDeviceInfoUnchecked();
+}
+
+AudioDeviceInfo AudioSynth::getDeviceInfoUnchecked() const {
+    const ma_device& device = impl_->device;
+    AudioDeviceInfo info;
+    info.backend = ma_get_backend_name(impl_->context.backend);
+    info.deviceName = device.playback.name;
+    info.sampleRate = impl_->sampleRate;
+    info.nativeSampleRate = static_cast<int>(device.playback.internalSampleRate);
+    info.periodFrames = device.playback.internalPeriodSizeInFrames;
+    info.periods = device.playback.internalPeriods;
+    info.latencyMs = 1000.0 * impl_->latencyFrames / impl_->sampleRate;
+    info.renderThreads = impl_->renderThreads;
+    return info;
+}
+
+std::vector<std::string> AudioSynth::availableBackends() {
+    std::vector<std::string> names;
+    ma_backend backends[MA_BACKEND_COUNT];
+    size_t count = 0;
+    if (ma_get_enabled_backends(backends, MA_BACKEND_COUNT, &count) != MA_SUCCESS) return names;
+    for (size_t i = 0; i < count; ++i) {
+        if (backends[i] == ma_backend_null || backends[i] == ma_backend_custom) continue;
+        names.push_back(ma_get_backend_name(backends[i]));
+    }
+    return names;
+}
+
 bool AudioSynth::loadSoundFont(const std::string& filepath) {
-    // Load the new soundfont first, then swap
-    tsf* newSf = tsf_load_filename(filepath.c_str());
-    if (!newSf) {
-        fprintf(stderr, "Audio error: Failed to load SoundFont: %s\n", filepath.c_str());
-        soundFontLoaded_ = false;
+    FILE* file = fopen(filepath.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "Audio error: Failed to open SoundFont: %s\n", filepath.c_str());
         return false;
     }
 
-    tsf_set_output(newSf, TSF_STEREO_INTERLEAVED, impl_->sampleRate, 0);
+    // A load still running is abandoned for this one
+    stopLoader();
+    soundFontProgress_ = 0.0f;
+    soundFontLoading_ = true;
+    loader_ = std::thread([this, file, filepath] {
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        auto newPager = std::make_unique<SamplePager>();
+        LoadStream stream{file, static_cast<size_t>(std::max(1L, size)), 0, &soundFontProgress_, &cancelLoad_,
+                          filepath, newPager.get()};
+        tsf_stream tsfStream = {&stream, &LoadStream::read, &LoadStream::skip};
+        tsf* newBase = tsf_load(&tsfStream);
+        fclose(file);
+
+        if (!newBase) {
+            if (!cancelLoad_) fprintf(stderr, "Audio error: Failed to load SoundFont: %s\n", filepath.c_str());
+            soundFontLoading_ = false;
+            return;
+        }
 
-    // Swap under lock
-    {
-        std::lock_guard<std::mutex> lock(impl_->sfMutex);
-        tsf* oldSf = impl_->soundFont;
-        impl_->soundFont = newSf;
-        if (oldSf) {
-            tsf_close(oldSf);
+        // Set up before anyone can see it: output rate and the programs
+        // the channels already have. What plays is a copy, with its own
+        // voices and channels; the audio thread catches up on anything
+        // that changed before the swap (see adoptFont).
+        tsf_set_output(newBase, TSF_STEREO_INTERLEAVED, impl_->sampleRate, 0);
+        tsf* newSf = tsf_copy(newBase);
+        // Every voice and channel is allocated here, so notes and rendering
+        // never touch the heap (all 16 channels get a preset below)
+        if (!newSf || !tsf_set_max_voices(newSf, maxVoices_)) {
+            fprintf(stderr, "Audio error: Failed to allocate SoundFont voices\n");
+            if (newSf) tsf_close(newSf);
+            tsf_close(newBase);
+            soundFontLoading_ = false;
+            return;
         }
-    }
+        for (int ch = 0; ch < 16; ++ch) {
+            tsf_channel_set_presetnumber(newSf, ch, impl_->channelPrograms[ch], ch == 9);
+        }
+        // Only the instruments in use are read from the file, before the
+        // swap so the first notes aren't silent
+        {
+            std::vector<std::pair<int, int>> projectPrograms;
+            {
+                std::lock_guard<std::mutex> lock(impl_->pagingMutex);
+                projectPrograms = impl_->projectPrograms;
+            }
+            impl_->pageSamples(newBase, *newPager, projectPrograms);
+        }
+        impl_->sampleBytesTotal = newPager->totalBytes();
 
-    fprintf(stderr, "Audio: Loaded SoundFont: %s\n", filepath.c_str());
-    soundFontLoaded_ = true;
+        {
+            std::lock_guard<std::mutex> lock(impl_->pagerMutex);
+            tsf* oldBase = impl_->baseFont;
+            std::unique_ptr<SamplePager> oldPager = std::move(impl_->pager);
+            impl_->baseFont = newBase;
+            impl_->pager = std::move(newPager);
+            // A program changed since the pass above was paged into the old
+            // pager (see programChange)
+            for (int ch = 0; ch < 16; ++ch) impl_->pageProgram(newBase, ch, impl_->channelPrograms[ch]);
+            tsf* oldSf = impl_->soundFont.exchange(newSf);
+            impl_->retireSoundFont(oldSf, oldBase, std::move(oldPager));
+            ++soundFontSerial_;
+        }
+        impl_->requestPaging();  // Trims the cache, and frees the old font
+
+        fprintf(stderr, "Audio: Loaded SoundFont: %s\n", filepath.c_str());
+        soundFontLoaded_ = true;
+        soundFontProgress_ = 1.0f;
+        soundFontLoading_ = false;
+    });
     return true;
 }
 
+void AudioSynth::stopLoader() {
+    if (!loader_.joinable()) return;
+    cancelLoad_ = true;
+    loader_.join();
+    cancelLoad_ = false;
+}
+
 void AudioSynth::noteOn(int channel, int pitch, int velocity) {
-    if (!initialized_) return;
+    if (!initialized_ || channel < 0 || channel >= 16) return;
+    impl_->sendLive(Impl::LIVE_NOTE_ON, channel, pitch, velocity);
+}
 
-    {
-        std::lock_guard<std::mutex> sfLock(impl_->sfMutex);
-        if (impl_->soundFont) {
-            tsf_channel_note_on(impl_->soundFont, channel, pitch, velocity / 127.0f);
-            return;
-        }
-    }
+void AudioSynth::noteOff(int channel, int pitch) {
+    if (!initialized_ || channel < 0 || channel >= 16) return;
+    impl_->sendLive(Impl::LIVE_NOTE_OFF, channel, pitch, 0);
+}
 
-    std::lock_guard<std::mutex> lock(impl_->voicesMutex);
+uint64_t AudioSynth::currentFrame() const {
+    if (initialized_) {
+        return impl_->framesRendered.load(std::memory_order_acquire);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - impl_->clockStart;
+    return static_cast<uint64_t>(std::chrono::duration<double>(elapsed).count() * impl_->sampleRate);
+}
 
-    // Check if note is already playing
-    auto* existing = impl_->findVoice(channel, pitch);
-    if (existing) {
-        existing->velocity = velocity;
-        existing->time = 0;
-        existing->releasing = false;
-        existing->releasePhase = 0;
+void AudioSynth::getClockReference(uint64_t& frame, std::chrono::steady_clock::time_point& time) const {
+    if (!initialized_) {
+        frame = 0;
+        time = impl_->clockStart;
         return;
     }
+    for (;;) {
+        uint32_t seq = impl_->clockSeq.load(std::memory_order_acquire);
+        frame = impl_->clockFrame.load(std::memory_order_relaxed);
+        int64_t ticks = impl_->clockTime.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((seq & 1) == 0 && impl_->clockSeq.load(std::memory_order_relaxed) == seq) {
+            time = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(ticks));
+            return;
+        }
+    }
+}
 
-    auto* voice = impl_->findFreeVoice();
-    if (voice) {
-        voice->active = true;
-        voice->pitch = pitch;
-        voice->velocity = velocity;
-        voice->channel = channel;
-        voice->phase = 0.0;
-        voice->envelope = 0.0;
-        voice->time = 0.0;
-        voice->releasing = false;
-        voice->releasePhase = 0.0;
+DspStats AudioSynth::getDspStats() const {
+    DspStats stats;
+    stats.load = impl_->dspLoad.load(std::memory_order_relaxed);
+    stats.peakLoad = impl_->dspPeak.load(std::memory_order_relaxed);
+    stats.lateCallbacks = impl_->lateCallbacks.load(std::memory_order_relaxed);
+    stats.underruns = impl_->underruns.load(std::memory_order_relaxed);
+    for (int ch = 0; ch < 16; ++ch) {
+        stats.channelLoad[ch] = impl_->channelLoad[ch].load(std::memory_order_relaxed);
     }
+    return stats;
 }
 
-void AudioSynth::noteOff(int channel, int pitch) {
-    if (!initialized_) return;
+void AudioSynth::resetDspCounters() {
+    impl_->lateCallbacks.store(0, std::memory_order_relaxed);
+    impl_->underruns.store(0, std::memory_order_relaxed);
+}
 
-    {
-        std::lock_guard<std::mutex> sfLock(impl_->sfMutex);
-        if (impl_->soundFont) {
-            tsf_channel_note_off(impl_->soundFont, channel, pitch);
-            return;
-        }
-    }
+int AudioSynth::getSampleRate() const {
+    return impl_->sampleRate;
+}
 
-    std::lock_guard<std::mutex> lock(impl_->voicesMutex);
+void AudioSynth::scheduleNoteOn(int channel, int pitch, int velocity, uint64_t frame) {
+    if (!initialized_ || channel < 0 || channel >= 16) return;
+    impl_->schedule(true, channel, pitch, velocity, frame);
+}
 
-    for (auto& voice : impl_->voices) {
-        if (voice.active && voice.channel == channel && voice.pitch == pitch && !voice.releasing) {
-            voice.releasing = true;
-            voice.releasePhase = 0.0;
-        }
-    }
+void AudioSynth::scheduleNoteOff(int channel, int pitch, uint64_t frame) {
+    if (!initialized_ || channel < 0 || channel >= 16) return;
+    impl_->schedule(false, channel, pitch, 0, frame);
+}
+
+void AudioSynth::cancelScheduled() {
+    impl_->generation.fetch_add(1, std::memory_order_release);
 }
 
 void AudioSynth::allNotesOff() {
     if (!initialized_) return;
 
-    {
-        std::lock_guard<std::mutex> sfLock(impl_->sfMutex);
-        if (impl_->soundFont) {
-            tsf_note_off_all(impl_->soundFont);
-        }
-    }
-
-    std::lock_guard<std::mutex> lock(impl_->voicesMutex);
-
-    for (auto& voice : impl_->voices) {
-        if (voice.active) {
-            voice.releasing = true;
-            voice.releasePhase = 0.0;
-        }
-    }
+    cancelScheduled();
+    impl_->sendLive(Impl::LIVE_ALL_OFF, 0, 0, 0);
 }
 
 void AudioSynth::programChange(int channel, int program) {
-    if (!initialized_) return;
+    if (!initialized_ || channel < 0 || channel >= 16) return;
 
+    // The audio thread sets the SoundFont's channel from here; also read
+    // by the simple synth, a SoundFont still loading and the paging thread
+    impl_->channelPrograms[channel] = program;
     {
-        std::lock_guard<std::mutex> sfLock(impl_->sfMutex);
-        if (impl_->soundFont) {
-            tsf_channel_set_presetnumber(impl_->soundFont, channel, program, channel == 9);
-        }
+        // Its samples go in before the switch, or the first notes on it
+        // would play blocks the paging thread hasn't got to yet
+        std::lock_guard<std::mutex> lock(impl_->pagerMutex);
+        if (impl_->baseFont) impl_->pageProgram(impl_->baseFont, channel, program);
     }
+    impl_->sendLive(Impl::LIVE_PROGRAM, channel, 0, 0);
+    impl_->requestPaging();
+}
 
-    // Also store for simple synth
-    if (channel >= 0 && channel < 16) {
-        impl_->channelPrograms[channel] = program;
+void AudioSynth::setProjectPrograms(const std::vector<std::pair<int, int>>& programs) {
+    {
+        std::lock_guard<std::mutex> lock(impl_->pagingMutex);
+        impl_->projectPrograms = programs;
     }
+    impl_->requestPaging();
+}
+
+void AudioSynth::setSampleCacheBudget(size_t bytes) {
+    impl_->sampleCacheBytes = bytes;
+    impl_->requestPaging();
+}
+
+size_t AudioSynth::getSampleBytesResident() const {
+    return impl_->sampleBytesResident;
+}
+
+size_t AudioSynth::getSampleBytesTotal() const {
+    return impl_->sampleBytesTotal;
 }
 
 void AudioSynth::setChannelVolume(int channel, float volume) {
-    if (channel >= 0 && channel < 16) {
-        impl_->channelVolume[channel] = std::max(0.0f, std::min(1.0f, volume));
+    if (channel < 0 || channel >= 16) return;
+    volume = std::max(0.0f, std::min(1.0f, volume));
+    if (impl_->channelVolume[channel].load(std::memory_order_relaxed) != volume) {
+        impl_->channelVolume[channel].store(volume, std::memory_order_relaxed);
     }
 }
 
 void AudioSynth::setChannelPan(int channel, float pan) {
-    if (channel >= 0 && channel < 16) {
-        impl_->channelPan[channel] = std::max(0.0f, std::min(1.0f, pan));
+    if (channel < 0 || channel >= 16) return;
+    pan = std::max(0.0f, std::min(1.0f, pan));
+    if (impl_->channelPan[channel].load(std::memory_order_relaxed) != pan) {
+        impl_->channelPan[channel].store(pan, std::memory_order_relaxed);
     }
 }
 
@@ -497,4 +1604,129 @@ void AudioSynth::setMasterVolume(float volume) {
     masterVolume_ = std::max(0.0f, std::min(1.0f, volume));
 }
 
+void AudioSynth::setFrozenTracks(const std::vector<FrozenTrack>& tracks) {
+    auto* mix = new Impl::FrozenMix();
+    for (const auto& track : tracks) {
+        Impl::FrozenMix::Track mixTrack;
+        mixTrack.channel = track.channel & 0x0F;
+        for (const auto& chunk : track.chunks) {
+            mixTrack.chunks.push_back(chunk ? chunk->data() : nullptr);
+            if (chunk) mix->owned.push_back(chunk);
+        }
+        mix->tracks.push_back(std::move(mixTrack));
+    }
+
+    // Sequentially consistent, with the callback's load and framesRendered
+    // store, for reclaimFrozen()
+    Impl::FrozenMix* old = impl_->frozenMix.exchange(mix);
+    if (old) impl_->retiredMixes.emplace_back(old, impl_->framesRendered.load());
+    impl_->reclaimFrozen();
+}
+
+void AudioSynth::scheduleFrozen(uint64_t songFrame, uint32_t frames, uint64_t frame) {
+    if (!initialized_) return;
+    impl_->reclaimFrozen();
+
+    size_t tail = impl_->segmentTail.load(std::memory_order_relaxed);
+    if (tail - impl_->segmentHead.load(std::memory_order_acquire) >= Impl::SEGMENT_QUEUE_SIZE) {
+        fprintf(stderr, "Audio error: Frozen segment queue full, dropping segment\n");
+        return;
+    }
+    auto& seg = impl_->segmentQueue[tail & (Impl::SEGMENT_QUEUE_SIZE - 1)];
+    seg.frame = frame;
+    seg.songFrame = songFrame;
+    seg.frames = frames;
+    seg.generation = impl_->generation.load(std::memory_order_relaxed);
+    impl_->segmentTail.store(tail + 1, std::memory_order_release);
+}
+
+bool AudioSynth::renderOffline(int channel, int program, int sampleRate, const std::vector<OfflineNote>& notes,
+                               uint64_t from, uint64_t to, float* out, const std::atomic<bool>* cancel) {
+    if (channel < 0 || channel >= 16 || to <= from || sampleRate <= 0) return false;
+
+    // A copy shares the presets and sample data but has its own voices.
+    // Made from the base, which nothing plays, so nothing else touches it.
+    // The SoundFont and its samples can't be swapped out while pagerMutex
+    // is held, and closing a copy drops the presets' shared count, so both
+    // happen under it.
+    tsf* sf;
+    tsf* copy;
+    uint32_t serial;
+    {
+        std::lock_guard<std::mutex> pagerLock(impl_->pagerMutex);
+        sf = impl_->baseFont;
+        if (!sf) return false;
+        copy = tsf_copy(sf);
+        serial = soundFontSerial_;
+    }
+    if (!copy) return false;
+    auto closeCopy = [&] {
+        std::lock_guard<std::mutex> pagerLock(impl_->pagerMutex);
+        tsf_close(copy);
+    };
+    if (!tsf_set_max_voices(copy, maxVoices_)) {
+        closeCopy();
+        return false;
+    }
+    tsf_set_output(copy, TSF_STEREO_INTERLEAVED, sampleRate, 0);
+    tsf_channel_set_presetnumber(copy, channel, program, channel == 9);
+
+    // Note-offs go first at the same frame, as when playing live
+    struct Event {
+        uint64_t frame;
+        bool on;
+        uint8_t pitch;
+        uint8_t velocity;
+    };
+    std::vector<Event> events;
+    events.reserve(notes.size() * 2);
+    uint64_t frame = from;
+    for (const auto& note : notes) {
+        events.push_back({note.on, true, note.pitch, note.velocity});
+        events.push_back({std::max(note.off, note.on + 1), false, note.pitch, 0});
+        frame = std::min(frame, note.on);
+    }
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.frame != b.frame ? a.frame < b.frame : a.on < b.on;
+    });
+
+    // Notes started before `from` render into scratch until then
+    static constexpr uint64_t BLOCK = 4096;
+    std::vector<float> scratch(BLOCK * 2);
+    size_t next = 0;
+    bool ok = true;
+    while (frame < to) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
+        for (; next < events.size() && events[next].frame <= frame; ++next) {
+            const Event& ev = events[next];
+            if (ev.on) tsf_channel_note_on(copy, channel, ev.pitch, ev.velocity / 127.0f);
+            else tsf_channel_note_off(copy, channel, ev.pitch);
+        }
+
+        uint64_t stop = std::min(to, frame + BLOCK);
+        if (frame < from) stop = std::min(stop, from);
+        if (next < events.size()) stop = std::min(stop, events[next].frame);
+        float* dst = frame >= from ? out + (frame - from) * 2 : scratch.data();
+        {
+            // A block at a time, so a program change isn't kept waiting
+            // on the whole render. Paging the program each block keeps
+            // the paging thread from evicting it meanwhile.
+            std::lock_guard<std::mutex> pagerLock(impl_->pagerMutex);
+            if (soundFontSerial_ != serial) {
+                ok = false;  // Its samples are gone
+                break;
+            }
+            impl_->pageProgram(sf, channel, program);
+            tsf_render_float(copy, dst, static_cast<int>(stop - frame), 0);
+        }
+        frame = stop;
+    }
+
+    closeCopy();
+    return ok;
+}
+
 }
@@ -1,14 +1,55 @@
 #pragma once
 
 #include "types.h"
+#include "timing_stats.h"
+#include <algorithm>
+#include <array>
 #include <string>
+#include <thread>
 #include <vector>
 #include <memory>
 #include <atomic>
+#include <chrono>
 #include <mutex>
+#include <utility>
 
 namespace midi {
 
+// How busy the audio callback is. Load is render time over the time the
+// rendered buffer lasts: 1.0 means the callback only just kept up.
+struct DspStats {
+    float load = 0.0f;           // Smoothed over ~300 ms
+    float peakLoad = 0.0f;       // Worst single callback in the last second
+    uint32_t lateCallbacks = 0;  // Callbacks that took longer than their buffer lasts
+    uint32_t underruns = 0;      // Times the device ran out of audio (estimated)
+    // Share of `load` per MIDI channel, split by active voices per frame
+    std::array<float, 16> channelLoad{};
+};
+
+// Requested audio device setup. Zero / empty means the backend decides.
+struct AudioConfig {
+    int sampleRate = 0;          // 0 = the device's native rate (no resampling)
+    uint32_t periodFrames = 0;   // Callback buffer size
+    uint32_t periods = 0;        // Buffers queued in the device
+    std::string backend;         // One of AudioSynth::availableBackends()
+    // Threads rendering SoundFont voices, the audio thread included; 0 =
+    // one per two cores, up to 4. Extra threads only join in when enough
+    // voices are sounding to be worth it.
+    int renderThreads = 0;
+};
+
+// What the device actually gave us
+struct AudioDeviceInfo {
+    std::string backend;
+    std::string deviceName;
+    int sampleRate = 0;
+    int nativeSampleRate = 0;    // Resampled when this differs from sampleRate
+    uint32_t periodFrames = 0;
+    uint32_t periods = 0;
+    double latencyMs = 0.0;      // Device buffering after the callback
+    int renderThreads = 1;
+};
+
 class AudioSynth {
 public:
     AudioSynth();
@@ -18,31 +59,128 @@ public:
     bool init();
     void shutdown();
     bool isInitialized() const { return initialized_; }
+
+    // Device setup. setConfig() before init() picks the first setup;
+    // reconfigure() restarts a running device with a new one (UI thread,
+    // drops anything playing or scheduled). Falls back to the defaults if
+    // the device refuses the config.
+    void setConfig(const AudioConfig& config) { config_ = config; }
+    const AudioConfig& getConfig() const { return config_; }
+    bool reconfigure(const AudioConfig& config);
+    AudioDeviceInfo getDeviceInfo() const;
+    static std::vector<std::string> availableBackends();
     
-    // SoundFont loading (optional - falls back to simple synth)
+    // SoundFont loading (optional - falls back to simple synth). Loads on
+    // a worker thread and swaps in when done; the current one (or the
+    // simple synth) keeps playing meanwhile. A newer load cancels an older
+    // one. False only if the file can't be opened.
     bool loadSoundFont(const std::string& filepath);
     bool hasSoundFont() const { return soundFontLoaded_; }
+    bool isLoadingSoundFont() const { return soundFontLoading_; }
+    float getSoundFontProgress() const { return soundFontProgress_; }  // 0-1
+
+    // SoundFont samples are mapped from the file and only converted for
+    // the presets in use: the channels' programs, the project's (channel,
+    // program) pairs and, up to the cache budget, recently used ones.
+    // Paged in on a background thread; any thread may call these.
+    void setProjectPrograms(const std::vector<std::pair<int, int>>& programs);
+    void setSampleCacheBudget(size_t bytes);
+    size_t getSampleBytesResident() const;
+    size_t getSampleBytesTotal() const;  // The whole sample chunk as float
     
-    // Note control
+    // Voices a SoundFont can play at once. They're allocated when it loads,
+    // so notes and rendering never allocate; past the limit a note takes
+    // the voice furthest into its release, or is dropped if none is.
+    // Applies from the next load.
+    void setMaxVoices(int voices) { maxVoices_ = std::max(1, voices); }
+    int getMaxVoices() const { return maxVoices_; }
+
+    // Note control, from any thread. Queued for the audio thread, which
+    // plays them at the start of its next buffer.
     void noteOn(int channel, int pitch, int velocity);
     void noteOff(int channel, int pitch);
     void allNotesOff();
     
-    // Program change
+    // Sample-accurate scheduling against the audio clock. Events are
+    // applied at their exact frame inside the audio callback; ones already
+    // in the past play at the start of the next buffer. Call from one
+    // thread only (the UI thread).
+    uint64_t currentFrame() const;  // First frame of the next buffer
+    int getSampleRate() const;
+    void scheduleNoteOn(int channel, int pitch, int velocity, uint64_t frame);
+    void scheduleNoteOff(int channel, int pitch, uint64_t frame);
+    // Drop scheduled note-ons; scheduled note-offs take effect right away
+    void cancelScheduled();
+    // A recent (frame, time it reaches the output) pair, for lining other
+    // outputs up with the audio. Taken at the start of each buffer, so it
+    // carries that callback's wake-up jitter.
+    void getClockReference(uint64_t& frame, std::chrono::steady_clock::time_point& time) const;
+    // Scheduled frame vs. the frame each event was actually rendered at
+    TimingRecorder& getTimingRecorder() { return timing_; }
+    // Callback load and dropouts; any thread
+    DspStats getDspStats() const;
+    void resetDspCounters();  // Zero lateCallbacks and underruns
+    
+    // Program change; queued like the notes
     void programChange(int channel, int program);
     
-    // Per-channel volume and pan
+    // Per-channel volume and pan, for the simple synth and the SoundFont.
+    // Cheap to call every frame: only changed values are stored, and the
+    // audio thread glides to them over ~10 ms.
     void setChannelVolume(int channel, float volume);
     void setChannelPan(int channel, float pan);
     
     // Volume control (0.0 - 1.0)
     void setMasterVolume(float volume);
     float getMasterVolume() const { return masterVolume_; }
-    
+
+    // Track freeze (see TrackFreezer). A frozen track is audio on the song
+    // timeline in chunks of FREEZE_CHUNK_FRAMES stereo frames, rendered at
+    // full volume and centred; a null chunk is silence. The audio thread
+    // mixes it in with its channel's volume/pan.
+    static constexpr uint32_t FREEZE_CHUNK_FRAMES = 1 << 16;
+    using FreezeChunk = std::shared_ptr<const std::vector<float>>;
+    struct FrozenTrack {
+        int channel = 0;
+        std::vector<FreezeChunk> chunks;
+    };
+    // The tracks mixed from frozen audio (UI thread). Chunks are read in
+    // place, so never change one after handing it over.
+    void setFrozenTracks(const std::vector<FrozenTrack>& tracks);
+    // Play the frozen tracks from `songFrame` for `frames`, starting at
+    // output `frame`. Like scheduled notes, dropped by cancelScheduled().
+    // A segment continuing the previous one joins it seamlessly.
+    void scheduleFrozen(uint64_t songFrame, uint32_t frames, uint64_t frame);
+
+    // Render notes on `channel` with `program` into `out` (stereo, frames
+    // [from, to) of the note timeline) with a private copy of the current
+    // SoundFont, on the calling thread. Notes sounding into the range are
+    // started from their beginning. False if there's no SoundFont or
+    // `cancel` got set.
+    struct OfflineNote {
+        uint64_t on, off;  // Frames
+        uint8_t pitch, velocity;
+    };
+    bool renderOffline(int channel, int program, int sampleRate, const std::vector<OfflineNote>& notes,
+                       uint64_t from, uint64_t to, float* out, const std::atomic<bool>* cancel = nullptr);
+    // Changes whenever another SoundFont (or none) takes over
+    uint32_t getSoundFontSerial() const { return soundFontSerial_; }
+
 private:
-    bool initialized_ = false;
-    bool soundFontLoaded_ = false;
+    AudioDeviceInfo getDeviceInfoUnchecked() const;
+    void stopLoader();  // Cancel and join a load in progress
+
+    std::atomic<bool> initialized_{false};  // Set by init(), which may run on another thread
+    std::atomic<bool> soundFontLoaded_{false};
+    std::atomic<bool> soundFontLoading_{false};
+    std::atomic<float> soundFontProgress_{0.0f};
+    std::atomic<bool> cancelLoad_{false};
+    std::thread loader_;
     std::atomic<float> masterVolume_{0.8f};
+    std::atomic<int> maxVoices_{256};
+    std::atomic<uint32_t> soundFontSerial_{0};
+    AudioConfig config_;
+    TimingRecorder timing_;
     
     // Forward declare implementation details (PIMPL pattern)
     struct Impl;
@@ -0,0 +1,324 @@
+#include "binary_io.h"
+#include <algorithm>
+#include <cstring>
+
+namespace midi {
+
+// Serialized note layout: pitch, velocity, flags (u8 each), start, duration (u32 each)
+static constexpr size_t NOTE_RECORD_SIZE = 11;
+static constexpr uint8_t NOTE_FLAG_SELECTED = 0x01;
+
+void ByteWriter::u32(uint32_t v) {
+    uint8_t b[4] = {
+        static_cast<uint8_t>(v),
+        static_cast<uint8_t>(v >> 8),
+        static_cast<uint8_t>(v >> 16),
+        static_cast<uint8_t>(v >> 24)
+    };
+    out_.insert(out_.end(), b, b + 4);
+}
+
+void ByteWriter::f32(float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    u32(bits);
+}
+
+void ByteWriter::varint(uint32_t v) {
+    while (v >= 0x80) {
+        out_.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out_.push_back(static_cast<uint8_t>(v));
+}
+
+void ByteWriter::svarint(int32_t v) {
+    varint((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+}
+
+void ByteWriter::str(const std::string& s) {
+    u32(static_cast<uint32_t>(s.size()));
+    bytes(s.data(), s.size());
+}
+
+void ByteWriter::bytes(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    out_.insert(out_.end(), p, p + size);
+}
+
+void ByteWriter::note(const Note& note) {
+    u8(static_cast<uint8_t>(std::clamp(note.pitch, 0, 127)));
+    u8(static_cast<uint8_t>(std::clamp(note.velocity, 0, 127)));
+    u8(note.selected ? NOTE_FLAG_SELECTED : 0);
+    u32(note.start_tick);
+    u32(note.duration);
+}
+
+void ByteWriter::notes(const std::vector<Note>& notes) {
+    u32(static_cast<uint32_t>(notes.size()));
+    out_.reserve(out_.size() + notes.size() * NOTE_RECORD_SIZE);
+    for (const auto& n : notes) {
+        note(n);
+    }
+}
+
+void ByteWriter::clipInstance(const ClipInstance& inst) {
+    i32(inst.clip);
+    u32(inst.offset);
+    i32(inst.transpose);
+    f32(inst.velocityScale);
+}
+
+void ByteWriter::project(const Project& project) {
+    u32(static_cast<uint32_t>(project.ticks_per_quarter));
+    f32(project.tempo_bpm);
+    i32(project.beats_per_bar);
+    i32(project.beat_unit);
+    u32(project.loop_start);
+    u32(project.loop_end);
+    u8(project.loop_enabled ? 1 : 0);
+    str(project.filepath);
+
+    u32(static_cast<uint32_t>(project.tracks.size()));
+    for (const auto& track : project.tracks) {
+        str(track.name);
+        i32(track.channel);
+        i32(track.program);
+        u8(track.muted ? 1 : 0);
+        u8(track.solo ? 1 : 0);
+        u8(track.frozen ? 1 : 0);
+        f32(track.volume);
+        f32(track.pan);
+        notes(track.notes);
+        u32(static_cast<uint32_t>(track.clipInstances.size()));
+        for (const auto& inst : track.clipInstances) {
+            clipInstance(inst);
+        }
+    }
+
+    u32(static_cast<uint32_t>(project.clips.size()));
+    for (const auto& clip : project.clips) {
+        str(clip.name);
+        u32(clip.length);
+        notes(clip.content.notes);
+    }
+}
+
+bool ByteReader::need(size_t n) {
+    if (!ok_ || size_ - pos_ < n) {
+        ok_ = false;
+        return false;
+    }
+    return true;
+}
+
+uint8_t ByteReader::u8() {
+    if (!need(1)) return 0;
+    return data_[pos_++];
+}
+
+uint32_t ByteReader::u32() {
+    if (!need(4)) return 0;
+    const uint8_t* p = data_ + pos_;
+    pos_ += 4;
+    return static_cast<uint32_t>(p[0]) |
+           (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+
+float ByteReader::f32() {
+    uint32_t bits = u32();
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+uint32_t ByteReader::varint() {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (!need(1)) return 0;
+        uint8_t b = data_[pos_++];
+        v |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    ok_ = false;  // more than 5 bytes: corrupt
+    return 0;
+}
+
+int32_t ByteReader::svarint() {
+    uint32_t v = varint();
+    return static_cast<int32_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+std::string ByteReader::str() {
+    uint32_t len = u32();
+    if (!need(len)) return std::string();
+    std::string s(reinterpret_cast<const char*>(data_ + pos_), len);
+    pos_ += len;
+    return s;
+}
+
+bool ByteReader::bytes(void* dst, size_t size) {
+    if (!need(size)) return false;
+    std::memcpy(dst, data_ + pos_, size);
+    pos_ += size;
+    return true;
+}
+
+Note ByteReader::note() {
+    Note n;
+    n.pitch = u8();
+    n.velocity = u8();
+    n.selected = (u8() & NOTE_FLAG_SELECTED) != 0;
+    n.start_tick = u32();
+    n.duration = u32();
+    return n;
+}
+
+std::vector<Note> ByteReader::notes() {
+    std::vector<Note> result;
+    uint32_t count = u32();
+    // Guard against a corrupt count asking for more notes than the buffer holds
+    if (!ok_ || count > remaining() / NOTE_RECORD_SIZE) {
+        ok_ = false;
+        return result;
+    }
+    result.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        result.push_back(note());
+    }
+    return result;
+}
+
+ClipInstance ByteReader::clipInstance() {
+    ClipInstance inst;
+    inst.clip = i32();
+    inst.offset = u32();
+    inst.transpose = i32();
+    inst.velocityScale = f32();
+    return inst;
+}
+
+bool ByteReader::project(Project& project) {
+    project = Project();
+    project.ticks_per_quarter = static_cast<int>(u32());
+    project.tempo_bpm = f32();
+    project.beats_per_bar = i32();
+    project.beat_unit = i32();
+    project.loop_start = u32();
+    project.loop_end = u32();
+    project.loop_enabled = u8() != 0;
+    project.filepath = str();
+
+    uint32_t trackCount = u32();
+    for (uint32_t i = 0; i < trackCount && ok_; ++i) {
+        Track track;
+        track.name = str();
+        track.channel = i32();
+        track.program = i32();
+        track.muted = u8() != 0;
+        track.solo = u8() != 0;
+        track.frozen = u8() != 0;
+        track.volume = f32();
+        track.pan = f32();
+        track.notes = notes();
+        uint32_t instanceCount = u32();
+        for (uint32_t j = 0; j < instanceCount && ok_; ++j) {
+            track.clipInstances.push_back(clipInstance());
+        }
+        project.tracks.push_back(std::move(track));
+    }
+
+    uint32_t clipCount = u32();
+    for (uint32_t i = 0; i < clipCount && ok_; ++i) {
+        Clip clip;
+        clip.name = str();
+        clip.length = u32();
+        clip.content.notes = notes();
+        project.clips.push_back(std::move(clip));
+    }
+    return ok_;
+}
+
+// PackedInts
+
+void PackedInts::write(ByteWriter& out) const {
+    out.varint(count_);
+    out.varint(static_cast<uint32_t>(data_.size()));
+    out.bytes(data_.data(), data_.size());
+}
+
+bool PackedInts::read(ByteReader& in) {
+    count_ = in.varint();
+    uint32_t size = in.varint();
+    // Every value takes at least one byte
+    if (!in.ok() || size > in.remaining() || count_ > size) {
+        in.fail();
+        count_ = 0;
+        data_.clear();
+        return false;
+    }
+    data_.resize(size);
+    return size == 0 || in.bytes(data_.data(), size);
+}
+
+// PackedNotes
+
+static constexpr uint8_t PACKED_SELECTED_BIT = 0x80;
+
+PackedNotes::PackedNotes(const std::vector<Note>& notes) {
+    ByteWriter out(data_);
+    int64_t prevStart = 0;
+    for (const auto& n : notes) {
+        out.svarint(static_cast<int32_t>(static_cast<int64_t>(n.start_tick) - prevStart));
+        out.varint(n.duration);
+        out.u8(static_cast<uint8_t>(std::clamp(n.pitch, 0, 127)));
+        uint8_t vel = static_cast<uint8_t>(std::clamp(n.velocity, 0, 127));
+        out.u8(n.selected ? (vel | PACKED_SELECTED_BIT) : vel);
+        prevStart = n.start_tick;
+    }
+    data_.shrink_to_fit();
+    count_ = static_cast<uint32_t>(notes.size());
+}
+
+std::vector<Note> PackedNotes::unpack() const {
+    std::vector<Note> notes;
+    notes.reserve(count_);
+    ByteReader in(data_.data(), data_.size());
+    int64_t start = 0;
+    for (uint32_t i = 0; i < count_; ++i) {
+        Note n;
+        start += in.svarint();
+        n.start_tick = static_cast<uint32_t>(start);
+        n.duration = in.varint();
+        n.pitch = in.u8();
+        uint8_t vel = in.u8();
+        n.velocity = vel & 0x7F;
+        n.selected = (vel & PACKED_SELECTED_BIT) != 0;
+        notes.push_back(n);
+    }
+    return notes;
+}
+
+void PackedNotes::write(ByteWriter& out) const {
+    out.varint(count_);
+    out.varint(static_cast<uint32_t>(data_.size()));
+    out.bytes(data_.data(), data_.size());
+}
+
+bool PackedNotes::read(ByteReader& in) {
+    count_ = in.varint();
+    uint32_t size = in.varint();
+    // A packed note is at least 4 bytes
+    if (!in.ok() || size > in.remaining() || count_ > size / 4) {
+        in.fail();
+        count_ = 0;
+        data_.clear();
+        return false;
+    }
+    data_.resize(size);
+    return size == 0 || in.bytes(data_.data(), size);
+}
+
+} // namespace midi
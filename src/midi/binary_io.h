@@ -0,0 +1,138 @@
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace midi {
+
+// Little-endian binary writer used for the edit journal.
+// Appends to a caller-owned byte buffer so records can be built without
+// any intermediate copies.
+class ByteWriter {
+public:
+    explicit ByteWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void u8(uint8_t v) { out_.push_back(v); }
+    void u32(uint32_t v);
+    void i32(int32_t v) { u32(static_cast<uint32_t>(v)); }
+    void f32(float v);
+    void varint(uint32_t v);
+    void svarint(int32_t v);  // zigzag, so small negative deltas stay small
+    void str(const std::string& s);
+    void bytes(const void* data, size_t size);
+
+    void note(const Note& note);
+    void notes(const std::vector<Note>& notes);
+    void clipInstance(const ClipInstance& inst);
+    void project(const Project& project);
+
+    size_t size() const { return out_.size(); }
+
+private:
+    std::vector<uint8_t>& out_;
+};
+
+// Bounds-checked reader. Reading past the end never crashes: the reader
+// just flips ok() to false and returns zeros, so a truncated journal tail
+// can be detected after the fact.
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    uint8_t u8();
+    uint32_t u32();
+    int32_t i32() { return static_cast<int32_t>(u32()); }
+    float f32();
+    uint32_t varint();
+    int32_t svarint();
+    std::string str();
+    bool bytes(void* dst, size_t size);
+
+    Note note();
+    std::vector<Note> notes();
+    ClipInstance clipInstance();
+    bool project(Project& project);
+
+    bool ok() const { return ok_; }
+    void fail() { ok_ = false; }
+    bool atEnd() const { return pos_ >= size_; }
+    size_t remaining() const { return ok_ ? size_ - pos_ : 0; }
+
+private:
+    bool need(size_t n);
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+// Compact list of integers for the undo history: each value is stored as a
+// zigzag varint delta from the previous one. Sorted note indices, durations
+// and velocities mostly come out at one byte per value instead of 4-8.
+class PackedInts {
+public:
+    PackedInts() = default;
+    template <typename T>
+    explicit PackedInts(const std::vector<T>& values) {
+        ByteWriter out(data_);
+        int64_t prev = 0;
+        for (T v : values) {
+            int64_t cur = static_cast<int64_t>(v);
+            out.svarint(static_cast<int32_t>(cur - prev));
+            prev = cur;
+        }
+        data_.shrink_to_fit();
+        count_ = static_cast<uint32_t>(values.size());
+    }
+
+    template <typename T>
+    std::vector<T> unpack() const {
+        std::vector<T> values;
+        values.reserve(count_);
+        ByteReader in(data_.data(), data_.size());
+        int64_t prev = 0;
+        for (uint32_t i = 0; i < count_; ++i) {
+            prev += in.svarint();
+            values.push_back(static_cast<T>(prev));
+        }
+        return values;
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    size_t memoryUsage() const { return data_.capacity(); }
+
+    void write(ByteWriter& out) const;
+    bool read(ByteReader& in);
+
+private:
+    std::vector<uint8_t> data_;
+    uint32_t count_ = 0;
+};
+
+// Compact note list for the undo history. Start ticks are delta encoded
+// against the previous note and the selected flag rides in the top bit of
+// the velocity byte, so a typical note takes ~5 bytes instead of sizeof(Note).
+class PackedNotes {
+public:
+    PackedNotes() = default;
+    explicit PackedNotes(const std::vector<Note>& notes);
+
+    std::vector<Note> unpack() const;
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    size_t memoryUsage() const { return data_.capacity(); }
+
+    void write(ByteWriter& out) const;
+    bool read(ByteReader& in);
+
+private:
+    std::vector<uint8_t> data_;
+    uint32_t count_ = 0;
+};
+
+} // namespace midi
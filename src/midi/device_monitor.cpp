@@ -0,0 +1,80 @@
+#include "device_monitor.h"
+#include "../startup_timeline.h"
+
+namespace midi {
+
+template <typename Port>
+static std::vector<std::string> portNames(Port* port) {
+    std::vector<std::string> names;
+    if (!port) return names;
+
+    unsigned int portCount = port->getPortCount();
+    for (unsigned int i = 0; i < portCount; ++i) {
+        try {
+            names.push_back(port->getPortName(i));
+        } catch (RtMidiError& error) {
+            names.push_back("Unknown Device");
+        }
+    }
+    return names;
+}
+
+DeviceMonitor::DeviceMonitor() {
+    std::atomic_store(&devices_, std::shared_ptr<const DeviceList>(std::make_shared<DeviceList>()));
+    thread_ = std::thread(&DeviceMonitor::run, this);
+}
+
+DeviceMonitor::~DeviceMonitor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void DeviceMonitor::refresh() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refreshPending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void DeviceMonitor::run() {
+    // The clients are created here too: opening a sequencer client can be
+    // as slow as a scan
+    {
+        StartupTimeline::Scope phase("MIDI port scan");
+        try {
+            midiOut_ = std::make_unique<RtMidiOut>();
+            midiIn_ = std::make_unique<RtMidiIn>();
+        } catch (RtMidiError& error) {
+            error.printMessage();
+        }
+        scan();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        wake_.wait_for(lock, POLL_INTERVAL, [this] { return !running_ || refreshPending_; });
+        if (!running_) break;
+        refreshPending_ = false;
+        lock.unlock();
+        scan();
+        lock.lock();
+    }
+}
+
+void DeviceMonitor::scan() {
+    auto list = std::make_shared<DeviceList>();
+    list->outputs = portNames(midiOut_.get());
+    list->inputs = portNames(midiIn_.get());
+
+    auto current = devices();
+    if (list->outputs != current->outputs || list->inputs != current->inputs) {
+        std::atomic_store(&devices_, std::shared_ptr<const DeviceList>(std::move(list)));
+    }
+}
+
+} // namespace midi
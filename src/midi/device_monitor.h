@@ -0,0 +1,54 @@
+#pragma once
+
+#include <RtMidi.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace midi {
+
+// MIDI port names from one scan. Never modified once published.
+struct DeviceList {
+    std::vector<std::string> outputs;
+    std::vector<std::string> inputs;
+};
+
+// Keeps the MIDI port list current without the UI ever enumerating: a
+// background thread rescans every POLL_INTERVAL (or when asked) using its
+// own RtMidi clients, and publishes a new immutable list only when
+// something changed. Readers just take the current pointer.
+class DeviceMonitor {
+public:
+    DeviceMonitor();
+    ~DeviceMonitor();
+
+    DeviceMonitor(const DeviceMonitor&) = delete;
+    DeviceMonitor& operator=(const DeviceMonitor&) = delete;
+
+    std::shared_ptr<const DeviceList> devices() const { return std::atomic_load(&devices_); }
+
+    // Rescan now instead of at the next interval (e.g. a device menu opened)
+    void refresh();
+
+private:
+    void run();
+    void scan();
+
+    static constexpr auto POLL_INTERVAL = std::chrono::seconds(1);
+
+    std::shared_ptr<const DeviceList> devices_;  // Accessed with atomic_load/store
+    std::unique_ptr<RtMidiOut> midiOut_;         // Scanner thread only
+    std::unique_ptr<RtMidiIn> midiIn_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = true;        // Guarded by mutex_
+    bool refreshPending_ = false;
+};
+
+} // namespace midi
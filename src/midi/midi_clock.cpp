@@ -0,0 +1,85 @@
+#include "midi_clock.h"
+#include <algorithm>
+#include <cmath>
+
+namespace midi {
+
+static constexpr double PI = 3.14159265358979323846;
+
+void ClockFollower::reset() {
+    *this = ClockFollower();
+}
+
+void ClockFollower::message(const uint8_t* bytes, int64_t timeNs) {
+    switch (bytes[0]) {
+    case MIDI_CLOCK:
+        if (running_) pulse(timeNs);
+        break;
+    case MIDI_START:
+        pulses_ = 0;
+        hasPulse_ = false;
+        running_ = true;
+        break;
+    case MIDI_CONTINUE:
+        hasPulse_ = false;
+        running_ = true;
+        break;
+    case MIDI_STOP:
+        running_ = false;
+        break;
+    case MIDI_SONG_POSITION:
+        pulses_ = static_cast<uint64_t>((bytes[1] & 0x7F) | ((bytes[2] & 0x7F) << 7)) * CLOCKS_PER_SPP_UNIT;
+        hasPulse_ = false;
+        break;
+    }
+}
+
+void ClockFollower::pulse(int64_t timeNs) {
+    bool restart = !hasPulse_ || static_cast<double>(timeNs - lastPulseNs_) / 1e9 > MAX_PERIOD;
+    lastPulseNs_ = timeNs;
+    ++pulses_;
+
+    if (restart) {
+        // Phase starts over here; a period from before is kept
+        baseNs_ = timeNs;
+        t0_ = 0.0;
+        t1_ = period_;
+    } else if (!locked_) {
+        // Second pulse: seed the filter with the raw period
+        double t = static_cast<double>(timeNs - baseNs_) / 1e9;
+        period_ = t - t0_;
+        t0_ = t;
+        t1_ = t + period_;
+        locked_ = period_ > 0.0;
+    } else {
+        // Delay-locked loop, critically damped
+        double t = static_cast<double>(timeNs - baseNs_) / 1e9;
+        double omega = 2.0 * PI * BANDWIDTH_HZ * period_;
+        double error = t - t1_;
+        t0_ = t1_;
+        t1_ += std::sqrt(2.0) * omega * error + period_;
+        period_ += omega * omega * error;
+    }
+    hasPulse_ = true;
+}
+
+double ClockFollower::tempoBpm() const {
+    return locked_ && period_ > 0.0 ? 60.0 / (period_ * CLOCKS_PER_QUARTER) : 0.0;
+}
+
+uint32_t ClockFollower::tickAt(int64_t timeNs, int ticksPerQuarter) const {
+    double clocks = static_cast<double>(pulses_);
+    if (running_ && hasPulse_) {
+        // pulses_ counts the last pulse; interpolate towards the next, but
+        // never past it if the clock stalls
+        double fraction = 0.0;
+        if (locked_ && t1_ > t0_) {
+            double t = static_cast<double>(timeNs - baseNs_) / 1e9;
+            fraction = std::clamp((t - t0_) / (t1_ - t0_), 0.0, 1.0);
+        }
+        clocks = static_cast<double>(pulses_ - 1) + fraction;
+    }
+    return static_cast<uint32_t>(clocks * ticksPerQuarter / CLOCKS_PER_QUARTER + 0.5);
+}
+
+} // namespace midi
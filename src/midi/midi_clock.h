@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+namespace midi {
+
+// MIDI beat clock: 24 pulses per quarter note, Song Position Pointer in
+// sixteenth notes (6 pulses)
+constexpr int CLOCKS_PER_QUARTER = 24;
+constexpr int CLOCKS_PER_SPP_UNIT = 6;
+
+enum : uint8_t {
+    MIDI_SONG_POSITION = 0xF2,
+    MIDI_CLOCK = 0xF8,
+    MIDI_START = 0xFA,
+    MIDI_CONTINUE = 0xFB,
+    MIDI_STOP = 0xFC,
+};
+
+// Follows an external MIDI clock. Pulse arrival times are jittery (USB
+// polling, driver scheduling), so they go through a second-order delay-
+// locked loop; the filtered pulse time and period give a smooth song
+// position and tempo between pulses. Times are steady_clock nanoseconds.
+class ClockFollower {
+public:
+    void message(const uint8_t* bytes, int64_t timeNs);
+    void reset();
+
+    bool isRunning() const { return running_; }
+    bool hasTempo() const { return locked_; }
+    double tempoBpm() const;
+
+    // Song position at `timeNs`, in ticks at `ticksPerQuarter`
+    uint32_t tickAt(int64_t timeNs, int ticksPerQuarter) const;
+
+private:
+    void pulse(int64_t timeNs);
+
+    static constexpr double BANDWIDTH_HZ = 0.5;  // Loop bandwidth: lower = smoother, slower to follow
+    static constexpr double MAX_PERIOD = 0.25;   // Seconds; slower than this (10 BPM) is a restart
+
+    bool running_ = false;
+    bool locked_ = false;       // Filter has a period estimate
+    bool hasPulse_ = false;     // A pulse arrived since start/continue
+    uint64_t pulses_ = 0;       // Song position in pulses at the next pulse
+    int64_t baseNs_ = 0;        // Filter time origin, keeps doubles precise
+    int64_t lastPulseNs_ = 0;
+    double t0_ = 0.0;           // Filtered time of the last pulse (s from base)
+    double t1_ = 0.0;           // Predicted time of the next one
+    double period_ = 0.0;       // Filtered period (s)
+};
+
+} // namespace midi
@@ -254,8 +254,12 @@ bool saveMidiFile(const std::string& filepath, const Project& project) {
             midifile.addPatchChange(trackIndex, 0, track.channel,
                                     std::clamp(track.program, 0, 127));
 
+            // Clip instances are written out as plain notes
+            std::vector<Note> clipNotes;
+            project.expandClips(track, 0, UINT32_MAX, clipNotes);
+
             // Add all notes with safe tick clamping
-            for (const auto& note : track.notes) {
+            auto addNote = [&](const Note& note) {
                 int startTick = safeTickToInt(note.start_tick);
                 uint64_t endTick64 = static_cast<uint64_t>(note.start_tick) + note.duration;
                 int endTick = safeTickToInt(endTick64 > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(endTick64));
@@ -265,7 +269,9 @@ bool saveMidiFile(const std::string& filepath, const Project& project) {
                                    std::clamp(note.velocity, 1, 127));
                 midifile.addNoteOff(trackIndex, endTick, track.channel,
                                     std::clamp(note.pitch, 0, 127));
-            }
+            };
+            for (const auto& note : track.notes) addNote(note);
+            for (const auto& note : clipNotes) addNote(note);
         }
 
         // Sort events by time
@@ -0,0 +1,236 @@
+#include "midi_input.h"
+#include "audio_synth.h"
+#include "midi_clock.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace midi {
+
+static constexpr uint8_t CLOCK_RUNNING = 1;
+static constexpr uint8_t CLOCK_LOOPING = 2;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t TransportClock::tickAt(int64_t ns) const {
+    double tick = anchorTick + static_cast<double>(ns - anchorNs) * ticksPerNs;
+
+    // Inside a loop, both directions stay inside it: a note played just
+    // before the wrap is heard is still at the end of the loop
+    if (looping && loopEnd > loopStart) {
+        double length = loopEnd - loopStart;
+        if (tick >= loopEnd && anchorTick < loopEnd) {
+            tick = loopStart + std::fmod(tick - loopStart, length);
+        } else if (tick < loopStart && anchorTick >= loopStart) {
+            tick = loopEnd - std::fmod(loopStart - tick, length);
+            if (tick >= loopEnd) tick = loopStart;
+        }
+    }
+    return static_cast<uint32_t>(std::max(0.0, tick + 0.5));
+}
+
+MidiInput::MidiInput() = default;
+
+bool MidiInput::init() {
+    std::unique_ptr<RtMidiIn> midiIn;
+    try {
+        midiIn = std::make_unique<RtMidiIn>();
+        // Sysex and active sensing would only fill the ring; clock is kept
+        // for following an external master
+        midiIn->ignoreTypes(true, false, true);
+    } catch (RtMidiError& error) {
+        error.printMessage();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(portMutex_);
+    midiIn_ = std::move(midiIn);
+    return true;
+}
+
+MidiInput::~MidiInput() {
+    close();
+}
+
+bool MidiInput::open(const std::string& portName) {
+    std::lock_guard<std::mutex> lock(portMutex_);
+    if (!midiIn_) return false;
+
+    try {
+        if (midiIn_->isPortOpen()) {
+            midiIn_->cancelCallback();
+            midiIn_->closePort();
+        }
+        open_ = false;
+
+        unsigned int portCount = midiIn_->getPortCount();
+        for (unsigned int port = 0; port < portCount; ++port) {
+            if (midiIn_->getPortName(port) != portName) continue;
+            midiIn_->openPort(port);
+            midiIn_->setCallback(&MidiInput::callback, this);
+            open_ = true;
+            return true;
+        }
+    } catch (RtMidiError& error) {
+        error.printMessage();
+    }
+    return false;
+}
+
+void MidiInput::close() {
+    std::lock_guard<std::mutex> lock(portMutex_);
+    open_ = false;
+    if (midiIn_ && midiIn_->isPortOpen()) {
+        midiIn_->cancelCallback();
+        midiIn_->closePort();
+    }
+}
+
+void MidiInput::setMonitor(AudioSynth* synth, int channel) {
+    monitor_.store(synth, std::memory_order_release);
+    monitorChannel_.store(channel, std::memory_order_relaxed);
+}
+
+void MidiInput::setTransport(const TransportClock& clock) {
+    uint32_t seq = clockSeq_.load(std::memory_order_relaxed);
+    clockSeq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clockAnchorNs_.store(clock.anchorNs, std::memory_order_relaxed);
+    clockAnchorTick_.store(clock.anchorTick, std::memory_order_relaxed);
+    clockTicksPerNs_.store(clock.ticksPerNs, std::memory_order_relaxed);
+    clockLoopStart_.store(clock.loopStart, std::memory_order_relaxed);
+    clockLoopEnd_.store(clock.loopEnd, std::memory_order_relaxed);
+    clockFlags_.store((clock.running ? CLOCK_RUNNING : 0) | (clock.looping ? CLOCK_LOOPING : 0),
+                      std::memory_order_relaxed);
+    clockSeq_.store(seq + 2, std::memory_order_release);
+}
+
+TransportClock MidiInput::transport() const {
+    TransportClock clock;
+    uint32_t before, after;
+    do {
+        before = clockSeq_.load(std::memory_order_acquire);
+        clock.anchorNs = clockAnchorNs_.load(std::memory_order_relaxed);
+        clock.anchorTick = clockAnchorTick_.load(std::memory_order_relaxed);
+        clock.ticksPerNs = clockTicksPerNs_.load(std::memory_order_relaxed);
+        clock.loopStart = clockLoopStart_.load(std::memory_order_relaxed);
+        clock.loopEnd = clockLoopEnd_.load(std::memory_order_relaxed);
+        uint8_t flags = clockFlags_.load(std::memory_order_relaxed);
+        clock.running = flags & CLOCK_RUNNING;
+        clock.looping = flags & CLOCK_LOOPING;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = clockSeq_.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    return clock;
+}
+
+void MidiInput::callback(double /*deltaTime*/, std::vector<unsigned char>* message, void* userData) {
+    if (message && !message->empty()) {
+        static_cast<MidiInput*>(userData)->receive(*message);
+    }
+}
+
+void MidiInput::receive(const std::vector<unsigned char>& message) {
+    // Stamp first, before anything else costs time
+    int64_t now = nowNs();
+    TransportClock clock = transport();
+
+    unsigned char status = message[0];
+    if (status < 0x80) return;
+    // Of the system messages, only clock, transport and song position
+    if (status >= 0xF0 && status != MIDI_CLOCK && status != MIDI_START && status != MIDI_CONTINUE &&
+        status != MIDI_STOP && status != MIDI_SONG_POSITION) {
+        return;
+    }
+    unsigned char data1 = message.size() > 1 ? message[1] : 0;
+    unsigned char data2 = message.size() > 2 ? message[2] : 0;
+
+    // Monitoring goes straight to the synth from this thread, no queue and
+    // no UI frame in between
+    unsigned char type = status & 0xF0;
+    AudioSynth* synth = monitor_.load(std::memory_order_acquire);
+    if (synth && status < 0xF0) {
+        int channel = monitorChannel_.load(std::memory_order_relaxed);
+        if (channel < 0) channel = status & 0x0F;
+        if (type == 0x90 && data2 > 0) synth->noteOn(channel, data1, data2);
+        else if (type == 0x80 || type == 0x90) synth->noteOff(channel, data1);
+    }
+
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+        fprintf(stderr, "MIDI error: Input queue full, dropping message\n");
+        return;
+    }
+    InputEvent& event = queue_[tail & (QUEUE_SIZE - 1)];
+    event.timeNs = now;
+    event.running = clock.running;
+    event.tick = clock.running ? clock.tickAt(now) : 0;
+    event.bytes[0] = status;
+    event.bytes[1] = data1;
+    event.bytes[2] = data2;
+    tail_.store(tail + 1, std::memory_order_release);
+}
+
+void MidiInput::drain(std::vector<InputEvent>& out) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+        out.push_back(queue_[head & (QUEUE_SIZE - 1)]);
+    }
+    head_.store(head, std::memory_order_release);
+}
+
+void NoteRecorder::reset() {
+    for (auto& channel : held_) {
+        for (auto& held : channel) held.active = false;
+    }
+    finished_.clear();
+}
+
+void NoteRecorder::feed(const InputEvent& event) {
+    if (!event.running) return;
+    unsigned char type = event.bytes[0] & 0xF0;
+    if (type != 0x80 && type != 0x90) return;
+
+    int channel = event.bytes[0] & 0x0F;
+    int pitch = event.bytes[1] & 0x7F;
+    Held& held = held_[channel][pitch];
+
+    // A repeated note-on without its note-off ends the earlier note
+    if (held.active) finish(held, pitch, event.tick);
+
+    if (type == 0x90 && event.bytes[2] > 0) {
+        held.active = true;
+        held.start = event.tick;
+        held.velocity = event.bytes[2];
+    }
+}
+
+void NoteRecorder::closeAll(uint32_t tick) {
+    for (auto& channel : held_) {
+        for (int pitch = 0; pitch < 128; ++pitch) {
+            if (channel[pitch].active) finish(channel[pitch], pitch, tick);
+        }
+    }
+}
+
+void NoteRecorder::finish(Held& held, int pitch, uint32_t end) {
+    held.active = false;
+    // Released after the loop wrapped: the note ran to the loop end
+    if (end < held.start) end = std::max(held.start, loopEnd_);
+    Note note;
+    note.pitch = pitch;
+    note.velocity = held.velocity;
+    note.start_tick = held.start;
+    note.duration = std::max<uint32_t>(1, end - held.start);
+    finished_.push_back(note);
+}
+
+void NoteRecorder::take(std::vector<Note>& out) {
+    out.insert(out.end(), finished_.begin(), finished_.end());
+    finished_.clear();
+}
+
+} // namespace midi
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "types.h"
+#include <RtMidi.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace midi {
+
+class AudioSynth;
+
+// Where the transport is, as heard: at steady_clock time `anchorNs` the
+// listener hears `anchorTick`, moving `ticksPerNs`, wrapping at the loop
+// end. Published by the player every update, read by the MIDI input thread.
+struct TransportClock {
+    int64_t anchorNs = 0;
+    uint32_t anchorTick = 0;
+    double ticksPerNs = 0.0;
+    uint32_t loopStart = 0;
+    uint32_t loopEnd = 0;
+    bool looping = false;
+    bool running = false;
+
+    uint32_t tickAt(int64_t ns) const;
+};
+
+// One captured channel message (or clock/transport message), stamped on
+// arrival
+struct InputEvent {
+    int64_t timeNs;      // steady_clock
+    uint32_t tick;       // Transport tick heard at timeNs (valid if running)
+    bool running;        // Transport was playing
+    unsigned char bytes[3];
+};
+
+// MIDI input. The RtMidi callback stamps each message with the transport
+// clock, passes notes straight to the monitor synth, and pushes the event
+// into a lock-free ring (single producer: the RtMidi thread). The UI thread
+// drains the ring.
+class MidiInput {
+public:
+    MidiInput();
+    ~MidiInput();
+
+    MidiInput(const MidiInput&) = delete;
+    MidiInput& operator=(const MidiInput&) = delete;
+
+    // Create the RtMidi client (may be slow; fine on any thread)
+    bool init();
+
+    // Ports are opened by name (see DeviceMonitor for the list)
+    bool open(const std::string& portName);
+    void close();
+    bool isOpen() const { return open_.load(std::memory_order_relaxed); }
+
+    // Incoming notes play on `synth`, on `channel` (-1 = as received)
+    void setMonitor(AudioSynth* synth, int channel);
+    void setTransport(const TransportClock& clock);
+
+    // Append everything received since the last drain
+    void drain(std::vector<InputEvent>& out);
+
+private:
+    static void callback(double deltaTime, std::vector<unsigned char>* message, void* userData);
+    void receive(const std::vector<unsigned char>& message);
+    TransportClock transport() const;
+
+    std::unique_ptr<RtMidiIn> midiIn_;
+    mutable std::mutex portMutex_;
+    std::atomic<bool> open_{false};
+
+    std::atomic<AudioSynth*> monitor_{nullptr};
+    std::atomic<int> monitorChannel_{-1};
+
+    // Transport clock under a sequence lock (writer: UI, reader: input thread)
+    std::atomic<uint32_t> clockSeq_{0};
+    std::atomic<int64_t> clockAnchorNs_{0};
+    std::atomic<uint32_t> clockAnchorTick_{0};
+    std::atomic<double> clockTicksPerNs_{0.0};
+    std::atomic<uint32_t> clockLoopStart_{0};
+    std::atomic<uint32_t> clockLoopEnd_{0};
+    std::atomic<uint8_t> clockFlags_{0};
+
+    static constexpr size_t QUEUE_SIZE = 4096;  // Power of two
+    std::array<InputEvent, QUEUE_SIZE> queue_;
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+};
+
+// Turns note-on/note-off pairs into Notes. A note-on with velocity 0 is a
+// note-off; notes still held when recording stops are closed at that tick.
+class NoteRecorder {
+public:
+    void reset();
+    void setLoopEnd(uint32_t tick) { loopEnd_ = tick; }  // 0 = not looping
+    void feed(const InputEvent& event);
+    void closeAll(uint32_t tick);
+
+    // Move out the notes completed so far
+    void take(std::vector<Note>& out);
+
+private:
+    struct Held {
+        bool active = false;
+        uint32_t start = 0;
+        int velocity = 0;
+    };
+    void finish(Held& held, int pitch, uint32_t end);
+
+    std::array<std::array<Held, 128>, 16> held_{};
+    std::vector<Note> finished_;
+    uint32_t loopEnd_ = 0;
+};
+
+} // namespace midi
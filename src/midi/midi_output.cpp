@@ -0,0 +1,215 @@
+#include "midi_output.h"
+#include "rt_thread.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace midi {
+
+// Sleep until this long before a message is due, then spin. Sleep wake-up
+// on desktop OSes is good to well under this.
+static constexpr auto SPIN_WINDOW = std::chrono::microseconds(1000);
+// Longest idle sleep; new messages wake the thread earlier
+static constexpr auto IDLE_WAIT = std::chrono::milliseconds(20);
+
+static int64_t toNs(int64_t clockTicks) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(MidiOutput::Clock::duration(clockTicks)).count();
+}
+
+MidiOutput::MidiOutput() {
+    pending_.reserve(QUEUE_SIZE);
+    thread_ = std::thread(&MidiOutput::run, this);
+}
+
+bool MidiOutput::init() {
+    // Opening a sequencer client can take a while, so do it outside the lock
+    std::unique_ptr<RtMidiOut> midiOut;
+    try {
+        midiOut = std::make_unique<RtMidiOut>();
+    } catch (RtMidiError& error) {
+        error.printMessage();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(portMutex_);
+    midiOut_ = std::move(midiOut);
+    return true;
+}
+
+MidiOutput::~MidiOutput() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        running_.store(false, std::memory_order_relaxed);
+    }
+    wake_.notify_one();
+    thread_.join();
+
+    // Whatever is still queued (final note-offs) goes out now
+    takeQueued();
+    {
+        std::lock_guard<std::mutex> portLock(portMutex_);
+        while (!pending_.empty()) {
+            write(pending_.front());
+            std::pop_heap(pending_.begin(), pending_.end(), later);
+            pending_.pop_back();
+        }
+    }
+    close();
+}
+
+bool MidiOutput::open(const std::string& portName) {
+    std::lock_guard<std::mutex> lock(portMutex_);
+    if (!midiOut_) return false;
+
+    try {
+        if (midiOut_->isPortOpen()) {
+            midiOut_->closePort();
+        }
+        open_ = false;
+
+        unsigned int portCount = midiOut_->getPortCount();
+        for (unsigned int port = 0; port < portCount; ++port) {
+            if (midiOut_->getPortName(port) != portName) continue;
+            midiOut_->openPort(port);
+            open_ = true;
+            return true;
+        }
+    } catch (RtMidiError& error) {
+        error.printMessage();
+    }
+    return false;
+}
+
+void MidiOutput::close() {
+    std::lock_guard<std::mutex> lock(portMutex_);
+    open_ = false;
+    if (midiOut_ && midiOut_->isPortOpen()) {
+        midiOut_->closePort();
+    }
+}
+
+void MidiOutput::enqueue(const unsigned char* bytes, size_t size, Clock::time_point time, bool measured) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+        fprintf(stderr, "MIDI error: Output queue full, dropping message\n");
+        return;
+    }
+
+    Message& msg = queue_[tail & (QUEUE_SIZE - 1)];
+    msg.time = time.time_since_epoch().count();
+    msg.seq = nextSeq_++;
+    msg.generation = generation_.load(std::memory_order_relaxed);
+    msg.measured = measured;
+    msg.size = static_cast<uint8_t>(std::min<size_t>(size, 3));
+    std::copy(bytes, bytes + msg.size, msg.bytes);
+    tail_.store(tail + 1, std::memory_order_seq_cst);
+    wakeIfSleeping();
+}
+
+void MidiOutput::cancelPending() {
+    generation_.fetch_add(1, std::memory_order_seq_cst);
+    wakeIfSleeping();
+}
+
+// The store before this and sleeping_ here, against sleeping_ and then
+// hasNews() in sleepUntil(), are all seq_cst: with anything weaker both
+// sides can read the old value and the message waits for the timeout.
+// Only pay for the wake-up when the thread is actually waiting; the lock
+// is then held by it only for the few lines before it's in wait_until().
+void MidiOutput::wakeIfSleeping() {
+    if (sleeping_.load(std::memory_order_seq_cst)) {
+        { std::lock_guard<std::mutex> lock(wakeMutex_); }
+        wake_.notify_one();
+    }
+}
+
+void MidiOutput::takeQueued() {
+    uint32_t gen = generation_.load(std::memory_order_acquire);
+    if (gen != pendingGeneration_) {
+        std::lock_guard<std::mutex> portLock(portMutex_);
+        for (const auto& msg : pending_) {
+            if (isNoteOff(msg)) write(msg);
+        }
+        pending_.clear();
+        pendingGeneration_ = gen;
+    }
+
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    while (head != tail && pending_.size() < pending_.capacity()) {
+        const Message& msg = queue_[head & (QUEUE_SIZE - 1)];
+        if (msg.generation == gen) {
+            pending_.push_back(msg);
+            std::push_heap(pending_.begin(), pending_.end(), later);
+        } else if (isNoteOff(msg)) {
+            std::lock_guard<std::mutex> portLock(portMutex_);
+            write(msg);
+        }
+        ++head;
+    }
+    head_.store(head, std::memory_order_release);
+}
+
+bool MidiOutput::hasNews() const {
+    return tail_.load(std::memory_order_seq_cst) != head_.load(std::memory_order_relaxed) ||
+           generation_.load(std::memory_order_seq_cst) != pendingGeneration_;
+}
+
+void MidiOutput::sleepUntil(Clock::time_point time) {
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    // Recheck after announcing the sleep, so a message or cancel that
+    // came in between isn't left waiting for the timeout
+    sleeping_.store(true, std::memory_order_seq_cst);
+    if (running_.load(std::memory_order_relaxed) && !hasNews()) {
+        wake_.wait_until(lock, time);
+    }
+    sleeping_.store(false, std::memory_order_relaxed);
+}
+
+void MidiOutput::write(const Message& msg) {
+    if (!midiOut_ || !open_.load(std::memory_order_relaxed)) return;
+    try {
+        midiOut_->sendMessage(msg.bytes, msg.size);
+    } catch (RtMidiError& error) {
+        error.printMessage();
+    }
+}
+
+void MidiOutput::run() {
+    // Clock pulses and notes are sent from this thread. Where it can't get
+    // real-time priority, the spin window covers the difference.
+    raiseThreadPriority();
+    while (running_.load(std::memory_order_relaxed)) {
+        takeQueued();
+
+        if (pending_.empty()) {
+            sleepUntil(Clock::now() + IDLE_WAIT);
+            continue;
+        }
+
+        Clock::time_point due{Clock::duration(pending_.front().time)};
+        if (due - Clock::now() > SPIN_WINDOW) {
+            // Woken early by anything new, which might be due sooner
+            sleepUntil(due - SPIN_WINDOW);
+            continue;
+        }
+
+        while (Clock::now() < due) {
+            std::this_thread::yield();
+        }
+
+        // Everything due by now goes out back to back, under one lock
+        {
+            std::lock_guard<std::mutex> portLock(portMutex_);
+            int64_t now = Clock::now().time_since_epoch().count();
+            while (!pending_.empty() && pending_.front().time <= now) {
+                write(pending_.front());
+                if (pending_.front().measured) {
+                    timing_.record(toNs(pending_.front().time), toNs(Clock::now().time_since_epoch().count()));
+                }
+                std::pop_heap(pending_.begin(), pending_.end(), later);
+                pending_.pop_back();
+            }
+        }
+    }
+}
+
+} // namespace midi
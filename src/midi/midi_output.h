@@ -0,0 +1,101 @@
+#pragma once
+
+#include "timing_stats.h"
+#include <RtMidi.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace midi {
+
+// External MIDI output on its own thread. Messages are queued with the
+// time they should go out; the thread sleeps until shortly before that,
+// spins the last stretch, then sends everything due in one burst. Queuing
+// never allocates: messages are copied into a fixed ring (single producer,
+// the UI thread) and from there into a preallocated heap. It only takes a
+// lock to wake the thread when it's asleep, and then only for as long as
+// the thread takes to get into its wait.
+class MidiOutput {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    MidiOutput();
+    ~MidiOutput();
+
+    MidiOutput(const MidiOutput&) = delete;
+    MidiOutput& operator=(const MidiOutput&) = delete;
+
+    // Create the RtMidi client (may be slow; fine on any thread). Until
+    // then ports can't be opened, and queued messages go nowhere.
+    bool init();
+
+    // Ports are opened by name (see DeviceMonitor for the list)
+    bool open(const std::string& portName);
+    void close();
+    bool isOpen() const { return open_.load(std::memory_order_relaxed); }
+
+    // Queue a message of up to 3 bytes. Times in the past mean "now".
+    // Timed sends are measured in the timing recorder; sendNow() isn't.
+    void send(const unsigned char* bytes, size_t size, Clock::time_point time) { enqueue(bytes, size, time, true); }
+    void sendNow(const unsigned char* bytes, size_t size) { enqueue(bytes, size, Clock::now(), false); }
+
+    // Target time vs. when sendMessage() actually ran
+    TimingRecorder& getTimingRecorder() { return timing_; }
+
+    // Drop queued messages; queued note-offs are sent right away instead so
+    // nothing is left hanging
+    void cancelPending();
+
+private:
+    struct Message {
+        int64_t time;  // Clock ticks since epoch
+        uint32_t seq;
+        uint32_t generation;
+        bool measured;
+        uint8_t size;
+        unsigned char bytes[3];
+    };
+    static bool later(const Message& a, const Message& b) {
+        return a.time != b.time ? a.time > b.time : a.seq > b.seq;
+    }
+    static bool isNoteOff(const Message& msg) {
+        return (msg.bytes[0] & 0xF0) == 0x80 || ((msg.bytes[0] & 0xF0) == 0x90 && msg.bytes[2] == 0);
+    }
+
+    void enqueue(const unsigned char* bytes, size_t size, Clock::time_point time, bool measured);
+    void run();
+    void takeQueued();
+    bool hasNews() const;  // Queued messages or a cancel not yet taken
+    void sleepUntil(Clock::time_point time);  // Or until woken by news
+    void wakeIfSleeping();
+    void write(const Message& msg);  // Caller holds portMutex_
+
+    std::unique_ptr<RtMidiOut> midiOut_;
+    mutable std::mutex portMutex_;  // Port open/close/enumeration vs. sending
+    std::atomic<bool> open_{false};
+    TimingRecorder timing_;
+
+    static constexpr size_t QUEUE_SIZE = 4096;  // Power of two
+    std::array<Message, QUEUE_SIZE> queue_;
+    std::atomic<size_t> head_{0};  // Output thread
+    std::atomic<size_t> tail_{0};  // Producer
+    std::atomic<uint32_t> generation_{0};
+    uint32_t nextSeq_ = 0;         // Producer
+
+    std::vector<Message> pending_;  // Output thread, heap on `later`
+    uint32_t pendingGeneration_ = 0;
+
+    std::thread thread_;
+    std::mutex wakeMutex_;  // Only held around the thread's wait
+    std::condition_variable wake_;
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> running_{true};  // Cleared under wakeMutex_
+};
+
+} // namespace midi
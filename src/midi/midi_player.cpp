@@ -1,166 +1,680 @@
 #include "midi_player.h"
-#include <RtMidi.h>
+#include "../startup_timeline.h"
 #include <algorithm>
+#include <cmath>
+#include <functional>
 
 namespace midi {
 
-MidiPlayer::MidiPlayer() {
-    // Initialize built-in audio synth
-    audioSynth_.init();
-    
-    // Initialize MIDI output
-    try {
-        midiOut_ = std::make_unique<RtMidiOut>();
-    } catch (RtMidiError& error) {
-        error.printMessage();
-    }
-}
+MidiPlayer::MidiPlayer() = default;
 
 MidiPlayer::~MidiPlayer() {
+    // Let a bring-up still in progress finish before tearing down
+    if (audioInit_.valid()) audioInit_.wait();
+    if (midiInit_.valid()) midiInit_.wait();
+    pollStartup();
+
     allNotesOff();
-    
-    if (midiOut_ && midiOut_->isPortOpen()) {
-        midiOut_->closePort();
-    }
-    
+    midiOutput_.cancelPending();
     audioSynth_.shutdown();
 }
 
-std::vector<std::string> MidiPlayer::getOutputDevices() const {
-    std::vector<std::string> devices;
-    if (!midiOut_) return devices;
-    
-    unsigned int portCount = midiOut_->getPortCount();
-    for (unsigned int i = 0; i < portCount; ++i) {
-        try {
-            devices.push_back(midiOut_->getPortName(i));
-        } catch (RtMidiError& error) {
-            devices.push_back("Unknown Device");
-        }
+void MidiPlayer::start() {
+    if (started_) return;
+    started_ = true;
+
+    // Audio (backend probing, device start) and MIDI (sequencer clients)
+    // come up in parallel; pollStartup() picks them up when done
+    audioInit_ = std::async(std::launch::async, [this] {
+        StartupTimeline::Scope phase("audio init");
+        return audioSynth_.init();
+    });
+    midiInit_ = std::async(std::launch::async, [this] {
+        StartupTimeline::Scope phase("MIDI init");
+        bool output = midiOutput_.init();
+        bool input = midiInput_.init();
+        return output && input;
+    });
+}
+
+void MidiPlayer::pollStartup() {
+    auto done = [](std::future<bool>& init) {
+        return init.valid() && init.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    if (!audioReady_ && done(audioInit_)) {
+        audioInit_.get();  // A failed init just leaves the synth silent
+        audioReady_ = true;
+        for (auto& call : queuedAudio_) call();
+        queuedAudio_.clear();
+    }
+    if (!midiReady_ && done(midiInit_)) {
+        midiInit_.get();
+        midiReady_ = true;
+        for (auto& call : queuedMidi_) call();
+        queuedMidi_.clear();
     }
-    return devices;
+    if (audioReady_ && midiReady_) {
+        StartupTimeline::get().report();
+    }
+}
+
+void MidiPlayer::whenAudioReady(std::function<void()> call) {
+    if (audioReady_) call();
+    else queuedAudio_.push_back(std::move(call));
+}
+
+void MidiPlayer::whenMidiReady(std::function<void()> call) {
+    if (midiReady_) call();
+    else queuedMidi_.push_back(std::move(call));
+}
+
+static int indexOf(const std::vector<std::string>& names, const std::string& name) {
+    if (name.empty()) return -1;
+    auto it = std::find(names.begin(), names.end(), name);
+    return it != names.end() ? static_cast<int>(it - names.begin()) : -1;
 }
 
 bool MidiPlayer::openDevice(int deviceIndex) {
-    if (!midiOut_) return false;
-    
-    try {
-        if (midiOut_->isPortOpen()) {
-            allNotesOff();
-            midiOut_->closePort();
-        }
-        
-        if (deviceIndex >= 0 && deviceIndex < static_cast<int>(midiOut_->getPortCount())) {
-            midiOut_->openPort(deviceIndex);
-            currentDevice_ = deviceIndex;
-            return true;
-        }
-    } catch (RtMidiError& error) {
-        error.printMessage();
+    if (isDeviceOpen()) {
+        allNotesOff();
     }
-    
-    currentDevice_ = -1;
-    return false;
+
+    auto devices = getDevices();
+    if (deviceIndex < 0 || deviceIndex >= static_cast<int>(devices->outputs.size())) {
+        currentDevice_.clear();
+        return false;
+    }
+
+    // Before MIDI is up this only queues the open, and reports success
+    currentDevice_ = devices->outputs[deviceIndex];
+    auto open = [this, name = currentDevice_] {
+        if (currentDevice_ != name) return false;  // Closed or changed while queued
+        bool opened = midiOutput_.open(name);
+        if (!opened && currentDevice_ == name) currentDevice_.clear();
+        return opened;
+    };
+    if (midiReady_) return open();
+    queuedMidi_.push_back(open);
+    return true;
 }
 
 void MidiPlayer::closeDevice() {
-    if (midiOut_ && midiOut_->isPortOpen()) {
+    if (isDeviceOpen()) {
         allNotesOff();
-        midiOut_->closePort();
+        midiOutput_.close();
     }
-    currentDevice_ = -1;
+    currentDevice_.clear();
+}
+
+int MidiPlayer::getCurrentDevice() const {
+    return indexOf(getDevices()->outputs, currentDevice_);
 }
 
 bool MidiPlayer::isDeviceOpen() const {
-    return midiOut_ && midiOut_->isPortOpen();
+    return midiOutput_.isOpen();
+}
+
+bool MidiPlayer::openInputDevice(int deviceIndex) {
+    auto devices = getDevices();
+    if (deviceIndex < 0 || deviceIndex >= static_cast<int>(devices->inputs.size())) {
+        currentInputDevice_.clear();
+        return false;
+    }
+
+    currentInputDevice_ = devices->inputs[deviceIndex];
+    auto open = [this, name = currentInputDevice_] {
+        if (currentInputDevice_ != name) return false;
+        bool opened = midiInput_.open(name);
+        if (!opened && currentInputDevice_ == name) currentInputDevice_.clear();
+        return opened;
+    };
+    if (midiReady_) return open();
+    queuedMidi_.push_back(open);
+    return true;
+}
+
+void MidiPlayer::closeInputDevice() {
+    midiInput_.close();
+    currentInputDevice_.clear();
+}
+
+int MidiPlayer::getCurrentInputDevice() const {
+    return indexOf(getDevices()->inputs, currentInputDevice_);
+}
+
+void MidiPlayer::checkDevices() {
+    // A new list means something was plugged or unplugged. An open port
+    // that vanished is closed, so it doesn't look open while dead.
+    auto devices = getDevices();
+    if (devices == knownDevices_) return;
+    knownDevices_ = devices;
+
+    if (!currentDevice_.empty() && indexOf(devices->outputs, currentDevice_) < 0) {
+        midiOutput_.close();
+        currentDevice_.clear();
+    }
+    if (!currentInputDevice_.empty() && indexOf(devices->inputs, currentInputDevice_) < 0) {
+        closeInputDevice();
+    }
+}
+
+void MidiPlayer::setRecording(bool recording) {
+    if (recording == recording_) return;
+    pollInput();  // What already arrived belongs to the old state
+
+    if (recording) {
+        recorder_.reset();
+    } else if (transport_.running) {
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            MidiOutput::Clock::now().time_since_epoch()).count();
+        recorder_.closeAll(transport_.tickAt(nowNs));
+    }
+    recording_ = recording;
+}
+
+void MidiPlayer::pollInput() {
+    inputEvents_.clear();
+    midiInput_.drain(inputEvents_);
+    for (const auto& event : inputEvents_) {
+        if (event.bytes[0] >= 0xF0) {
+            if (followClock_) clockFollower_.message(event.bytes, event.timeNs);
+        } else if (recording_) {
+            recorder_.feed(event);
+        }
+    }
+}
+
+void MidiPlayer::setSendClock(bool send) {
+    if (send == sendClock_) return;
+    if (!send && wasPlaying_ && isDeviceOpen()) {
+        unsigned char stop = MIDI_STOP;
+        midiOutput_.sendNow(&stop, 1);
+    }
+    sendClock_ = send;
+    // Picks up at the next start or seek
+}
+
+void MidiPlayer::setFollowClock(bool follow) {
+    if (follow == followClock_) return;
+    followClock_ = follow;
+    clockFollower_.reset();
 }
 
 bool MidiPlayer::loadSoundFont(const std::string& filepath) {
+    // Loads in the background and doesn't need the device, so no queueing
     return audioSynth_.loadSoundFont(filepath);
 }
 
+void MidiPlayer::syncProjectPrograms(const Project& project) {
+    // The synth keeps the samples of these instruments in memory
+    bool same = projectPrograms_.size() == project.tracks.size();
+    for (size_t i = 0; same && i < project.tracks.size(); ++i) {
+        same = projectPrograms_[i].first == project.tracks[i].channel &&
+               projectPrograms_[i].second == project.tracks[i].program;
+    }
+    if (same) return;
+
+    projectPrograms_.clear();
+    for (const auto& track : project.tracks) {
+        projectPrograms_.emplace_back(track.channel, track.program);
+    }
+    audioSynth_.setProjectPrograms(projectPrograms_);
+}
+
+void MidiPlayer::setAudioConfig(const AudioConfig& config) {
+    whenAudioReady([this, config] {
+        releaseActiveNotes();
+        audioSynth_.reconfigure(config);
+        // The frame clock may have a new rate and a gap: reschedule from the
+        // playhead, as after a seek
+        wasPlaying_ = false;
+        clockOffsetValid_ = false;
+    });
+}
+
 void MidiPlayer::update(const Project& project, uint32_t currentTick, bool isPlaying) {
+    pollStartup();
+    checkDevices();
+    syncProjectPrograms(project);
+
+    // Input is drained every frame, recording or not, so the ring never fills
+    midiInput_.setMonitor(synthActive() ? &audioSynth_ : nullptr, monitorChannel_);
+    pollInput();
+    int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        MidiOutput::Clock::now().time_since_epoch()).count();
+
+    // Playback runs on the audio clock, so it waits for the audio bring-up
+    if (!audioReady_) return;
+
+    // Frozen tracks render whether playing or not. Their audio is only for
+    // the built-in synth at the project tempo; otherwise they play live.
+    freezer_.update(project, synthActive() && audioSynth_.isInitialized() && !isDeviceOpen() &&
+                                 !(followClock_ && clockFollower_.hasTempo()));
+
     // Built-in synth is always available
     bool hasOutput = useBuiltInSynth_ || isDeviceOpen();
     if (!hasOutput) return;
     
-    // If we just started playing or playback position jumped
-    if (isPlaying && (!wasPlaying_ || currentTick < lastTick_)) {
-        // Stop all currently playing notes
-        for (const auto& pn : playingNotes_) {
-            sendNoteOff(pn.channel, pn.pitch);
-        }
-        playingNotes_.clear();
-    }
-    
     if (!isPlaying) {
         // Stop all playing notes when playback stops
         if (wasPlaying_) {
-            for (const auto& pn : playingNotes_) {
-                sendNoteOff(pn.channel, pn.pitch);
+            releaseActiveNotes();
+            if (recording_) recorder_.closeAll(transport_.tickAt(nowNs));
+            publishTransport(project, false);
+            if (clockActive()) {
+                unsigned char stop = MIDI_STOP;
+                midiOutput_.sendNow(&stop, 1);
             }
-            playingNotes_.clear();
         }
         wasPlaying_ = false;
         lastTick_ = currentTick;
         return;
     }
     
-    // Check for notes that should end
-    auto it = playingNotes_.begin();
-    while (it != playingNotes_.end()) {
-        if (currentTick >= it->endTick) {
-            sendNoteOff(it->channel, it->pitch);
-            it = playingNotes_.erase(it);
-        } else {
-            ++it;
-        }
-    }
-    
     // Check if any track is solo'd (compute once)
     bool hasSolo = false;
     for (const auto& t : project.tracks) {
         if (t.solo) { hasSolo = true; break; }
     }
     
-    // Check for new notes that should start
-    for (const auto& track : project.tracks) {
-        if (track.muted) continue;
-        if (hasSolo && !track.solo) continue;
-        
-        // Apply track volume/pan to audio synth channel
-        if (useBuiltInSynth_) {
+    // Apply track volume/pan to audio synth channels (only changes reach
+    // the audio thread, which glides to them)
+    if (synthActive()) {
+        for (const auto& track : project.tracks) {
+            if (track.muted) continue;
+            if (hasSolo && !track.solo) continue;
             audioSynth_.setChannelVolume(track.channel, track.volume);
             audioSynth_.setChannelPan(track.channel, track.pan);
         }
-        
-        for (const auto& note : track.notes) {
-            // Check if note starts in the time window since last update
-            if (note.start_tick > lastTick_ && note.start_tick <= currentTick) {
-                // Check if this note isn't already playing
-                bool alreadyPlaying = false;
-                for (const auto& pn : playingNotes_) {
-                    if (pn.channel == track.channel && pn.pitch == note.pitch) {
-                        alreadyPlaying = true;
-                        break;
-                    }
-                }
-                
-                if (!alreadyPlaying) {
-                    sendNoteOn(track.channel, note.pitch, note.velocity);
-                    playingNotes_.push_back({track.channel, note.pitch, note.endTick()});
-                }
-            }
+    }
+    
+    // The playhead wrapping at the loop end is expected: the loop's next
+    // pass is already scheduled. Anything else that moves it backwards, or
+    // forwards further than a stalled frame would (ruler click, or a stall
+    // long enough that the schedule ran dry), is a seek.
+    uint32_t maxStep = project.secondsToTicks(MAX_UPDATE_GAP_SECONDS);
+    bool looping = loopActive(project);
+    bool wrapped = looping && currentTick < lastTick_ && lastTick_ <= project.loop_end &&
+                   currentTick >= project.loop_start &&
+                   (project.loop_end - lastTick_) + (currentTick - project.loop_start) <= maxStep;
+    bool jumped = (currentTick < lastTick_ && !wrapped) || (currentTick > lastTick_ && currentTick - lastTick_ > maxStep);
+    
+    if (!wasPlaying_ || jumped) {
+        if (wasPlaying_ && recording_) recorder_.closeAll(transport_.tickAt(nowNs));
+        releaseActiveNotes();
+        startPlayback(project, currentTick, hasSolo);
+        if (clockActive()) sendClockPosition(project, currentTick, static_cast<double>(anchorPos_), wasPlaying_);
+    } else {
+        // Tempo change: re-anchor at the cursor so what's already scheduled
+        // stays put and the rest follows the new tempo
+        double fpt = framesPerTick(project);
+        if (fpt != framesPerTick_) {
+            anchorFrame_ = frameAt(cursorPos_);
+            anchorPos_ = cursorPos_;
+            framesPerTick_ = fpt;
         }
+        if (followClock_) followPhase(currentTick, nowNs);
     }
     
+    updateClockOffset();
+    scheduleAhead(project, hasSolo);
+    publishTransport(project, true);
+    recorder_.setLoopEnd(looping ? project.loop_end : 0);
+    
     wasPlaying_ = isPlaying;
     lastTick_ = currentTick;
 }
 
+double MidiPlayer::framesPerTick(const Project& project) const {
+    // A followed clock sets the tempo
+    double bpm = followClock_ && clockFollower_.hasTempo() ? clockFollower_.tempoBpm() : project.tempo_bpm;
+    double ticksPerSecond = bpm / 60.0 * project.ticks_per_quarter;
+    return ticksPerSecond > 0.0 ? audioSynth_.getSampleRate() / ticksPerSecond : 1.0;
+}
+
+uint64_t MidiPlayer::frameAt(double pos) const {
+    double offset = (pos - static_cast<double>(anchorPos_)) * framesPerTick_;
+    return static_cast<uint64_t>(std::max(0.0, static_cast<double>(anchorFrame_) + offset + 0.5));
+}
+
+void MidiPlayer::startPlayback(const Project& project, uint32_t tick, bool hasSolo) {
+    anchorFrame_ = audioSynth_.currentFrame();
+    anchorPos_ = 1;
+    cursorPos_ = 1;
+    cursorTick_ = tick;
+    framesPerTick_ = framesPerTick(project);
+    chaseNotes(project, tick, hasSolo);
+}
+
+void MidiPlayer::scheduleAhead(const Project& project, bool hasSolo) {
+    uint64_t horizonFrame = audioSynth_.currentFrame() +
+                            static_cast<uint64_t>(LOOKAHEAD_SECONDS * audioSynth_.getSampleRate());
+    if (horizonFrame <= anchorFrame_) return;
+    uint64_t horizonPos = anchorPos_ + static_cast<uint64_t>((horizonFrame - anchorFrame_) / framesPerTick_);
+    bool looping = loopActive(project);
+
+    while (cursorPos_ < horizonPos) {
+        if (looping && cursorTick_ >= project.loop_end) {
+            cursorTick_ = project.loop_start;
+            if (clockActive()) sendClockPosition(project, cursorTick_, static_cast<double>(cursorPos_), true);
+            continue;
+        }
+
+        uint64_t segEnd = std::min<uint64_t>(cursorTick_ + (horizonPos - cursorPos_), UINT32_MAX);
+        if (looping) segEnd = std::min<uint64_t>(segEnd, project.loop_end);
+        if (segEnd <= cursorTick_) break;
+        const uint32_t segStart = cursorTick_;
+        const uint32_t segStop = static_cast<uint32_t>(segEnd);
+
+        // Notes starting in [segStart, segStop), all tracks, in start order
+        upcoming_.clear();
+        for (size_t t = 0; t < project.tracks.size(); ++t) {
+            const auto& track = project.tracks[t];
+            if (track.muted) continue;
+            if (hasSolo && !track.solo) continue;
+            if (freezer_.isStreaming(t)) continue;
+            const uint8_t channel = static_cast<uint8_t>(track.channel & 0x0F);
+
+            auto it = std::lower_bound(track.notes.begin(), track.notes.end(), segStart,
+                                       [](const Note& note, uint32_t tick) { return note.start_tick < tick; });
+            for (; it != track.notes.end() && it->start_tick < segStop; ++it) {
+                upcoming_.push_back({it->start_tick, channel, *it});
+            }
+
+            // Clip instances: only the part inside this window is expanded
+            if (!track.clipInstances.empty()) {
+                clipNotes_.clear();
+                project.expandClips(track, segStart, segStop, clipNotes_);
+                for (const auto& note : clipNotes_) {
+                    upcoming_.push_back({note.start_tick, channel, note});
+                }
+            }
+        }
+        if (clockActive()) scheduleClock(project, segStart, segStop);
+
+        // Frozen tracks play this span of their audio
+        if (freezer_.hasStreaming()) {
+            uint64_t songFrame = freezer_.songFrame(segStart);
+            audioSynth_.scheduleFrozen(songFrame, static_cast<uint32_t>(freezer_.songFrame(segStop) - songFrame),
+                                       frameAt(cursorPos_));
+        }
+
+        std::stable_sort(upcoming_.begin(), upcoming_.end(),
+                         [](const UpcomingNote& a, const UpcomingNote& b) { return a.start < b.start; });
+
+        for (const auto& up : upcoming_) {
+            uint64_t pos = cursorPos_ + (up.start - segStart);
+            // Free slots whose note ends by now, so a repeated pitch retriggers
+            scheduleOffsUntil(pos);
+
+            // Inside a loop, notes are cut at the loop end
+            uint32_t end = up.note.endTick();
+            if (looping && up.start < project.loop_end) end = std::min(end, project.loop_end);
+            scheduleNote(up.channel, up.note, pos, end - up.start);
+        }
+
+        cursorPos_ += segStop - segStart;
+        cursorTick_ = segStop;
+    }
+
+    scheduleOffsUntil(cursorPos_);
+}
+
+void MidiPlayer::scheduleNote(uint8_t channel, const Note& note, uint64_t onPos, uint32_t length) {
+    // Skip notes that are already playing
+    uint8_t pitch = static_cast<uint8_t>(note.pitch & 0x7F);
+    uint64_t& off = activeOff_[channel][pitch];
+    if (off != 0) return;
+
+    // Positions start at 1 and lengths are at least 1, so 0 stays "idle"
+    off = onPos + std::max<uint32_t>(1, length);
+    sendAt(true, channel, pitch, static_cast<uint8_t>(note.velocity & 0x7F), onPos);
+    pendingOffs_.push_back({off, channel, pitch});
+    std::push_heap(pendingOffs_.begin(), pendingOffs_.end(), std::greater<PendingOff>());
+}
+
+void MidiPlayer::scheduleOffsUntil(uint64_t pos) {
+    auto later = std::greater<PendingOff>();
+    while (!pendingOffs_.empty() && pendingOffs_.front().pos <= pos) {
+        std::pop_heap(pendingOffs_.begin(), pendingOffs_.end(), later);
+        PendingOff off = pendingOffs_.back();
+        pendingOffs_.pop_back();
+        activeOff_[off.channel][off.pitch] = 0;
+        sendAt(false, off.channel, off.pitch, 0, off.pos);
+    }
+}
+
+void MidiPlayer::sendAt(bool on, uint8_t channel, uint8_t pitch, uint8_t velocity, uint64_t pos) {
+    uint64_t frame = frameAt(pos);
+
+    if (useBuiltInSynth_) {
+        if (on) audioSynth_.scheduleNoteOn(channel, pitch, velocity, frame);
+        else audioSynth_.scheduleNoteOff(channel, pitch, frame);
+    }
+
+    if (isDeviceOpen()) {
+        unsigned char msg[3] = {static_cast<unsigned char>((on ? 0x90 : 0x80) | channel), pitch, velocity};
+        midiOutput_.send(msg, 3, timeAtFrame(frame));
+    }
+}
+
+void MidiPlayer::updateClockOffset() {
+    uint64_t frame;
+    MidiOutput::Clock::time_point time;
+    audioSynth_.getClockReference(frame, time);
+    if (time.time_since_epoch().count() == 0) {
+        // No buffer rendered yet: assume the next one plays now
+        frame = audioSynth_.currentFrame();
+        time = MidiOutput::Clock::now();
+    }
+
+    // Frame 0's time by this reference. Callbacks wake up with some
+    // jitter, so follow it through a slow filter; a jump of more than 50 ms
+    // (device restart, long stall) is taken as is.
+    double offset = std::chrono::duration<double>(time.time_since_epoch()).count() -
+                    static_cast<double>(frame) / audioSynth_.getSampleRate();
+    if (!clockOffsetValid_ || std::abs(offset - clockOffset_) > 0.05) {
+        clockOffset_ = offset;
+        clockOffsetValid_ = true;
+    } else {
+        clockOffset_ += (offset - clockOffset_) * 0.05;
+    }
+}
+
+void MidiPlayer::publishTransport(const Project& project, bool running) {
+    TransportClock clock;
+    clock.running = running && framesPerTick_ > 0.0;
+    if (clock.running) {
+        // The cursor is what's heard at its frame's wall-clock time
+        clock.anchorNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            timeAtFrame(frameAt(cursorPos_)).time_since_epoch()).count();
+        clock.anchorTick = cursorTick_;
+        clock.ticksPerNs = audioSynth_.getSampleRate() / framesPerTick_ / 1e9;
+        clock.looping = loopActive(project);
+        clock.loopStart = project.loop_start;
+        clock.loopEnd = project.loop_end;
+    }
+    transport_ = clock;
+    midiInput_.setTransport(clock);
+}
+
+bool MidiPlayer::loopActive(const Project& project) const {
+    // A followed master does its own looping (with song position messages)
+    return project.loop_enabled && project.loop_end > project.loop_start && !followClock_;
+}
+
+void MidiPlayer::followPhase(uint32_t currentTick, int64_t nowNs) {
+    if (!transport_.running) return;
+    // Pull what's heard towards the master's position a little each update,
+    // so filtered clock jitter never turns into audible jumps
+    double error = static_cast<double>(currentTick) - static_cast<double>(transport_.tickAt(nowNs));
+    double frame = static_cast<double>(frameAt(cursorPos_)) - error * PHASE_GAIN * framesPerTick_;
+    anchorFrame_ = static_cast<uint64_t>(std::max(0.0, frame));
+    anchorPos_ = cursorPos_;
+}
+
+void MidiPlayer::sendClockPosition(const Project& project, uint32_t tick, double pos, bool restart) {
+    // Song position is in sixteenths, so resume at the first one at or
+    // after `tick`; that's where the first pulse after continue goes
+    double sixteenth = project.ticks_per_quarter / 4.0;
+    int spp = std::min(16383, static_cast<int>(std::ceil(tick / sixteenth - 1e-9)));
+    clockResumeTick_ = spp * sixteenth;
+
+    if (restart) {
+        unsigned char stop = MIDI_STOP;
+        sendSystemAt(&stop, 1, pos);
+    }
+    if (tick == 0) {
+        unsigned char start = MIDI_START;
+        sendSystemAt(&start, 1, pos);
+    } else {
+        unsigned char position[3] = {MIDI_SONG_POSITION, static_cast<unsigned char>(spp & 0x7F),
+                                     static_cast<unsigned char>((spp >> 7) & 0x7F)};
+        unsigned char resume = MIDI_CONTINUE;
+        sendSystemAt(position, 3, pos);
+        sendSystemAt(&resume, 1, pos);
+    }
+}
+
+void MidiPlayer::scheduleClock(const Project& project, uint32_t segStart, uint32_t segStop) {
+    // Pulses sit on the song's 24 PPQN grid, in [segStart, segStop)
+    double pulseTicks = static_cast<double>(project.ticks_per_quarter) / CLOCKS_PER_QUARTER;
+    double from = std::max<double>(segStart, clockResumeTick_);
+    unsigned char pulse = MIDI_CLOCK;
+    for (double k = std::ceil(from / pulseTicks - 1e-9);; k += 1.0) {
+        double tick = k * pulseTicks;
+        if (tick >= segStop) break;
+        sendSystemAt(&pulse, 1, static_cast<double>(cursorPos_) + (tick - segStart));
+    }
+}
+
+void MidiPlayer::sendSystemAt(const unsigned char* bytes, size_t size, double pos) {
+    midiOutput_.send(bytes, size, timeAtFrame(frameAt(pos)));
+}
+
+MidiOutput::Clock::time_point MidiPlayer::timeAtFrame(uint64_t frame) const {
+    double seconds = clockOffset_ + static_cast<double>(frame) / audioSynth_.getSampleRate();
+    return MidiOutput::Clock::time_point(
+        std::chrono::duration_cast<MidiOutput::Clock::duration>(std::chrono::duration<double>(seconds)));
+}
+
+void MidiPlayer::rebuildChaseIndex(const Project& project) {
+    chaseRevision_ = project.revision;
+    chaseInterval_ = static_cast<uint32_t>(std::max(1, project.ticksPerBar() * CHASE_BARS));
+    chase_.assign(project.tracks.size(), ChaseTrack());
+
+    const uint32_t interval = chaseInterval_;
+    for (size_t t = 0; t < project.tracks.size(); ++t) {
+        const auto& notes = project.tracks[t].notes;
+        auto& chase = chase_[t];
+
+        uint32_t lastEnd = 0;
+        for (const auto& note : notes) lastEnd = std::max(lastEnd, note.endTick());
+        size_t checkpoints = lastEnd / interval + 1;
+
+        // Notes are in start order, so first-note indices come from one sweep
+        chase.firstNote.resize(checkpoints);
+        size_t n = 0;
+        for (size_t k = 0; k < checkpoints; ++k) {
+            uint64_t tick = static_cast<uint64_t>(k) * interval;
+            while (n < notes.size() && notes[n].start_tick < tick) ++n;
+            chase.firstNote[k] = static_cast<uint32_t>(n);
+        }
+
+        // A note is in checkpoint k's list when start < k * interval < end.
+        // Count per checkpoint, then fill (counting sort into one array).
+        auto span = [&](const Note& note, size_t& first, size_t& last) {
+            first = note.start_tick / interval + 1;
+            last = note.endTick() == 0 ? 0 : (note.endTick() - 1) / interval;
+        };
+        chase.activeBegin.assign(checkpoints + 1, 0);
+        for (const auto& note : notes) {
+            size_t first, last;
+            span(note, first, last);
+            for (size_t k = first; k <= last && k < checkpoints; ++k) ++chase.activeBegin[k + 1];
+        }
+        for (size_t k = 0; k < checkpoints; ++k) chase.activeBegin[k + 1] += chase.activeBegin[k];
+
+        chase.active.resize(chase.activeBegin.back());
+        std::vector<uint32_t> fill(chase.activeBegin.begin(), chase.activeBegin.end() - 1);
+        for (size_t i = 0; i < notes.size(); ++i) {
+            size_t first, last;
+            span(notes[i], first, last);
+            for (size_t k = first; k <= last && k < checkpoints; ++k) {
+                chase.active[fill[k]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+}
+
+void MidiPlayer::chaseNotes(const Project& project, uint32_t tick, bool hasSolo) {
+    // Edits only leave the index stale; dragging a note during playback
+    // would otherwise pay for a full rebuild every frame
+    uint32_t interval = static_cast<uint32_t>(std::max(1, project.ticksPerBar() * CHASE_BARS));
+    if (project.revision != chaseRevision_ || interval != chaseInterval_ ||
+        chase_.size() != project.tracks.size()) {
+        rebuildChaseIndex(project);
+    }
+    size_t k = tick / chaseInterval_;
+
+    for (size_t t = 0; t < project.tracks.size() && t < chase_.size(); ++t) {
+        const auto& track = project.tracks[t];
+        if (track.muted) continue;
+        if (hasSolo && !track.solo) continue;
+        if (freezer_.isStreaming(t)) continue;  // Its audio has them
+
+        const uint8_t channel = static_cast<uint8_t>(track.channel & 0x0F);
+        const auto& notes = track.notes;
+        const auto& index = chase_[t];
+
+        // Chased notes start now and keep their original end (cut at the
+        // loop end when inside a loop)
+        bool looping = project.loop_enabled && project.loop_end > project.loop_start && tick < project.loop_end;
+        auto chaseNote = [&](const Note& note) {
+            uint32_t end = note.endTick();
+            if (looping) end = std::min(end, project.loop_end);
+            if (note.start_tick <= tick && end > tick) scheduleNote(channel, note, cursorPos_, end - tick);
+        };
+
+        // Past the checkpoints nothing on the track is sounding
+        if (k < index.firstNote.size()) {
+            // Still sounding from before the checkpoint...
+            for (uint32_t a = index.activeBegin[k]; a < index.activeBegin[k + 1]; ++a) {
+                chaseNote(notes[index.active[a]]);
+            }
+            // ...or started between the checkpoint and `tick`
+            for (size_t i = index.firstNote[k]; i < notes.size() && notes[i].start_tick <= tick; ++i) {
+                chaseNote(notes[i]);
+            }
+        }
+
+        if (!track.clipInstances.empty()) {
+            clipNotes_.clear();
+            project.expandClips(track, tick, tick + 1, clipNotes_, true);
+            for (const auto& note : clipNotes_) chaseNote(note);
+        }
+    }
+}
+
 void MidiPlayer::panic() {
+    midiOutput_.cancelPending();
     allNotesOff();
-    playingNotes_.clear();
+    for (const auto& off : pendingOffs_) {
+        activeOff_[off.channel][off.pitch] = 0;
+    }
+    pendingOffs_.clear();
+}
+
+void MidiPlayer::releaseActiveNotes() {
+    // Scheduled note-ons are dropped, scheduled note-offs go out now
+    if (audioReady_) audioSynth_.cancelScheduled();
+    midiOutput_.cancelPending();
+
+    for (const auto& off : pendingOffs_) {
+        activeOff_[off.channel][off.pitch] = 0;
+        sendNoteOff(off.channel, off.pitch);
+    }
+    pendingOffs_.clear();
 }
 
 void MidiPlayer::previewNoteOn(int channel, int pitch, int velocity) {
@@ -172,70 +686,60 @@ void MidiPlayer::previewNoteOff(int channel, int pitch) {
 }
 
 void MidiPlayer::sendProgramChange(int channel, int program) {
-    // Send to built-in synth
-    if (useBuiltInSynth_) {
-        audioSynth_.programChange(channel, program);
-    }
-    
-    // Send to external MIDI device
-    if (isDeviceOpen()) {
-        std::vector<unsigned char> message;
-        message.push_back(0xC0 | (channel & 0x0F)); // Program Change
-        message.push_back(program & 0x7F);
-        
-        try {
-            midiOut_->sendMessage(&message);
-        } catch (RtMidiError& error) {
-            error.printMessage();
+    // Programs set during startup are kept for when the outputs are up
+    whenAudioReady([this, channel, program] {
+        // Send to built-in synth
+        if (useBuiltInSynth_) {
+            audioSynth_.programChange(channel, program);
         }
-    }
+    });
+
+    whenMidiReady([this, channel, program] {
+        // Send to external MIDI device
+        if (isDeviceOpen()) {
+            unsigned char message[2] = {
+                static_cast<unsigned char>(0xC0 | (channel & 0x0F)), // Program Change
+                static_cast<unsigned char>(program & 0x7F)};
+            midiOutput_.sendNow(message, 2);
+        }
+    });
 }
 
 void MidiPlayer::sendNoteOn(int channel, int pitch, int velocity) {
     // Send to built-in synth
-    if (useBuiltInSynth_) {
+    if (synthActive()) {
         audioSynth_.noteOn(channel, pitch, velocity);
     }
     
     // Send to external MIDI device
     if (isDeviceOpen()) {
-        std::vector<unsigned char> message;
-        message.push_back(0x90 | (channel & 0x0F)); // Note On
-        message.push_back(pitch & 0x7F);
-        message.push_back(velocity & 0x7F);
-        
-        try {
-            midiOut_->sendMessage(&message);
-        } catch (RtMidiError& error) {
-            error.printMessage();
-        }
+        unsigned char message[3] = {
+            static_cast<unsigned char>(0x90 | (channel & 0x0F)), // Note On
+            static_cast<unsigned char>(pitch & 0x7F),
+            static_cast<unsigned char>(velocity & 0x7F)};
+        midiOutput_.sendNow(message, 3);
     }
 }
 
 void MidiPlayer::sendNoteOff(int channel, int pitch) {
     // Send to built-in synth
-    if (useBuiltInSynth_) {
+    if (synthActive()) {
         audioSynth_.noteOff(channel, pitch);
     }
     
     // Send to external MIDI device
     if (isDeviceOpen()) {
-        std::vector<unsigned char> message;
-        message.push_back(0x80 | (channel & 0x0F)); // Note Off
-        message.push_back(pitch & 0x7F);
-        message.push_back(0); // Velocity 0
-        
-        try {
-            midiOut_->sendMessage(&message);
-        } catch (RtMidiError& error) {
-            error.printMessage();
-        }
+        unsigned char message[3] = {
+            static_cast<unsigned char>(0x80 | (channel & 0x0F)), // Note Off
+            static_cast<unsigned char>(pitch & 0x7F),
+            0}; // Velocity 0
+        midiOutput_.sendNow(message, 3);
     }
 }
 
 void MidiPlayer::allNotesOff() {
     // Send to built-in synth
-    if (useBuiltInSynth_) {
+    if (synthActive()) {
         audioSynth_.allNotesOff();
     }
     
@@ -243,16 +747,11 @@ void MidiPlayer::allNotesOff() {
     if (isDeviceOpen()) {
         // Send All Notes Off (CC 123) on all channels
         for (int ch = 0; ch < 16; ++ch) {
-            std::vector<unsigned char> message;
-            message.push_back(0xB0 | ch); // Control Change
-            message.push_back(123);       // All Notes Off
-            message.push_back(0);
-            
-            try {
-                midiOut_->sendMessage(&message);
-            } catch (RtMidiError& error) {
-                error.printMessage();
-            }
+            unsigned char message[3] = {
+                static_cast<unsigned char>(0xB0 | ch), // Control Change
+                123,                                   // All Notes Off
+                0};
+            midiOutput_.sendNow(message, 3);
         }
     }
 }
@@ -2,7 +2,13 @@
 
 #include "types.h"
 #include "audio_synth.h"
-#include <RtMidi.h>
+#include "midi_output.h"
+#include "midi_input.h"
+#include "midi_clock.h"
+#include "device_monitor.h"
+#include "track_freezer.h"
+#include <functional>
+#include <future>
 #include <memory>
 #include <vector>
 #include <string>
@@ -14,19 +20,59 @@ public:
     MidiPlayer();
     ~MidiPlayer();
 
+    // Bring up audio and MIDI on background threads. Call once the first
+    // frame is on screen; until they're up, calls that need them (opening
+    // devices, program changes) are queued and playback is silent.
+    void start();
+    bool isReady() const { return audioReady_ && midiReady_; }
+
     // Built-in audio synth (always available)
     AudioSynth& getAudioSynth() { return audioSynth_; }
     bool isAudioEnabled() const { return useBuiltInSynth_; }
     void setAudioEnabled(bool enabled) { useBuiltInSynth_ = enabled; }
+    // Restart the audio device with a new setup (queued until audio is up).
+    // Playback carries on from the playhead.
+    void setAudioConfig(const AudioConfig& config);
+
+    // Port lists, kept current in the background; cheap to call every frame.
+    // Device indices below index into this list.
+    std::shared_ptr<const DeviceList> getDevices() const { return deviceMonitor_.devices(); }
+    void refreshDevices() { deviceMonitor_.refresh(); }
 
     // External MIDI device management
-    std::vector<std::string> getOutputDevices() const;
     bool openDevice(int deviceIndex);
     void closeDevice();
     bool isDeviceOpen() const;
-    int getCurrentDevice() const { return currentDevice_; }
+    int getCurrentDevice() const;
+
+    // MIDI input. Incoming notes sound on the built-in synth right away
+    // (on the monitor channel, -1 = as received) and, while recording, are
+    // stamped with the song position heard when they arrived.
+    bool openInputDevice(int deviceIndex);
+    void closeInputDevice();
+    bool isInputDeviceOpen() const { return midiInput_.isOpen(); }
+    int getCurrentInputDevice() const;
+    void setMonitorChannel(int channel) { monitorChannel_ = channel; }
+
+    // Recording only captures while playing. Turning it off (or stopping
+    // playback) ends notes still held at the current position.
+    bool isRecording() const { return recording_; }
+    void setRecording(bool recording);
+    void takeRecordedNotes(std::vector<Note>& out) { recorder_.take(out); }
+
+    // MIDI clock. As master, 24 PPQN clock, start/stop/continue and song
+    // position go to the external device, timed like the notes (loop wraps
+    // send stop, song position, continue). As slave, clock from the MIDI
+    // input drives the transport: the caller takes play state and position
+    // from getClockFollower(), and playback follows its tempo and phase.
+    bool isSendingClock() const { return sendClock_; }
+    void setSendClock(bool send);
+    bool isFollowingClock() const { return followClock_; }
+    void setFollowClock(bool follow);
+    const ClockFollower& getClockFollower() const { return clockFollower_; }
 
-    // Load SoundFont for better audio quality
+    // Load SoundFont for better audio quality, in the background (see
+    // AudioSynth::loadSoundFont)
     bool loadSoundFont(const std::string& filepath);
 
     // Playback
@@ -40,26 +86,138 @@ public:
     // Send program change
     void sendProgramChange(int channel, int program);
 
+    // Frozen tracks (Track::frozen) play from pre-rendered audio on the
+    // built-in synth; state and progress per track
+    const TrackFreezer& getTrackFreezer() const { return freezer_; }
+
+    // Timing instrumentation, one recorder per output
+    TimingRecorder& getSynthTiming() { return audioSynth_.getTimingRecorder(); }
+    TimingRecorder& getMidiOutTiming() { return midiOutput_.getTimingRecorder(); }
+
 private:
     void sendNoteOn(int channel, int pitch, int velocity);
     void sendNoteOff(int channel, int pitch);
     void allNotesOff();
+    void releaseActiveNotes();  // Note-off for everything started or scheduled
+
+    // Look-ahead scheduling. Playback runs on the audio clock: `anchorFrame_`
+    // is the frame at which position `anchorPos_` plays, and positions count
+    // ticks of play time, so they keep increasing across loop wraps while
+    // `cursorTick_` jumps back to the loop start. Each update schedules
+    // everything up to LOOKAHEAD_SECONDS ahead with exact frame times.
+    void startPlayback(const Project& project, uint32_t tick, bool hasSolo);
+    void scheduleAhead(const Project& project, bool hasSolo);
+    void scheduleNote(uint8_t channel, const Note& note, uint64_t onPos, uint32_t length);
+    void scheduleOffsUntil(uint64_t pos);
+    void sendAt(bool on, uint8_t channel, uint8_t pitch, uint8_t velocity, uint64_t pos);
+    uint64_t frameAt(double pos) const;
+    void updateClockOffset();
+    MidiOutput::Clock::time_point timeAtFrame(uint64_t frame) const;
+    double framesPerTick(const Project& project) const;
+    void publishTransport(const Project& project, bool running);
+    bool loopActive(const Project& project) const;
+    void checkDevices();
+    void pollStartup();
+    bool synthActive() const { return useBuiltInSynth_ && audioReady_; }
+    void whenAudioReady(std::function<void()> call);
+    void whenMidiReady(std::function<void()> call);
+    void followPhase(uint32_t currentTick, int64_t nowNs);
+    bool clockActive() const { return sendClock_ && isDeviceOpen(); }
+    void sendClockPosition(const Project& project, uint32_t tick, double pos, bool restart);
+    void scheduleClock(const Project& project, uint32_t segStart, uint32_t segStop);
+    void sendSystemAt(const unsigned char* bytes, size_t size, double pos);
+    void pollInput();
+    void syncProjectPrograms(const Project& project);
+
+    // Note chasing: after a seek, start the notes already sounding there
+    void rebuildChaseIndex(const Project& project);
+    void chaseNotes(const Project& project, uint32_t tick, bool hasSolo);
+
+    // Background bring-up (see start())
+    bool started_ = false;
+    std::future<bool> audioInit_;
+    std::future<bool> midiInit_;
+    bool audioReady_ = false;
+    bool midiReady_ = false;
+    std::vector<std::function<void()>> queuedAudio_;
+    std::vector<std::function<void()>> queuedMidi_;
+
+    DeviceMonitor deviceMonitor_;
+    std::shared_ptr<const DeviceList> knownDevices_;  // Last list checkDevices() saw
 
     // Built-in audio synthesizer
     AudioSynth audioSynth_;
     bool useBuiltInSynth_ = true;
+    std::vector<std::pair<int, int>> projectPrograms_;  // As last given to the synth
+    TrackFreezer freezer_{audioSynth_};  // Declared after audioSynth_: its renders use it
+
+    // External MIDI output, sent from its own thread at the audio frame's
+    // wall-clock time
+    MidiOutput midiOutput_;
+    std::string currentDevice_;  // Port name, empty = none
+    double clockOffset_ = 0.0;  // Seconds: steady_clock time of audio frame 0
+    bool clockOffsetValid_ = false;
+
+    // MIDI input; declared after audioSynth_ so its callback (which may be
+    // monitoring into the synth) stops first
+    MidiInput midiInput_;
+    std::string currentInputDevice_;
+    int monitorChannel_ = -1;
+    TransportClock transport_;  // As last published to midiInput_
+    NoteRecorder recorder_;
+    bool recording_ = false;
+    std::vector<InputEvent> inputEvents_;  // Scratch for pollInput
+
+    // MIDI clock
+    bool sendClock_ = false;
+    bool followClock_ = false;
+    ClockFollower clockFollower_;
+    double clockResumeTick_ = 0.0;  // First pulse after a start/continue
+    static constexpr double PHASE_GAIN = 0.1;  // Share of the slave's phase error corrected per update
+
+    // Scheduled notes: note-off position per channel/pitch (0 = idle) for an
+    // O(1) "already playing" check, plus a min-heap of note-offs not yet
+    // handed to the outputs. A slot is only filled when idle, so each active
+    // note has exactly one heap entry.
+    struct PendingOff {
+        uint64_t pos;
+        uint8_t channel;
+        uint8_t pitch;
+        bool operator>(const PendingOff& other) const { return pos > other.pos; }
+    };
+    uint64_t activeOff_[16][128] = {};
+    std::vector<PendingOff> pendingOffs_;
+    std::vector<Note> clipNotes_;  // Scratch for expanded clip instances
+
+    struct UpcomingNote {
+        uint32_t start;
+        uint8_t channel;
+        Note note;
+    };
+    std::vector<UpcomingNote> upcoming_;  // Scratch for scheduleAhead
 
-    // External MIDI output
-    std::unique_ptr<RtMidiOut> midiOut_;
-    int currentDevice_ = -1;
+    static constexpr double LOOKAHEAD_SECONDS = 0.1;
+    uint64_t anchorFrame_ = 0;
+    uint64_t anchorPos_ = 1;
+    uint64_t cursorPos_ = 1;   // Everything before this is scheduled
+    uint32_t cursorTick_ = 0;  // Song tick at cursorPos_
+    double framesPerTick_ = 0.0;
 
-    // Track which notes are currently playing
-    struct PlayingNote {
-        int channel;
-        int pitch;
-        uint32_t endTick;
+    // Checkpoints every CHASE_BARS bars, per track: the notes sounding across
+    // the checkpoint, and the first note starting at or after it. Chasing
+    // tick T reads the checkpoint before T and replays at most one interval
+    // of notes, whatever the song length. Rebuilt by the first chase after
+    // Project::revision or the interval changes.
+    static constexpr int CHASE_BARS = 4;
+    static constexpr double MAX_UPDATE_GAP_SECONDS = 0.25;  // Larger forward steps count as a seek
+    struct ChaseTrack {
+        std::vector<uint32_t> firstNote;    // Per checkpoint
+        std::vector<uint32_t> activeBegin;  // Per checkpoint, +1 end marker; ranges into `active`
+        std::vector<uint32_t> active;       // Note indices
     };
-    std::vector<PlayingNote> playingNotes_;
+    std::vector<ChaseTrack> chase_;
+    uint64_t chaseRevision_ = 0;
+    uint32_t chaseInterval_ = 0;
 
     uint32_t lastTick_ = 0;
     bool wasPlaying_ = false;
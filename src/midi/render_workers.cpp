@@ -0,0 +1,151 @@
+#include "render_workers.h"
+#include "alloc_trap.h"
+#include "rt_thread.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
+
+namespace midi {
+
+// How long a worker stays awake after a part. Callbacks render in short
+// blocks, so the next part is usually due well within this.
+static constexpr auto SPIN_TIME = std::chrono::microseconds(200);
+
+// Posting from the audio thread mustn't take a lock, so no
+// mutex + condition variable here
+class Semaphore {
+public:
+#ifdef _WIN32
+    Semaphore() { handle_ = CreateSemaphoreA(nullptr, 0, LONG_MAX, nullptr); }
+    ~Semaphore() { CloseHandle(handle_); }
+    void post() { ReleaseSemaphore(handle_, 1, nullptr); }
+    void wait() { WaitForSingleObject(handle_, INFINITE); }
+private:
+    HANDLE handle_;
+#elif defined(__APPLE__)
+    Semaphore() { sem_ = dispatch_semaphore_create(0); }
+    ~Semaphore() { dispatch_release(sem_); }
+    void post() { dispatch_semaphore_signal(sem_); }
+    void wait() { dispatch_semaphore_wait(sem_, DISPATCH_TIME_FOREVER); }
+private:
+    dispatch_semaphore_t sem_;
+#else
+    Semaphore() { sem_init(&sem_, 0, 0); }
+    ~Semaphore() { sem_destroy(&sem_); }
+    void post() { sem_post(&sem_); }
+    void wait() {
+        while (sem_wait(&sem_) != 0 && errno == EINTR) {}
+    }
+private:
+    sem_t sem_;
+#endif
+};
+
+struct RenderWorkers::Worker {
+    std::thread thread;
+    Semaphore wake;
+    std::atomic<uint64_t> run{0};  // Last run handed to this worker
+    std::atomic<bool> sleeping{false};
+};
+
+RenderWorkers::RenderWorkers() = default;
+
+RenderWorkers::~RenderWorkers() {
+    stop();
+}
+
+void RenderWorkers::start(int count) {
+    stop();
+    stopping_.store(false);
+    for (int i = 0; i < count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < count; ++i) {
+        workers_[i]->thread = std::thread(&RenderWorkers::workerLoop, this, std::ref(*workers_[i]), i + 1);
+    }
+}
+
+void RenderWorkers::stop() {
+    if (workers_.empty()) return;
+    stopping_.store(true);
+    for (auto& worker : workers_) {
+        worker->run.store(++runs_);
+        worker->wake.post();
+    }
+    for (auto& worker : workers_) worker->thread.join();
+    workers_.clear();
+}
+
+void RenderWorkers::run(Task task, void* context, int parts) {
+    parts = std::max(1, std::min(parts, count() + 1));
+    task_ = task;
+    context_ = context;
+    remaining_.store(parts - 1, std::memory_order_relaxed);
+
+    // The stores above are seen by any worker that sees its new run. A
+    // worker that went to sleep gets posted; see workerLoop for the race.
+    uint64_t run = ++runs_;
+    for (int part = 1; part < parts; ++part) {
+        Worker& worker = *workers_[part - 1];
+        worker.run.store(run, std::memory_order_seq_cst);
+        if (worker.sleeping.exchange(false, std::memory_order_seq_cst)) worker.wake.post();
+    }
+
+    task(context, 0);
+    while (remaining_.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+    }
+}
+
+void RenderWorkers::workerLoop(Worker& worker, int part) {
+    // Same as the audio thread: a worker running late holds the whole
+    // callback up
+    raiseThreadPriority();
+    uint64_t seen = 0;
+
+    while (true) {
+        // Spin for a while, then sleep
+        uint64_t run = worker.run.load(std::memory_order_acquire);
+        auto spinUntil = std::chrono::steady_clock::now() + SPIN_TIME;
+        while (run == seen && std::chrono::steady_clock::now() < spinUntil) {
+            std::this_thread::yield();
+            run = worker.run.load(std::memory_order_acquire);
+        }
+        if (run == seen) {
+            // Announce the sleep, then look again: run() either sees the
+            // flag and posts, or stored its run before we looked. If it
+            // took the flag back it has posted (or is about to), and that
+            // post has to be used up here.
+            worker.sleeping.store(true, std::memory_order_seq_cst);
+            run = worker.run.load(std::memory_order_seq_cst);
+            if (run == seen) {
+                worker.wake.wait();
+            } else if (!worker.sleeping.exchange(false, std::memory_order_seq_cst)) {
+                worker.wake.wait();
+            }
+            run = worker.run.load(std::memory_order_acquire);
+        }
+        seen = run;
+        if (stopping_.load()) return;
+
+        {
+            AUDIO_NO_ALLOC_SCOPE();
+            task_(context_, part);
+        }
+        remaining_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+} // namespace midi
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace midi {
+
+// A few threads the audio callback splits work across and waits for,
+// with no locks or allocation: run() hands each worker its part, does
+// part 0 itself and spins until the rest are done. A worker spins a
+// little after each part, so the next run in the same callback finds it
+// awake, then sleeps on a semaphore until it's needed again.
+//
+// Only one thread calls run(). start() and stop() aren't thread-safe and
+// must not overlap a run().
+class RenderWorkers {
+public:
+    using Task = void (*)(void* context, int part);
+
+    RenderWorkers();
+    ~RenderWorkers();
+    RenderWorkers(const RenderWorkers&) = delete;
+    RenderWorkers& operator=(const RenderWorkers&) = delete;
+
+    // Start `count` worker threads (stopping any running first)
+    void start(int count);
+    void stop();
+    int count() const { return static_cast<int>(workers_.size()); }
+
+    // task(context, 0) on the calling thread and task(context, 1..parts-1)
+    // on the workers; returns once all of them are done
+    void run(Task task, void* context, int parts);
+
+private:
+    struct Worker;
+    void workerLoop(Worker& worker, int part);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    Task task_ = nullptr;
+    void* context_ = nullptr;
+    uint64_t runs_ = 0;
+    std::atomic<int> remaining_{0};
+    std::atomic<bool> stopping_{false};
+};
+
+} // namespace midi
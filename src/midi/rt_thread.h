@@ -0,0 +1,11 @@
+#pragma once
+
+namespace midi {
+
+// Ask for real-time scheduling for the calling thread: time-critical
+// priority on Windows, SCHED_FIFO a little above the minimum elsewhere.
+// Without the privilege for it (no rtprio on Linux, mobile) the thread
+// just stays as it was.
+void raiseThreadPriority();
+
+} // namespace midi
@@ -0,0 +1,159 @@
+#include "sample_pager.h"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace midi {
+
+static constexpr size_t BLOCK_BYTES = SamplePager::BLOCK_SAMPLES * sizeof(float);
+
+SamplePager::~SamplePager() {
+    close();
+}
+
+bool SamplePager::open(const std::string& path, uint64_t offset, uint32_t count) {
+    close();
+
+    // One spare block past the end: tsf reads a sample beyond the last one
+    size_t blocks = count / BLOCK_SAMPLES + 1;
+    poolSize_ = blocks * BLOCK_BYTES;
+    size_t bytes = static_cast<size_t>(count) * sizeof(int16_t);
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    uint64_t start = offset - offset % info.dwAllocationGranularity;
+    mappingSize_ = static_cast<size_t>(offset - start) + bytes;
+
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) file_ = nullptr;
+    if (file_) fileMapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (fileMapping_) {
+        mapping_ = MapViewOfFile(fileMapping_, FILE_MAP_READ, static_cast<DWORD>(start >> 32),
+                                 static_cast<DWORD>(start), mappingSize_);
+    }
+    // Committed up front so a stray read is silence rather than a fault;
+    // pages still only take memory once written
+    if (mapping_) pool_ = static_cast<float*>(VirtualAlloc(nullptr, poolSize_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t start = offset - offset % static_cast<uint64_t>(pageSize);
+    mappingSize_ = static_cast<size_t>(offset - start) + bytes;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        mapping_ = mmap(nullptr, mappingSize_, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(start));
+        if (mapping_ == MAP_FAILED) mapping_ = nullptr;
+        ::close(fd);  // The mapping keeps the file
+    }
+    // Address space only; untouched pages read as zero and cost nothing
+    if (mapping_) {
+        void* pool = mmap(nullptr, poolSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        pool_ = pool == MAP_FAILED ? nullptr : static_cast<float*>(pool);
+    }
+#endif
+
+    if (!mapping_ || !pool_) {
+        fprintf(stderr, "Audio error: Failed to map SoundFont samples: %s\n", path.c_str());
+        close();
+        return false;
+    }
+
+    source_ = reinterpret_cast<const int16_t*>(static_cast<const char*>(mapping_) + (offset - start));
+    count_ = count;
+    lastUsed_.assign(blocks, 0);
+    pass_ = 1;
+    residentBytes_ = 0;
+    return true;
+}
+
+void SamplePager::close() {
+#ifdef _WIN32
+    if (pool_) VirtualFree(pool_, 0, MEM_RELEASE);
+    if (mapping_) UnmapViewOfFile(mapping_);
+    if (fileMapping_) CloseHandle(fileMapping_);
+    if (file_) CloseHandle(file_);
+    fileMapping_ = nullptr;
+    file_ = nullptr;
+#else
+    if (pool_) munmap(pool_, poolSize_);
+    if (mapping_) munmap(mapping_, mappingSize_);
+#endif
+    pool_ = nullptr;
+    mapping_ = nullptr;
+    source_ = nullptr;
+    count_ = 0;
+    lastUsed_.clear();
+    residentBytes_ = 0;
+}
+
+void SamplePager::pageIn(uint32_t first, uint32_t end) {
+    end = std::min(end, count_);
+    if (first >= end) return;
+
+    for (uint32_t block = first / BLOCK_SAMPLES; block <= (end - 1) / BLOCK_SAMPLES; ++block) {
+        if (lastUsed_[block] == 0) convertBlock(block);
+        lastUsed_[block] = pass_;
+    }
+}
+
+void SamplePager::evictTo(size_t bytes) {
+    if (residentBytes() <= bytes) return;
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t block = 0; block < lastUsed_.size(); ++block) {
+        if (lastUsed_[block] != 0 && lastUsed_[block] != pass_) candidates.push_back(block);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [this](uint32_t a, uint32_t b) { return lastUsed_[a] < lastUsed_[b]; });
+
+    for (uint32_t block : candidates) {
+        if (residentBytes() <= bytes) break;
+        releaseBlock(block);
+    }
+}
+
+void SamplePager::convertBlock(uint32_t block) {
+    uint32_t first = block * BLOCK_SAMPLES;
+    uint32_t end = std::min(first + BLOCK_SAMPLES, count_);
+    float* out = pool_ + first;
+    for (uint32_t i = first; i < end; ++i) {
+        *out++ = static_cast<float>(source_[i] / 32767.0);
+    }
+    residentBytes_ += BLOCK_BYTES;
+
+#ifndef _WIN32
+    // The file pages aren't needed again until this block is dropped; let
+    // them go from our resident set rather than wait for memory pressure
+    uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t from = (reinterpret_cast<uintptr_t>(source_ + first) + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t to = reinterpret_cast<uintptr_t>(source_ + end) & ~(pageSize - 1);
+    if (to > from) madvise(reinterpret_cast<void*>(from), to - from, MADV_DONTNEED);
+#endif
+}
+
+void SamplePager::releaseBlock(uint32_t block) {
+    void* start = pool_ + static_cast<size_t>(block) * BLOCK_SAMPLES;
+#ifdef _WIN32
+    // Decommit then commit again: back to zero pages
+    VirtualFree(start, BLOCK_BYTES, MEM_DECOMMIT);
+    VirtualAlloc(start, BLOCK_BYTES, MEM_COMMIT, PAGE_READWRITE);
+#else
+    madvise(start, BLOCK_BYTES, MADV_DONTNEED);
+#endif
+    lastUsed_[block] = 0;
+    residentBytes_ -= BLOCK_BYTES;
+}
+
+} // namespace midi
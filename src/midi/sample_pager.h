@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace midi {
+
+// The 16-bit sample chunk of a SoundFont, memory-mapped and converted to
+// float a block at a time on demand. samples() is laid out like the pool
+// tsf converts up front, but only blocks that were paged in take memory;
+// the rest reads as silence. Blocks are dropped least recently used first.
+//
+// Not thread-safe. Converting a block only writes that block, so the audio
+// thread can keep reading the others meanwhile.
+class SamplePager {
+public:
+    static constexpr uint32_t BLOCK_SAMPLES = 1 << 16;  // 256 KB of floats
+
+    SamplePager() = default;
+    ~SamplePager();
+    SamplePager(const SamplePager&) = delete;
+    SamplePager& operator=(const SamplePager&) = delete;
+
+    // Map `count` samples starting `offset` bytes into the file
+    bool open(const std::string& path, uint64_t offset, uint32_t count);
+    void close();
+
+    float* samples() const { return pool_; }
+    uint32_t sampleCount() const { return count_; }
+
+    // Convert samples [first, end) where they aren't in yet, and mark the
+    // blocks as used in this pass
+    void pageIn(uint32_t first, uint32_t end);
+    // Start a new pass; evictTo() keeps whatever gets paged in after this
+    void beginPass() { ++pass_; }
+    // Drop blocks not used this pass, oldest first, until at most `bytes`
+    // are resident
+    void evictTo(size_t bytes);
+
+    size_t residentBytes() const { return residentBytes_; }
+    size_t totalBytes() const { return static_cast<size_t>(count_) * sizeof(float); }
+
+private:
+    void convertBlock(uint32_t block);
+    void releaseBlock(uint32_t block);
+
+    uint32_t count_ = 0;
+    const int16_t* source_ = nullptr;  // The sample chunk inside mapping_
+    void* mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    float* pool_ = nullptr;
+    size_t poolSize_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* fileMapping_ = nullptr;
+#endif
+
+    std::vector<uint64_t> lastUsed_;  // Pass each block was last used in, 0 = not resident
+    uint64_t pass_ = 1;
+    size_t residentBytes_ = 0;
+};
+
+} // namespace midi
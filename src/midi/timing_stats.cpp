@@ -0,0 +1,89 @@
+#include "timing_stats.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace midi {
+
+static double latenessMs(const TimingSample& sample) {
+    return static_cast<double>(sample.actual - sample.intended) / 1e6;
+}
+
+void TimingStats::update(TimingRecorder& recorder) {
+    fresh_.clear();
+    recorder.drain(fresh_);
+    if (fresh_.empty()) return;
+
+    // history_ is a ring once it reaches HISTORY
+    for (const auto& sample : fresh_) {
+        if (history_.size() < HISTORY) {
+            history_.push_back(sample);
+        } else {
+            history_[historyStart_] = sample;
+            historyStart_ = (historyStart_ + 1) % HISTORY;
+        }
+    }
+    recompute();
+}
+
+void TimingStats::clear() {
+    history_.clear();
+    historyStart_ = 0;
+    p50_ = p99_ = max_ = 0.0;
+    histogram_.clear();
+    histMin_ = histMax_ = 0.0;
+}
+
+void TimingStats::recompute() {
+    size_t n = std::min(history_.size(), WINDOW);
+    if (n == 0) return;
+
+    // Newest n samples, oldest first
+    scratch_.clear();
+    size_t size = history_.size();
+    size_t newest = (historyStart_ + size - 1) % size;
+    for (size_t i = 0; i < n; ++i) {
+        scratch_.push_back(latenessMs(history_[(newest + size - (n - 1 - i)) % size]));
+    }
+
+    auto [lo, hi] = std::minmax_element(scratch_.begin(), scratch_.end());
+    histMin_ = *lo;
+    histMax_ = *hi;
+    max_ = *hi;
+
+    histogram_.assign(HISTOGRAM_BINS, 0.0f);
+    double range = std::max(histMax_ - histMin_, 1e-3);
+    for (double v : scratch_) {
+        int bin = static_cast<int>((v - histMin_) / range * HISTOGRAM_BINS);
+        ++histogram_[std::clamp(bin, 0, HISTOGRAM_BINS - 1)];
+    }
+
+    auto at = [&](double q) {
+        size_t k = std::min(n - 1, static_cast<size_t>(q * (n - 1) + 0.5));
+        std::nth_element(scratch_.begin(), scratch_.begin() + k, scratch_.end());
+        return scratch_[k];
+    };
+    p50_ = at(0.50);
+    p99_ = at(0.99);
+}
+
+bool TimingStats::exportCsv(const std::string& filepath) const {
+    FILE* file = std::fopen(filepath.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "Timing error: Cannot write %s\n", filepath.c_str());
+        return false;
+    }
+
+    std::fprintf(file, "intended_ns,actual_ns,lateness_ms\n");
+    size_t size = history_.size();
+    for (size_t i = 0; i < size; ++i) {
+        const auto& sample = history_[(historyStart_ + i) % size];
+        std::fprintf(file, "%lld,%lld,%.4f\n", static_cast<long long>(sample.intended),
+                     static_cast<long long>(sample.actual), latenessMs(sample));
+    }
+
+    bool ok = std::fclose(file) == 0;
+    if (!ok) fprintf(stderr, "Timing error: Failed writing %s\n", filepath.c_str());
+    return ok;
+}
+
+} // namespace midi
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace midi {
+
+// When an event was meant to happen and when it actually did, both in
+// steady_clock nanoseconds
+struct TimingSample {
+    int64_t intended;
+    int64_t actual;
+};
+
+// Lock-free ring for timing samples: one producer (the thread that sends or
+// renders the events), one consumer (the UI). Samples are dropped when the
+// ring is full rather than ever blocking the producer.
+class TimingRecorder {
+public:
+    void record(int64_t intended, int64_t actual) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= CAPACITY) return;
+        samples_[tail & (CAPACITY - 1)] = {intended, actual};
+        tail_.store(tail + 1, std::memory_order_release);
+    }
+
+    // Append everything recorded since the last drain
+    void drain(std::vector<TimingSample>& out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            out.push_back(samples_[head & (CAPACITY - 1)]);
+        }
+        head_.store(head, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t CAPACITY = 8192;  // Power of two
+    std::array<TimingSample, CAPACITY> samples_;
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+};
+
+// UI-side summary of one output's recorder: lateness percentiles over the
+// most recent samples, a histogram, and CSV export of the kept history.
+class TimingStats {
+public:
+    static constexpr size_t WINDOW = 2048;      // Samples behind the live numbers
+    static constexpr size_t HISTORY = 100000;   // Samples kept for export
+    static constexpr int HISTOGRAM_BINS = 40;
+
+    // Pull new samples; call every frame so the recorder doesn't fill up
+    void update(TimingRecorder& recorder);
+    void clear();
+
+    size_t count() const { return history_.size(); }
+    // Lateness in milliseconds (negative = early)
+    double p50() const { return p50_; }
+    double p99() const { return p99_; }
+    double max() const { return max_; }
+    double jitter() const { return p99_ - p50_; }
+
+    // Lateness histogram over [histogramMin(), histogramMax()] ms
+    const std::vector<float>& histogram() const { return histogram_; }
+    double histogramMin() const { return histMin_; }
+    double histogramMax() const { return histMax_; }
+
+    bool exportCsv(const std::string& filepath) const;
+
+private:
+    void recompute();
+
+    std::vector<TimingSample> history_;
+    size_t historyStart_ = 0;  // Oldest sample once history_ has wrapped
+    std::vector<TimingSample> fresh_;
+    std::vector<double> scratch_;
+
+    double p50_ = 0.0;
+    double p99_ = 0.0;
+    double max_ = 0.0;
+    std::vector<float> histogram_;
+    double histMin_ = 0.0;
+    double histMax_ = 0.0;
+};
+
+} // namespace midi
@@ -0,0 +1,323 @@
+#include "track_freezer.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace midi {
+
+static constexpr uint64_t CHUNK = AudioSynth::FREEZE_CHUNK_FRAMES;
+
+TrackFreezer::TrackFreezer(AudioSynth& synth) : synth_(synth) {
+    worker_ = std::thread(&TrackFreezer::workerLoop, this);
+}
+
+TrackFreezer::~TrackFreezer() {
+    cancel_ = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_one();
+    worker_.join();
+}
+
+void TrackFreezer::update(const Project& project, bool enabled) {
+    enabled_ = enabled;
+    hasSoundFont_ = synth_.hasSoundFont();
+
+    // The audio sits on a timeline of frames at the project tempo; a new
+    // tempo, rate or SoundFont makes all of it stale
+    int rate = synth_.getSampleRate();
+    double ticksPerSecond = project.tempo_bpm / 60.0 * project.ticks_per_quarter;
+    double fpt = ticksPerSecond > 0.0 ? rate / ticksPerSecond : 1.0;
+    uint32_t fontSerial = synth_.getSoundFontSerial();
+    if (fpt != framesPerTick_ || rate != sampleRate_ || fontSerial != fontSerial_) {
+        framesPerTick_ = fpt;
+        sampleRate_ = rate;
+        fontSerial_ = fontSerial;
+        for (auto& entry : entries_) {
+            if (entry.frozen) reset(entry);
+        }
+    }
+
+    if (entries_.size() != project.tracks.size()) {
+        entries_.resize(project.tracks.size());
+        dirtyMix_ = true;
+    }
+    bool notesChanged = project.revision != revision_;
+    revision_ = project.revision;
+
+    for (size_t i = 0; i < project.tracks.size(); ++i) {
+        const Track& track = project.tracks[i];
+        Entry& entry = entries_[i];
+        if (!track.frozen) {
+            if (entry.frozen) {
+                if (busy_ && busyEntry_ == i) cancel_ = true;
+                uint32_t serial = entry.serial;
+                entry = Entry();
+                entry.serial = serial + 1;
+                dirtyMix_ = true;
+            }
+            continue;
+        }
+        if (!entry.frozen || entry.channel != track.channel || entry.program != track.program) {
+            entry.frozen = true;
+            entry.channel = track.channel;
+            entry.program = track.program;
+            expandNotes(project, track, entry.notes);
+            reset(entry);
+        } else if (notesChanged) {
+            expandNotes(project, track, scratch_);
+            markChanges(entry, scratch_);
+            entry.notes.swap(scratch_);
+        }
+    }
+
+    // Pick up a finished render, start the next
+    std::unique_ptr<Job> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done = std::move(done_);
+    }
+    if (done) {
+        busy_ = false;
+        applyJob(*done);
+    }
+    if (!busy_ && hasSoundFont_) launchJob();
+
+    publish(project);
+}
+
+TrackFreezer::State TrackFreezer::getState(size_t index) const {
+    if (index >= entries_.size() || !entries_[index].frozen) return State::Off;
+    if (entries_[index].complete) return State::Frozen;
+    return hasSoundFont_ ? State::Rendering : State::NoSoundFont;
+}
+
+float TrackFreezer::getProgress(size_t index) const {
+    if (index >= entries_.size()) return 0.0f;
+    const Entry& entry = entries_[index];
+    if (entry.complete) return 1.0f;
+    if (entry.length == 0) return 0.0f;
+
+    uint64_t left = 0;
+    for (const auto& range : entry.dirty) left += range.second - range.first;
+    if (busy_ && busyEntry_ == index) left += busyFrames_ - std::min(busyFrames_, jobDone_.load());
+    return 1.0f - static_cast<float>(std::min(left, entry.length)) / entry.length;
+}
+
+void TrackFreezer::reset(Entry& entry) {
+    if (busy_ && busyEntry_ < entries_.size() && &entries_[busyEntry_] == &entry) cancel_ = true;
+    ++entry.serial;
+    entry.chunks.clear();
+    entry.length = lengthOf(entry.notes);
+    entry.chunks.resize((entry.length + CHUNK - 1) / CHUNK);
+    entry.dirty.clear();
+    if (entry.length > 0) entry.dirty.emplace_back(0, entry.length);
+    entry.complete = entry.dirty.empty();
+    dirtyMix_ = true;
+}
+
+void TrackFreezer::expandNotes(const Project& project, const Track& track, std::vector<Note>& out) const {
+    out = track.notes;
+    if (!track.clipInstances.empty()) {
+        project.expandClips(track, 0, UINT32_MAX, out);
+        std::sort(out.begin(), out.end(), noteOrder);
+    }
+}
+
+uint64_t TrackFreezer::lengthOf(const std::vector<Note>& notes) const {
+    uint32_t end = 0;
+    for (const auto& note : notes) end = std::max(end, note.endTick());
+    if (notes.empty()) return 0;
+    return songFrame(end) + static_cast<uint64_t>(TAIL_SECONDS * sampleRate_);
+}
+
+void TrackFreezer::markChanges(Entry& entry, const std::vector<Note>& notes) {
+    // Both are in noteOrder: walk them together, and every note that's
+    // only in one of them dirties the frames it sounds in
+    const uint64_t tail = static_cast<uint64_t>(TAIL_SECONDS * sampleRate_);
+    auto touch = [&](const Note& note) {
+        addDirty(entry, songFrame(note.start_tick), songFrame(note.endTick()) + tail);
+    };
+    auto same = [](const Note& a, const Note& b) {
+        return a.start_tick == b.start_tick && a.pitch == b.pitch && a.duration == b.duration &&
+               a.velocity == b.velocity;
+    };
+
+    size_t i = 0, j = 0;
+    const auto& old = entry.notes;
+    while (i < old.size() || j < notes.size()) {
+        if (j == notes.size() || (i < old.size() && noteOrder(old[i], notes[j]))) {
+            touch(old[i++]);
+        } else if (i == old.size() || noteOrder(notes[j], old[i])) {
+            touch(notes[j++]);
+        } else {
+            if (!same(old[i], notes[j])) {
+                touch(old[i]);
+                touch(notes[j]);
+            }
+            ++i;
+            ++j;
+        }
+    }
+
+    // A shorter track keeps no audio past its new end
+    entry.length = lengthOf(notes);
+    entry.chunks.resize((entry.length + CHUNK - 1) / CHUNK);
+    for (auto& range : entry.dirty) range.second = std::min(range.second, entry.length);
+    entry.dirty.erase(std::remove_if(entry.dirty.begin(), entry.dirty.end(),
+                                     [](const std::pair<uint64_t, uint64_t>& range) { return range.first >= range.second; }),
+                      entry.dirty.end());
+    dirtyMix_ = true;
+}
+
+void TrackFreezer::addDirty(Entry& entry, uint64_t from, uint64_t to) {
+    if (from >= to) return;
+    auto& dirty = entry.dirty;
+    auto it = std::lower_bound(dirty.begin(), dirty.end(), std::make_pair(from, from));
+    // Merge with the range before when they touch, and with any after
+    if (it != dirty.begin() && std::prev(it)->second >= from) --it;
+    auto last = it;
+    while (last != dirty.end() && last->first <= to) {
+        from = std::min(from, last->first);
+        to = std::max(to, last->second);
+        ++last;
+    }
+    it = dirty.erase(it, last);
+    dirty.insert(it, std::make_pair(from, to));
+}
+
+bool TrackFreezer::launchJob() {
+    for (size_t n = 0; n < entries_.size(); ++n) {
+        size_t index = (nextEntry_ + n) % entries_.size();
+        Entry& entry = entries_[index];
+        if (!entry.frozen || entry.dirty.empty()) continue;
+
+        // The first dirty range, at most MAX_JOB_CHUNKS chunks of it
+        auto job = std::make_unique<Job>();
+        job->entry = index;
+        job->serial = entry.serial;
+        job->channel = entry.channel;
+        job->program = entry.program;
+        job->sampleRate = sampleRate_;
+        job->tailFrames = static_cast<uint64_t>(TAIL_SECONDS * sampleRate_);
+        job->from = entry.dirty.front().first;
+        job->to = std::min(entry.dirty.front().second, (job->from / CHUNK + MAX_JOB_CHUNKS) * CHUNK);
+        if (job->to < entry.dirty.front().second) entry.dirty.front().first = job->to;
+        else entry.dirty.erase(entry.dirty.begin());
+
+        // Notes sounding anywhere in the range
+        for (const auto& note : entry.notes) {
+            uint64_t on = songFrame(note.start_tick);
+            if (on >= job->to) break;
+            uint64_t off = songFrame(note.endTick());
+            if (off + job->tailFrames <= job->from) continue;
+            job->notes.push_back({on, off, static_cast<uint8_t>(note.pitch & 0x7F),
+                                  static_cast<uint8_t>(note.velocity & 0x7F)});
+        }
+        job->firstChunk = job->from / CHUNK;
+        size_t lastChunk = (job->to - 1) / CHUNK;
+        for (size_t c = job->firstChunk; c <= lastChunk; ++c) {
+            job->chunks.push_back(c < entry.chunks.size() ? entry.chunks[c] : nullptr);
+        }
+
+        busy_ = true;
+        busyEntry_ = index;
+        busyFrames_ = job->to - job->from;
+        jobDone_ = 0;
+        cancel_ = false;
+        nextEntry_ = index + 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = std::move(job);
+        }
+        wake_.notify_one();
+        return true;
+    }
+    return false;
+}
+
+void TrackFreezer::applyJob(Job& job) {
+    if (job.entry >= entries_.size()) return;
+    Entry& entry = entries_[job.entry];
+    if (!entry.frozen || entry.serial != job.serial) return;  // Reset meanwhile; it's all dirty again
+
+    if (!job.ok) {
+        addDirty(entry, job.from, std::min(job.to, entry.length));
+        return;
+    }
+    for (size_t i = 0; i < job.chunks.size(); ++i) {
+        size_t c = job.firstChunk + i;
+        if (c < entry.chunks.size()) entry.chunks[c] = std::move(job.chunks[i]);
+    }
+    if (entry.dirty.empty()) entry.complete = true;
+    dirtyMix_ = true;
+}
+
+void TrackFreezer::publish(const Project& project) {
+    bool hasSolo = false;
+    for (const auto& track : project.tracks) hasSolo = hasSolo || track.solo;
+
+    std::vector<std::pair<size_t, uint32_t>> tracks;
+    for (size_t i = 0; i < project.tracks.size(); ++i) {
+        const Track& track = project.tracks[i];
+        if (track.muted || (hasSolo && !track.solo) || !isStreaming(i)) continue;
+        tracks.emplace_back(i, entries_[i].serial);
+    }
+    if (!dirtyMix_ && tracks == published_) return;
+    dirtyMix_ = false;
+    published_ = tracks;
+
+    std::vector<AudioSynth::FrozenTrack> mix;
+    for (const auto& published : published_) {
+        const Entry& entry = entries_[published.first];
+        mix.push_back({entry.channel, entry.chunks});
+    }
+    synth_.setFrozenTracks(mix);
+}
+
+void TrackFreezer::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        wake_.wait(lock, [this] { return !running_ || job_; });
+        if (!running_) break;
+        std::unique_ptr<Job> job = std::move(job_);
+        lock.unlock();
+        render(*job);
+        lock.lock();
+        done_ = std::move(job);
+    }
+}
+
+void TrackFreezer::render(Job& job) {
+    // A chunk at a time: fresh copies of the chunks touched, the rest of
+    // each kept from the old one. Each piece starts the notes sounding into
+    // it from their beginning, so pieces line up sample for sample.
+    std::vector<AudioSynth::OfflineNote> notes;
+    for (size_t i = 0; i < job.chunks.size(); ++i) {
+        uint64_t chunkStart = (job.firstChunk + i) * CHUNK;
+        uint64_t from = std::max(job.from, chunkStart);
+        uint64_t to = std::min(job.to, chunkStart + CHUNK);
+
+        auto audio = job.chunks[i] ? std::make_shared<std::vector<float>>(*job.chunks[i])
+                                   : std::make_shared<std::vector<float>>(CHUNK * 2, 0.0f);
+        notes.clear();
+        for (const auto& note : job.notes) {
+            if (note.on < to && note.off + job.tailFrames > from) notes.push_back(note);
+        }
+        float* out = audio->data() + (from - chunkStart) * 2;
+        if (notes.empty()) {
+            std::fill(out, out + (to - from) * 2, 0.0f);
+        } else if (!synth_.renderOffline(job.channel, job.program, job.sampleRate, notes, from, to, out, &cancel_)) {
+            return;  // No SoundFont, or cancelled
+        }
+
+        // Silence takes no memory
+        bool silent = std::all_of(audio->begin(), audio->end(), [](float s) { return s == 0.0f; });
+        job.chunks[i] = silent ? nullptr : std::move(audio);
+        jobDone_ += to - from;
+    }
+    job.ok = true;
+}
+
+} // namespace midi
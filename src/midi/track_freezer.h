@@ -0,0 +1,121 @@
+#pragma once
+
+#include "types.h"
+#include "audio_synth.h"
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace midi {
+
+// Track freeze: a frozen track is rendered offline, on a worker thread
+// and faster than realtime, into audio the synth mixes from the song
+// position instead of playing the track's notes live. Note edits only
+// re-render the frames they touch (plus the release tail); a tempo,
+// sample rate or SoundFont change re-renders the lot (played live until
+// done); after an edit the old audio plays until the new lands. Needs a
+// SoundFont, the simple synth is cheap enough live.
+//
+// Tracks are followed by index; a track moving just looks like an edit.
+class TrackFreezer {
+public:
+    static constexpr double TAIL_SECONDS = 2.0;  // Rendered past each note for its release
+    static constexpr size_t MAX_JOB_CHUNKS = 16;  // Per render job, so edits don't wait long
+
+    enum class State { Off, Rendering, Frozen, NoSoundFont };
+
+    explicit TrackFreezer(AudioSynth& synth);
+    ~TrackFreezer();
+    TrackFreezer(const TrackFreezer&) = delete;
+    TrackFreezer& operator=(const TrackFreezer&) = delete;
+
+    // UI thread, every frame: follow the project's frozen tracks, start
+    // renders and hand finished audio to the synth. With `enabled` off
+    // nothing plays frozen (notes going to an external device, a followed
+    // clock's tempo), but rendering carries on.
+    void update(const Project& project, bool enabled);
+
+    // Track `index` plays from frozen audio, so its notes are skipped
+    bool isStreaming(size_t index) const {
+        return enabled_ && index < entries_.size() && entries_[index].frozen && entries_[index].complete;
+    }
+    // Some audible track does
+    bool hasStreaming() const { return !published_.empty(); }
+    // Frame of `tick` on the frozen audio's timeline
+    uint64_t songFrame(uint32_t tick) const { return static_cast<uint64_t>(std::llround(tick * framesPerTick_)); }
+
+    State getState(size_t index) const;
+    float getProgress(size_t index) const;  // Of the first render, 0-1
+
+private:
+    struct Entry {
+        bool frozen = false;
+        int channel = -1;
+        int program = -1;
+        std::vector<Note> notes;  // Expanded clips included, noteOrder; what chunks + dirty stand for
+        std::vector<AudioSynth::FreezeChunk> chunks;
+        std::vector<std::pair<uint64_t, uint64_t>> dirty;  // Frame ranges to (re-)render, sorted, disjoint
+        uint64_t length = 0;      // Frames: last note end plus the tail
+        uint32_t serial = 0;      // Bumped by reset(), so a render in flight is dropped
+        bool complete = false;    // Rendered through once; plays frozen from then on
+    };
+
+    struct Job {
+        size_t entry;
+        uint32_t serial;
+        int channel, program, sampleRate;
+        uint64_t from, to;
+        uint64_t tailFrames;
+        std::vector<AudioSynth::OfflineNote> notes;
+        size_t firstChunk;
+        std::vector<AudioSynth::FreezeChunk> chunks;  // [firstChunk, ...): the entry's, then the result
+        bool ok = false;
+    };
+
+    void reset(Entry& entry);
+    void expandNotes(const Project& project, const Track& track, std::vector<Note>& out) const;
+    void markChanges(Entry& entry, const std::vector<Note>& notes);
+    void addDirty(Entry& entry, uint64_t from, uint64_t to);
+    uint64_t lengthOf(const std::vector<Note>& notes) const;
+    bool launchJob();
+    void applyJob(Job& job);
+    void publish(const Project& project);
+    void workerLoop();
+    void render(Job& job);
+
+    AudioSynth& synth_;
+    std::vector<Entry> entries_;
+    double framesPerTick_ = 0.0;
+    int sampleRate_ = 0;
+    uint32_t fontSerial_ = 0;
+    uint64_t revision_ = 0;
+    bool enabled_ = false;
+    bool hasSoundFont_ = false;
+    size_t nextEntry_ = 0;  // Round robin between tracks needing renders
+    std::vector<Note> scratch_;
+
+    // What the synth was last given: (track, entry serial), and whether
+    // anything in the entries changed since
+    std::vector<std::pair<size_t, uint32_t>> published_;
+    bool dirtyMix_ = false;
+
+    // Worker: one job at a time, handed over under mutex_
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = true;
+    std::unique_ptr<Job> job_;   // To render
+    std::unique_ptr<Job> done_;  // Rendered
+    bool busy_ = false;          // UI thread: a job is out
+    size_t busyEntry_ = 0;
+    uint64_t busyFrames_ = 0;
+    std::atomic<uint64_t> jobDone_{0};  // Frames of the job rendered so far
+    std::atomic<bool> cancel_{false};
+};
+
+} // namespace midi
@@ -1,12 +1,122 @@
 #include "types.h"
 #include <algorithm>
+#include <atomic>
 
 namespace midi {
 
+// Below this std::sort wins over the radix passes
+static constexpr size_t RADIX_SORT_THRESHOLD = 1024;
+
+// Stable LSD radix sort: one pass on pitch, then up to four byte passes on
+// start_tick. Passes where every note has the same byte are skipped, so
+// short songs usually need only two or three.
+static void radixSortNotes(std::vector<Note>& notes) {
+    std::vector<Note> buffer(notes.size());
+    auto pass = [&](auto keyOf) {
+        size_t counts[256] = {};
+        for (const auto& n : notes) counts[keyOf(n)]++;
+        for (size_t c : counts) {
+            if (c == notes.size()) return;  // all in one bucket, nothing to do
+        }
+        size_t offset = 0;
+        for (size_t& c : counts) {
+            size_t count = c;
+            c = offset;
+            offset += count;
+        }
+        for (const auto& n : notes) buffer[counts[keyOf(n)]++] = n;
+        notes.swap(buffer);
+    };
+
+    pass([](const Note& n) { return static_cast<uint8_t>(n.pitch); });
+    for (int shift = 0; shift < 32; shift += 8) {
+        pass([shift](const Note& n) { return static_cast<uint8_t>(n.start_tick >> shift); });
+    }
+}
+
 void Track::sortNotes() {
-    std::sort(notes.begin(), notes.end(), [](const Note& a, const Note& b) {
-        return a.start_tick < b.start_tick;
-    });
+    if (std::is_sorted(notes.begin(), notes.end(), noteOrder)) return;
+
+    if (notes.size() >= RADIX_SORT_THRESHOLD) {
+        radixSortNotes(notes);
+    } else {
+        std::sort(notes.begin(), notes.end(), noteOrder);
+    }
+}
+
+void Track::insertSorted(std::vector<Note> batch) {
+    if (batch.empty()) return;
+    std::sort(batch.begin(), batch.end(), noteOrder);
+
+    size_t oldSize = notes.size();
+    notes.insert(notes.end(), batch.begin(), batch.end());
+
+    // Existing notes before the first new one don't move
+    auto middle = notes.begin() + oldSize;
+    auto first = std::upper_bound(notes.begin(), middle, batch.front(), noteOrder);
+    std::inplace_merge(first, middle, notes.end(), noteOrder);
+}
+
+size_t Track::removeNotes(const std::vector<Note>& batch) {
+    std::vector<size_t> found;
+    found.reserve(batch.size());
+    std::vector<bool> taken(notes.size(), false);
+
+    for (const auto& target : batch) {
+        // Binary search on (start, pitch), then match the rest within the run
+        auto range = std::equal_range(notes.begin(), notes.end(), target, noteOrder);
+        for (auto it = range.first; it != range.second; ++it) {
+            size_t idx = static_cast<size_t>(it - notes.begin());
+            if (!taken[idx] && it->duration == target.duration && it->velocity == target.velocity) {
+                taken[idx] = true;
+                found.push_back(idx);
+                break;
+            }
+        }
+    }
+    if (found.empty()) return 0;
+
+    std::sort(found.begin(), found.end());
+    // Compact from the first removed note onwards
+    size_t write = found.front();
+    size_t next = 0;
+    for (size_t read = found.front(); read < notes.size(); ++read) {
+        if (next < found.size() && found[next] == read) {
+            ++next;
+            continue;
+        }
+        notes[write++] = notes[read];
+    }
+    notes.resize(write);
+    return found.size();
+}
+
+void Track::resortIndices(const std::vector<size_t>& indices) {
+    std::vector<size_t> sorted;
+    sorted.reserve(indices.size());
+    for (size_t idx : indices) {
+        if (idx < notes.size()) sorted.push_back(idx);
+    }
+    if (sorted.empty()) return;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    // Pull the modified notes out (everything else is still in order),
+    // then merge them back in
+    std::vector<Note> moved;
+    moved.reserve(sorted.size());
+    size_t write = sorted.front();
+    size_t next = 0;
+    for (size_t read = sorted.front(); read < notes.size(); ++read) {
+        if (next < sorted.size() && sorted[next] == read) {
+            moved.push_back(notes[read]);
+            ++next;
+            continue;
+        }
+        notes[write++] = notes[read];
+    }
+    notes.resize(write);
+    insertSorted(std::move(moved));
 }
 
 void Track::clearSelection() {
@@ -79,12 +189,21 @@ uint32_t Project::getTotalTicks() const {
             uint32_t end = note.endTick();
             if (end > maxTick) maxTick = end;
         }
+        for (const auto& inst : track.clipInstances) {
+            if (inst.clip < 0 || inst.clip >= static_cast<int>(clips.size())) continue;
+            maxTick = std::max(maxTick, inst.offset + clips[inst.clip].length);
+        }
     }
     // At minimum, return 4 bars worth of ticks
     uint32_t minTicks = static_cast<uint32_t>(ticksPerBar()) * 4;
     return std::max(maxTick, minTicks);
 }
 
+uint64_t Project::nextRevision() {
+    static std::atomic<uint64_t> counter{0};
+    return ++counter;
+}
+
 void Project::clearAllSelections() {
     for (auto& track : tracks) {
         track.clearSelection();
@@ -113,4 +232,41 @@ int pitchToRow(int pitch, int lowest_pitch) {
     return 127 - pitch;
 }
 
+void Project::expandClips(const Track& track, uint32_t startTick, uint32_t endTick,
+                          std::vector<Note>& out, bool overlapping) const {
+    for (const auto& inst : track.clipInstances) {
+        if (inst.offset >= endTick) break;  // sorted by offset
+        if (inst.clip < 0 || inst.clip >= static_cast<int>(clips.size())) continue;
+
+        const Clip& clip = clips[inst.clip];
+        uint64_t clipEnd = static_cast<uint64_t>(inst.offset) + clip.length;
+        if (clipEnd <= startTick) continue;
+
+        // Window relative to the clip start
+        uint32_t relStart = startTick > inst.offset ? startTick - inst.offset : 0;
+        uint32_t relEnd = static_cast<uint32_t>(std::min<uint64_t>(endTick - inst.offset, clip.length));
+
+        const auto& notes = clip.content.notes;
+        auto it = notes.begin();
+        if (!overlapping) {
+            Note key;
+            key.start_tick = relStart;
+            key.pitch = -1;
+            it = std::lower_bound(notes.begin(), notes.end(), key, noteOrder);
+        }
+        for (; it != notes.end() && it->start_tick < relEnd; ++it) {
+            if (overlapping && it->endTick() <= relStart) continue;
+
+            Note note = *it;
+            note.start_tick += inst.offset;
+            note.pitch = std::clamp(note.pitch + inst.transpose, 0, 127);
+            if (inst.velocityScale != 1.0f) {
+                note.velocity = std::clamp(static_cast<int>(note.velocity * inst.velocityScale + 0.5f), 1, 127);
+            }
+            note.selected = false;
+            out.push_back(note);
+        }
+    }
+}
+
 } // namespace midi
@@ -16,6 +16,20 @@ struct Note {
     uint32_t endTick() const { return start_tick + duration; }
 };
 
+// Order notes are kept in within a track: start tick, then pitch
+inline bool noteOrder(const Note& a, const Note& b) {
+    if (a.start_tick != b.start_tick) return a.start_tick < b.start_tick;
+    return a.pitch < b.pitch;
+}
+
+// One placement of a shared clip on a track
+struct ClipInstance {
+    int clip = 0;               // Index into Project::clips
+    uint32_t offset = 0;        // Tick where the clip starts
+    int transpose = 0;          // Semitones
+    float velocityScale = 1.0f;
+};
+
 struct Track {
     std::string name = "Track";
     int channel = 0;          // 0-15 (MIDI channel)
@@ -23,20 +37,50 @@ struct Track {
     std::vector<Note> notes;
     bool muted = false;
     bool solo = false;
+    bool frozen = false;      // Played from pre-rendered audio (see TrackFreezer)
     float volume = 1.0f;      // 0.0-1.0
     float pan = 0.5f;         // 0.0 (left) - 1.0 (right), 0.5 = center
+    std::vector<ClipInstance> clipInstances;  // Kept sorted by offset
     
+    // Full sort into noteOrder. Radix sort for big tracks (file loads)
     void sortNotes();
+
+    // Incremental edits that keep notes in noteOrder. They only touch the
+    // part of the track from the first affected position on, so small
+    // edits near the end of a huge track stay cheap.
+    void insertSorted(std::vector<Note> batch);
+    // Remove one note per entry matching pitch, start, duration and
+    // velocity. Returns how many were found.
+    size_t removeNotes(const std::vector<Note>& batch);
+    // Restore order after the notes at `indices` were modified in place
+    void resortIndices(const std::vector<size_t>& indices);
+
     void clearSelection();
     int selectedCount() const;
 };
 
+// Block of notes shared by any number of clip instances. Editing it
+// changes every instance; instances are expanded on demand, never stored.
+struct Clip {
+    std::string name = "Clip";
+    uint32_t length = 0;      // Ticks; notes starting at or past this are ignored
+    Track content;            // Notes relative to the clip start (only notes are used)
+};
+
 struct Project {
     std::vector<Track> tracks;
+    std::vector<Clip> clips;
     int ticks_per_quarter = 480;  // Resolution (PPQ)
     float tempo_bpm = 120.0f;     // Beats per minute
     std::string filepath;
     bool modified = false;
+
+    // Changes whenever note content or the track list changes (App calls
+    // touch()), so caches built from the notes can tell when they're stale.
+    // Unique across Project instances.
+    uint64_t revision = nextRevision();
+    void touch() { revision = nextRevision(); }
+    static uint64_t nextRevision();
     
     // Time signature
     int beats_per_bar = 4;        // Numerator (e.g., 4 in 4/4)
@@ -62,6 +106,13 @@ struct Project {
     uint32_t getTotalTicks() const;
     
     void clearAllSelections();
+
+    // Append the notes of `track`'s clip instances that start in
+    // [startTick, endTick) to `out`, or, with `overlapping`, every note that
+    // sounds anywhere in that window. Only instances touching the window
+    // are expanded.
+    void expandClips(const Track& track, uint32_t startTick, uint32_t endTick,
+                     std::vector<Note>& out, bool overlapping = false) const;
 };
 
 // Grid snap values (in fractions of a beat)
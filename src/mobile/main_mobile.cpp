@@ -1,4 +1,6 @@
 #include "mobile_app.h"
+#include "../profiler.h"
+#include "../startup_timeline.h"
 
 #include <imgui.h>
 #include <imgui_impl_sdl2.h>
@@ -46,6 +48,7 @@ static float computeDpiScale(SDL_Window* window) {
 }
 
 int main(int argc, char* argv[]) {
+    auto& timeline = StartupTimeline::get();
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_EVENTS) != 0) {
         fprintf(stderr, "SDL_Init error: %s\n", SDL_GetError());
         return 1;
@@ -187,10 +190,14 @@ int main(int argc, char* argv[]) {
     if (argc > 1) {
         mobileApp.getApp().loadFile(argv[1]);
     }
+    auto appReady = StartupTimeline::Clock::now();
+    timeline.record("window + app", timeline.launchTime(), appReady);
+    bool firstFrame = true;
 
 
     bool running = true;
     while (running) {
+        PROFILE_FRAME();
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             // On Android we need to scale mouse/button coordinates from physical
@@ -243,19 +250,36 @@ int main(int argc, char* argv[]) {
         float logicalW = io.DisplaySize.x;
         float logicalH = io.DisplaySize.y;
 
-        mobileApp.update(io.DeltaTime);
-        mobileApp.render(logicalW, logicalH);
+        {
+            PROFILE_SCOPE("UI");
+            mobileApp.update(io.DeltaTime);
+            mobileApp.render(logicalW, logicalH);
+        }
 
-        ImGui::Render();
+        {
+            PROFILE_SCOPE("GL submit");
+            ImGui::Render();
 
-        int drawableW, drawableH;
-        SDL_GL_GetDrawableSize(window, &drawableW, &drawableH);
-        glViewport(0, 0, drawableW, drawableH);
-        glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            int drawableW, drawableH;
+            SDL_GL_GetDrawableSize(window, &drawableW, &drawableH);
+            glViewport(0, 0, drawableW, drawableH);
+            glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
-        SDL_GL_SwapWindow(window);
+        // Includes the vsync wait
+        {
+            PROFILE_SCOPE("Swap");
+            SDL_GL_SwapWindow(window);
+        }
+
+        // Audio and MIDI come up once there's something on screen
+        if (firstFrame) {
+            timeline.record("first frame", appReady, StartupTimeline::Clock::now());
+            mobileApp.startAudio();
+            firstFrame = false;
+        }
     }
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -1,14 +1,18 @@
 #include "mobile_app.h"
 #include "file_ops_mobile.h"
+#include "../profiler.h"
 #include <imgui.h>
 
 MobileApp::MobileApp()
     : toolbar_(app_, midiPlayer_)
     , pianoRoll_(app_, midiPlayer_)
     , trackPanel_(app_, midiPlayer_)
-    , settings_(app_, midiPlayer_)
+    , settings_(app_, midiPlayer_, profilerOverlay_)
     , lastFrame_(std::chrono::steady_clock::now())
 {
+    // Little RAM to spare: keep only the instruments in use, plus a few
+    midiPlayer_.getAudioSynth().setSampleCacheBudget(16u << 20);
+
     // Setup swipe navigation screens
     swipeNav_.setScreen(0, "Tracks", [this](float w, float h) {
         trackPanel_.render(w, h);
@@ -36,7 +40,10 @@ void MobileApp::update(float deltaTime) {
     if (app_.isPlaying()) {
         app_.advancePlayhead(frameDelta);
     }
-    midiPlayer_.update(app_.getProject(), app_.getPlayheadTick(), app_.isPlaying());
+    {
+        PROFILE_SCOPE("MidiPlayer::update");
+        midiPlayer_.update(app_.getProject(), app_.getPlayheadTick(), app_.isPlaying());
+    }
 
     // Update touch input (detects long-press, etc.)
     touchInput_.update(deltaTime);
@@ -83,6 +90,7 @@ void MobileApp::update(float deltaTime) {
 }
 
 void MobileApp::render(float displayWidth, float displayHeight) {
+    PROFILE_SCOPE("MobileApp::render");
     displayWidth_ = displayWidth;
     displayHeight_ = displayHeight;
 
@@ -90,4 +98,42 @@ void MobileApp::render(float displayWidth, float displayHeight) {
 
     // Render file dialogs (modal popups on top)
     FileOpsMobile::renderDialogs();
+    renderRecoveryDialog();
+
+    profilerOverlay_.render();
+    firstFrame_ = false;
+}
+
+void MobileApp::renderRecoveryDialog() {
+    // The OS killing the app is how most sessions end here, so this comes
+    // up whenever there were unsaved edits
+    if (firstFrame_ && app_.hasRecoveryData()) {
+        ImGui::OpenPopup("Recover Unsaved Changes##mobile");
+    }
+
+    ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+    ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+    ImGui::SetNextWindowSize(ImVec2(350, 0));
+
+    if (ImGui::BeginPopupModal("Recover Unsaved Changes##mobile", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::TextWrapped("The previous session ended with unsaved changes. Recover them?");
+        ImGui::Spacing();
+
+        float btnWidth = 150.0f;
+        if (ImGui::Button("Recover", ImVec2(btnWidth, 44))) {
+            if (app_.recoverFromJournal()) {
+                for (const auto& track : app_.getProject().tracks) {
+                    midiPlayer_.sendProgramChange(track.channel, track.program);
+                }
+            }
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Discard", ImVec2(btnWidth, 44))) {
+            app_.discardRecoveryData();
+            ImGui::CloseCurrentPopup();
+        }
+
+        ImGui::EndPopup();
+    }
 }
@@ -8,6 +8,7 @@
 #include "piano_roll_mobile.h"
 #include "track_panel_mobile.h"
 #include "settings_screen.h"
+#include "../ui/profiler_overlay.h"
 
 #include <SDL.h>
 #include <chrono>
@@ -20,8 +21,13 @@ public:
     void processEvent(const SDL_Event& event);
     void update(float deltaTime);
     void render(float displayWidth, float displayHeight);
+    // Bring up audio and MIDI in the background (after the first frame)
+    void startAudio() { midiPlayer_.start(); }
 
 private:
+    // Offer to restore edits from a session that didn't exit cleanly
+    void renderRecoveryDialog();
+
     App app_;
     midi::MidiPlayer midiPlayer_;
     TouchInput touchInput_;
@@ -29,8 +35,10 @@ private:
     ToolbarMobile toolbar_;
     PianoRollMobile pianoRoll_;
     TrackPanelMobile trackPanel_;
+    ProfilerOverlay profilerOverlay_;  // Before settings_, which toggles it
     SettingsScreen settings_;
     std::chrono::steady_clock::time_point lastFrame_;
+    bool firstFrame_ = true;
 
     // Display size cache
     float displayWidth_ = 0.0f;
@@ -1,5 +1,7 @@
 #include "piano_roll_mobile.h"
+#include "../batch_edit.h"
 #include "../midi/types.h"
+#include "../profiler.h"
 #include <algorithm>
 #include <cmath>
 
@@ -124,7 +126,7 @@ void PianoRollMobile::processGesture(const TouchGesture& gesture) {
                     newNote.selected = true;
 
                     auto cmd = std::make_unique<AddNotesCommand>(
-                        app_, app_.getSelectedTrackIndex(),
+                        app_, app_.getEditTargetIndex(),
                         std::vector<midi::Note>{newNote}
                     );
                     app_.executeCommand(std::move(cmd));
@@ -187,15 +189,10 @@ void PianoRollMobile::processGesture(const TouchGesture& gesture) {
                         }
 
                         if (track && (pitchDelta != 0 || tickDelta != 0)) {
-                            for (auto& note : track->notes) {
-                                if (note.selected) {
-                                    note.pitch = std::clamp(note.pitch + pitchDelta, 0, 127);
-                                    int32_t newTick = static_cast<int32_t>(note.start_tick) + tickDelta;
-                                    note.start_tick = static_cast<uint32_t>(std::max(0, newTick));
-                                }
-                            }
-                            track->sortNotes();
-                            app_.getProject().modified = true;
+                            BatchTransform transform;
+                            transform.transpose = pitchDelta;
+                            transform.timeShift = tickDelta;
+                            app_.applyBatchTransform(transform, "Move Notes");
                         }
                         mode_ = InteractionMode::None;
                     }
@@ -210,31 +207,13 @@ void PianoRollMobile::processGesture(const TouchGesture& gesture) {
 
                         int32_t tickDelta = static_cast<int32_t>(currentTick) - static_cast<int32_t>(startTick);
 
-                        if (resizingFromRight_) {
-                            // Right edge: change duration only
-                            for (auto& note : track->notes) {
-                                if (note.selected) {
-                                    int32_t newDuration = static_cast<int32_t>(note.duration) + tickDelta;
-                                    note.duration = static_cast<uint32_t>(std::max(1, newDuration));
-                                }
-                            }
-                        } else {
-                            // Left edge: move start_tick, adjust duration to keep end fixed
-                            for (auto& note : track->notes) {
-                                if (note.selected) {
-                                    uint32_t endTick = note.start_tick + note.duration;
-                                    int32_t newStart = static_cast<int32_t>(note.start_tick) + tickDelta;
-                                    newStart = std::max(0, newStart);
-                                    if (static_cast<uint32_t>(newStart) >= endTick) {
-                                        newStart = static_cast<int32_t>(endTick) - 1;
-                                    }
-                                    note.start_tick = static_cast<uint32_t>(newStart);
-                                    note.duration = endTick - note.start_tick;
-                                }
-                            }
+                        if (tickDelta != 0) {
+                            // Left edge moves the start and keeps the end fixed
+                            BatchTransform transform;
+                            transform.resizeDelta = tickDelta;
+                            transform.resizeFromLeft = !resizingFromRight_;
+                            app_.applyBatchTransform(transform, "Resize Notes");
                         }
-                        track->sortNotes();
-                        app_.getProject().modified = true;
                         mode_ = InteractionMode::None;
                     }
 
@@ -349,6 +328,7 @@ void PianoRollMobile::processGesture(const TouchGesture& gesture) {
 // ========== Drawing ==========
 
 void PianoRollMobile::drawGrid(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 canvasSize) {
+    PROFILE_SCOPE("PianoRoll::drawGrid");
     const auto& project = app_.getProject();
 
     uint32_t startTick = static_cast<uint32_t>(std::max(0.0f, scrollX_));
@@ -493,13 +473,14 @@ ImU32 PianoRollMobile::getTrackColor(int trackIndex, int velocity, bool isSelect
 }
 
 void PianoRollMobile::drawNotes(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 canvasSize) {
+    PROFILE_SCOPE("PianoRoll::drawNotes");
     const auto& project = app_.getProject();
     int selectedTrackIndex = app_.getSelectedTrackIndex();
 
     drawList->PushClipRect(canvasPos, ImVec2(canvasPos.x + canvasSize.x, canvasPos.y + canvasSize.y), true);
 
-    // Non-selected tracks (behind)
-    for (int trackIdx = 0; trackIdx < static_cast<int>(project.tracks.size()); ++trackIdx) {
+    // Non-selected tracks (behind), hidden while editing a clip
+    for (int trackIdx = 0; app_.getEditingClip() < 0 && trackIdx < static_cast<int>(project.tracks.size()); ++trackIdx) {
         if (trackIdx == selectedTrackIndex) continue;
         const auto& track = project.tracks[trackIdx];
         if (track.muted) continue;
@@ -519,8 +500,8 @@ void PianoRollMobile::drawNotes(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 c
     }
 
     // Selected track (on top)
-    if (selectedTrackIndex >= 0 && selectedTrackIndex < static_cast<int>(project.tracks.size())) {
-        const auto& track = project.tracks[selectedTrackIndex];
+    if (const auto* selected = app_.getSelectedTrack()) {
+        const auto& track = *selected;
 
         for (size_t i = 0; i < track.notes.size(); ++i) {
             const auto& note = track.notes[i];
@@ -4,9 +4,10 @@
 #include <algorithm>
 #include <cmath>
 
-SettingsScreen::SettingsScreen(App& app, midi::MidiPlayer& player)
+SettingsScreen::SettingsScreen(App& app, midi::MidiPlayer& player, ProfilerOverlay& profiler)
     : app_(app)
     , player_(player)
+    , profiler_(profiler)
 {
 }
 
@@ -51,7 +52,11 @@ void SettingsScreen::render(float width, float height) {
     renderMasterVolume(cardWidth);
     renderQuantize(cardWidth);
     renderMidiOutput(cardWidth);
+    renderAudio(cardWidth);
     renderExport(cardWidth);
+#ifdef ENABLE_PROFILER
+    renderDebug(cardWidth);
+#endif
 
     ImGui::Spacing();
     ImGui::Spacing();
@@ -237,17 +242,21 @@ void SettingsScreen::renderQuantize(float cardWidth) {
 void SettingsScreen::renderMidiOutput(float cardWidth) {
     beginCard("MIDI Output", cardWidth);
 
-    auto devices = player_.getOutputDevices();
+    auto devices = player_.getDevices();
     std::vector<const char*> deviceNames;
     deviceNames.push_back("Built-in Synth");
-    for (const auto& d : devices) {
+    for (const auto& d : devices->outputs) {
         deviceNames.push_back(d.c_str());
     }
 
     int deviceIndex = player_.getCurrentDevice() + 1;
     ImGui::SetNextItemWidth(cardWidth - CARD_PADDING * 2);
-    if (ImGui::Combo("##midi_device", &deviceIndex, deviceNames.data(),
-                     static_cast<int>(deviceNames.size()))) {
+    bool deviceChosen = ImGui::Combo("##midi_device", &deviceIndex, deviceNames.data(),
+                                     static_cast<int>(deviceNames.size()));
+    if (ImGui::IsItemActivated()) {
+        player_.refreshDevices();
+    }
+    if (deviceChosen) {
         if (deviceIndex == 0) {
             player_.closeDevice();
         } else {
@@ -262,6 +271,53 @@ void SettingsScreen::renderMidiOutput(float cardWidth) {
     endCard();
 }
 
+void SettingsScreen::renderAudio(float cardWidth) {
+    beginCard("Audio", cardWidth);
+
+    // Small buffers for playing live, big ones when the device drops out.
+    // The sample rate stays the device's own, so nothing is resampled.
+    static const char* bufferNames[] = {"Auto", "128", "256", "512", "1024"};
+    static const uint32_t bufferFrames[] = {0, 128, 256, 512, 1024};
+
+    midi::AudioConfig config = player_.getAudioSynth().getConfig();
+    int current = 0;
+    for (int i = 0; i < 5; ++i) {
+        if (bufferFrames[i] == config.periodFrames) current = i;
+    }
+
+    float pillWidth = (cardWidth - CARD_PADDING * 2 - 16) / 5;
+    for (int i = 0; i < 5; ++i) {
+        if (i > 0) ImGui::SameLine();
+
+        bool isActive = i == current;
+        if (isActive) {
+            ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.2f, 0.5f, 0.8f, 1.0f));
+        }
+
+        char label[16];
+        snprintf(label, sizeof(label), "%s##buf", bufferNames[i]);
+        if (ImGui::Button(label, ImVec2(pillWidth, BUTTON_HEIGHT)) && !isActive) {
+            config.periodFrames = bufferFrames[i];
+            player_.setAudioConfig(config);
+        }
+
+        if (isActive) {
+            ImGui::PopStyleColor();
+        }
+    }
+
+    ImGui::Spacing();
+    auto info = player_.getAudioSynth().getDeviceInfo();
+    if (info.sampleRate == 0) {
+        ImGui::TextDisabled("Audio not running");
+    } else {
+        ImGui::TextDisabled("%d Hz, %u x %u frames, %.1f ms", info.sampleRate, info.periods,
+                            info.periodFrames, info.latencyMs);
+    }
+
+    endCard();
+}
+
 void SettingsScreen::renderExport(float cardWidth) {
     beginCard("Export", cardWidth);
 
@@ -273,3 +329,16 @@ void SettingsScreen::renderExport(float cardWidth) {
 
     endCard();
 }
+
+void SettingsScreen::renderDebug(float cardWidth) {
+    beginCard("Debug", cardWidth);
+
+    ImGui::Text("Frame Profiler");
+    ImGui::SameLine(cardWidth - CARD_PADDING * 2 - 50);
+    bool showProfiler = profiler_.isVisible();
+    if (ImGui::Checkbox("##frame_profiler", &showProfiler)) {
+        profiler_.setVisible(showProfiler);
+    }
+
+    endCard();
+}
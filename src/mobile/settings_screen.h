@@ -2,14 +2,15 @@
 
 #include "../app.h"
 #include "../midi/midi_player.h"
+#include "../ui/profiler_overlay.h"
 #include <imgui.h>
 
 // Advanced settings screen (right swipe screen).
 // Card-based sections: Time Signature, Loop Region, Master Volume,
-// Quantize, MIDI Output, Export.
+// Quantize, MIDI Output, Audio, Export (and Debug in profiling builds).
 class SettingsScreen {
 public:
-    SettingsScreen(App& app, midi::MidiPlayer& player);
+    SettingsScreen(App& app, midi::MidiPlayer& player, ProfilerOverlay& profiler);
 
     void render(float width, float height);
 
@@ -20,7 +21,9 @@ private:
     void renderMasterVolume(float cardWidth);
     void renderQuantize(float cardWidth);
     void renderMidiOutput(float cardWidth);
+    void renderAudio(float cardWidth);
     void renderExport(float cardWidth);
+    void renderDebug(float cardWidth);
 
     // Helper: draw a card background and return inner position
     void beginCard(const char* title, float cardWidth);
@@ -28,6 +31,7 @@ private:
 
     App& app_;
     midi::MidiPlayer& player_;
+    ProfilerOverlay& profiler_;
 
     static constexpr float CARD_MARGIN = 8.0f;
     static constexpr float CARD_PADDING = 14.0f;
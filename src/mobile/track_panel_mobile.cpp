@@ -1,5 +1,6 @@
 #include "track_panel_mobile.h"
 #include "../midi/general_midi.h"
+#include "../profiler.h"
 #include <algorithm>
 #include <cmath>
 
@@ -75,6 +76,7 @@ void TrackPanelMobile::processGesture(const TouchGesture& gesture) {
 }
 
 void TrackPanelMobile::render(float width, float height) {
+    PROFILE_SCOPE("TrackPanel::render");
     auto& project = app_.getProject();
 
     // If the editing track was deleted, close the editor
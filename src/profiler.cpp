@@ -0,0 +1,42 @@
+#include "profiler.h"
+#include <cstring>
+
+FrameProfiler& FrameProfiler::get() {
+    static FrameProfiler profiler;
+    return profiler;
+}
+
+void FrameProfiler::beginFrame() {
+    auto now = Clock::now();
+    if (started_) {
+        current_.totalMs = std::chrono::duration<float, std::milli>(now - frameStart_).count();
+        history_[next_] = current_;
+        frameTimes_[next_] = current_.totalMs;
+        next_ = (next_ + 1) % HISTORY;
+        if (frameCount_ < HISTORY) ++frameCount_;
+        if (current_.totalMs > worst_.totalMs) worst_ = current_;
+    }
+    current_ = Frame();
+    frameStart_ = now;
+    started_ = true;
+}
+
+int FrameProfiler::registerStage(const char* name) {
+    for (int i = 0; i < stageCount_; ++i) {
+        if (std::strcmp(stages_[i].name, name) == 0) return i;
+    }
+    if (stageCount_ == MAX_STAGES) return -1;
+    stages_[stageCount_].name = name;
+    stages_[stageCount_].depth = depth_;
+    return stageCount_++;
+}
+
+void FrameProfiler::add(int stage, Clock::duration elapsed) {
+    if (stage < 0) return;
+    // Summed: a stage can run more than once a frame
+    current_.stageMs[stage] += std::chrono::duration<float, std::milli>(elapsed).count();
+}
+
+const FrameProfiler::Frame& FrameProfiler::frame(int age) const {
+    return history_[(next_ - 1 - age + HISTORY) % HISTORY];
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+// Per-frame stage timings for the UI thread. PROFILE_SCOPE("name") times
+// the rest of the enclosing block and adds it to the current frame;
+// PROFILE_FRAME() at the top of the main loop closes the previous frame
+// into a ring of the last HISTORY frames. Both compile to nothing unless
+// ENABLE_PROFILER is defined (on by default in Debug builds).
+//
+// Not thread-safe: only time things that run on the UI thread.
+class FrameProfiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int MAX_STAGES = 16;
+    static constexpr int HISTORY = 240;
+
+    struct Frame {
+        float totalMs = 0.0f;  // Start of this frame to start of the next
+        std::array<float, MAX_STAGES> stageMs{};
+    };
+
+    static FrameProfiler& get();
+
+    void beginFrame();
+
+    // Returns the stage id for `name` (same name, same stage), or -1 when
+    // all MAX_STAGES are taken. `name` must outlive the profiler.
+    int registerStage(const char* name);
+    void add(int stage, Clock::duration elapsed);
+
+    int stageCount() const { return stageCount_; }
+    const char* stageName(int stage) const { return stages_[stage].name; }
+    // Nesting depth the stage was first seen at, for indenting
+    int stageDepth(int stage) const { return stages_[stage].depth; }
+
+    // Completed frames: age 0 is the last one, up to frameCount() - 1
+    int frameCount() const { return frameCount_; }
+    const Frame& frame(int age) const;
+
+    // Frame times in ring order, oldest at frameTimesOffset()
+    const float* frameTimes() const { return frameTimes_.data(); }
+    int frameTimesOffset() const { return next_; }
+
+    const Frame& worstFrame() const { return worst_; }
+    void resetWorst() { worst_ = Frame(); }
+
+    class Scope {
+    public:
+        explicit Scope(int stage) : stage_(stage), start_(Clock::now()) { ++FrameProfiler::get().depth_; }
+        ~Scope() {
+            FrameProfiler& profiler = FrameProfiler::get();
+            --profiler.depth_;
+            profiler.add(stage_, Clock::now() - start_);
+        }
+
+    private:
+        int stage_;
+        Clock::time_point start_;
+    };
+
+private:
+    FrameProfiler() = default;
+
+    struct Stage {
+        const char* name = nullptr;
+        int depth = 0;
+    };
+
+    std::array<Stage, MAX_STAGES> stages_{};
+    int stageCount_ = 0;
+    int depth_ = 0;
+
+    Frame current_;
+    Clock::time_point frameStart_;
+    bool started_ = false;
+
+    std::array<Frame, HISTORY> history_{};
+    std::array<float, HISTORY> frameTimes_{};
+    int next_ = 0;
+    int frameCount_ = 0;
+    Frame worst_;
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                                        \
+    static const int PROFILE_CONCAT(profileStage_, __LINE__) = FrameProfiler::get().registerStage(name); \
+    FrameProfiler::Scope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileStage_, __LINE__))
+#define PROFILE_FRAME() FrameProfiler::get().beginFrame()
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_FRAME() do {} while (0)
+#endif
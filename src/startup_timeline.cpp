@@ -0,0 +1,34 @@
+#include "startup_timeline.h"
+#include <algorithm>
+#include <cstdio>
+
+// Static initialization runs before main(), which is as close to launch as
+// we can get portably
+static const StartupTimeline::Clock::time_point processStart = StartupTimeline::Clock::now();
+
+StartupTimeline::StartupTimeline() : launch_(processStart) {}
+
+StartupTimeline& StartupTimeline::get() {
+    static StartupTimeline timeline;
+    return timeline;
+}
+
+void StartupTimeline::record(const std::string& phase, Clock::time_point start, Clock::time_point end) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reported_) return;
+    phases_.push_back({phase, start, end});
+}
+
+void StartupTimeline::report() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reported_) return;
+    reported_ = true;
+
+    std::stable_sort(phases_.begin(), phases_.end(),
+                     [](const Phase& a, const Phase& b) { return a.start < b.start; });
+    auto ms = [this](Clock::time_point t) { return std::chrono::duration<double, std::milli>(t - launch_).count(); };
+    for (const auto& phase : phases_) {
+        fprintf(stderr, "Startup: %7.1f - %7.1f ms  %s\n", ms(phase.start), ms(phase.end), phase.name.c_str());
+    }
+    phases_.clear();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Where startup time goes. Phases can be recorded from any thread (the
+// audio and MIDI bring-up run in the background); report() prints them
+// once, as milliseconds since launch:
+//
+//   Startup:    0.0 -   84.2 ms  window
+//   Startup:   84.2 -   95.0 ms  imgui
+//   ...
+class StartupTimeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static StartupTimeline& get();
+
+    void record(const std::string& phase, Clock::time_point start, Clock::time_point end);
+    // Print everything recorded so far; only the first call prints
+    void report();
+
+    Clock::time_point launchTime() const { return launch_; }
+
+    // Records from construction to destruction
+    class Scope {
+    public:
+        explicit Scope(std::string phase) : phase_(std::move(phase)), start_(Clock::now()) {}
+        ~Scope() { StartupTimeline::get().record(phase_, start_, Clock::now()); }
+
+    private:
+        std::string phase_;
+        Clock::time_point start_;
+    };
+
+private:
+    StartupTimeline();
+
+    struct Phase {
+        std::string name;
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    std::mutex mutex_;
+    std::vector<Phase> phases_;
+    bool reported_ = false;
+    Clock::time_point launch_;
+};
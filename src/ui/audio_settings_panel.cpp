@@ -0,0 +1,145 @@
+#include "audio_settings_panel.h"
+#include <imgui.h>
+#include <cstdio>
+#include <iterator>
+
+static const int SAMPLE_RATES[] = {0, 44100, 48000, 88200, 96000};
+static const uint32_t PERIOD_FRAMES[] = {0, 64, 128, 256, 512, 1024, 2048};
+static const uint32_t PERIODS[] = {0, 2, 3, 4};
+static const int RENDER_THREADS[] = {0, 1, 2, 3, 4, 6, 8};
+
+template <typename T, size_t N>
+static int indexOf(const T (&values)[N], T value) {
+    for (size_t i = 0; i < N; ++i) {
+        if (values[i] == value) return static_cast<int>(i);
+    }
+    return 0;
+}
+
+AudioSettingsPanel::AudioSettingsPanel(midi::MidiPlayer& player)
+    : player_(player)
+    , backends_(midi::AudioSynth::availableBackends())
+{
+}
+
+void AudioSettingsPanel::setVisible(bool visible) {
+    // Opening starts from what's in use
+    if (visible && !visible_) pending_ = player_.getAudioSynth().getConfig();
+    visible_ = visible;
+}
+
+void AudioSettingsPanel::render() {
+    if (!visible_) return;
+
+    ImGui::SetNextWindowSize(ImVec2(360, 380), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Audio Settings", &visible_)) {
+        ImGui::End();
+        return;
+    }
+
+    auto info = player_.getAudioSynth().getDeviceInfo();
+    int rate = info.sampleRate > 0 ? info.sampleRate : 48000;
+
+    // Backend
+    const char* backendLabel = pending_.backend.empty() ? "Default" : pending_.backend.c_str();
+    if (ImGui::BeginCombo("Backend", backendLabel)) {
+        if (ImGui::Selectable("Default", pending_.backend.empty())) pending_.backend.clear();
+        for (const auto& name : backends_) {
+            if (ImGui::Selectable(name.c_str(), pending_.backend == name)) pending_.backend = name;
+        }
+        ImGui::EndCombo();
+    }
+
+    // Sample rate; the device's own avoids resampling
+    char label[64];
+    int rateIndex = indexOf(SAMPLE_RATES, pending_.sampleRate);
+    if (rateIndex == 0) snprintf(label, sizeof(label), "Device native");
+    else snprintf(label, sizeof(label), "%d Hz", SAMPLE_RATES[rateIndex]);
+    if (ImGui::BeginCombo("Sample Rate", label)) {
+        for (int i = 0; i < static_cast<int>(std::size(SAMPLE_RATES)); ++i) {
+            if (i == 0) snprintf(label, sizeof(label), "Device native");
+            else snprintf(label, sizeof(label), "%d Hz", SAMPLE_RATES[i]);
+            if (ImGui::Selectable(label, i == rateIndex)) pending_.sampleRate = SAMPLE_RATES[i];
+        }
+        ImGui::EndCombo();
+    }
+
+    // Buffer size, with its length at the current rate
+    int periodIndex = indexOf(PERIOD_FRAMES, pending_.periodFrames);
+    auto periodLabel = [&](int i) {
+        if (i == 0) snprintf(label, sizeof(label), "Default");
+        else snprintf(label, sizeof(label), "%u frames (%.1f ms)", PERIOD_FRAMES[i], 1000.0 * PERIOD_FRAMES[i] / rate);
+        return label;
+    };
+    if (ImGui::BeginCombo("Buffer Size", periodLabel(periodIndex))) {
+        for (int i = 0; i < static_cast<int>(std::size(PERIOD_FRAMES)); ++i) {
+            if (ImGui::Selectable(periodLabel(i), i == periodIndex)) pending_.periodFrames = PERIOD_FRAMES[i];
+        }
+        ImGui::EndCombo();
+    }
+
+    int periodsIndex = indexOf(PERIODS, pending_.periods);
+    snprintf(label, sizeof(label), periodsIndex == 0 ? "Default" : "%u", PERIODS[periodsIndex]);
+    if (ImGui::BeginCombo("Buffers", label)) {
+        for (int i = 0; i < static_cast<int>(std::size(PERIODS)); ++i) {
+            snprintf(label, sizeof(label), i == 0 ? "Default" : "%u", PERIODS[i]);
+            if (ImGui::Selectable(label, i == periodsIndex)) pending_.periods = PERIODS[i];
+        }
+        ImGui::EndCombo();
+    }
+
+    // SoundFont voices rendered on more than the audio thread, for dense
+    // pieces; only used while lots of voices are sounding
+    int threadsIndex = indexOf(RENDER_THREADS, pending_.renderThreads);
+    snprintf(label, sizeof(label), threadsIndex == 0 ? "Auto" : "%d", RENDER_THREADS[threadsIndex]);
+    if (ImGui::BeginCombo("Render Threads", label)) {
+        for (int i = 0; i < static_cast<int>(std::size(RENDER_THREADS)); ++i) {
+            snprintf(label, sizeof(label), i == 0 ? "Auto" : "%d", RENDER_THREADS[i]);
+            if (ImGui::Selectable(label, i == threadsIndex)) pending_.renderThreads = RENDER_THREADS[i];
+        }
+        ImGui::EndCombo();
+    }
+
+    if (ImGui::Button("Apply")) {
+        player_.setAudioConfig(pending_);
+    }
+    ImGui::SameLine();
+    ImGui::TextDisabled("Restarts the device");
+
+    ImGui::Separator();
+    if (info.sampleRate == 0) {
+        ImGui::TextDisabled("Audio device not running");
+    } else {
+        ImGui::Text("%s: %s", info.backend.c_str(), info.deviceName.c_str());
+        ImGui::Text("%d Hz, %u x %u frames", info.sampleRate, info.periods, info.periodFrames);
+        ImGui::Text("Output latency %.1f ms", info.latencyMs);
+        ImGui::Text("%d render thread%s", info.renderThreads, info.renderThreads == 1 ? "" : "s");
+        if (info.nativeSampleRate != info.sampleRate) {
+            ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f), "Resampling from the device's %d Hz",
+                               info.nativeSampleRate);
+        }
+    }
+
+    // SoundFont, loaded in the background
+    ImGui::Separator();
+    auto& synth = player_.getAudioSynth();
+    ImGui::SetNextItemWidth(-60);
+    bool load = ImGui::InputText("##soundfont", soundFontPath_, sizeof(soundFontPath_),
+                                 ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    load |= ImGui::Button("Load");
+    if (load && soundFontPath_[0]) {
+        player_.loadSoundFont(soundFontPath_);
+    }
+    if (synth.isLoadingSoundFont()) {
+        ImGui::ProgressBar(synth.getSoundFontProgress(), ImVec2(-1, 0));
+    } else if (synth.hasSoundFont()) {
+        // Only the instruments in use are in memory
+        ImGui::TextDisabled("SoundFont loaded, samples %.0f of %.0f MB in memory",
+                            synth.getSampleBytesResident() / 1048576.0, synth.getSampleBytesTotal() / 1048576.0);
+    } else {
+        ImGui::TextDisabled("Built-in synth (no SoundFont)");
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../midi/midi_player.h"
+#include <string>
+#include <vector>
+
+// Audio device setup: backend, sample rate, buffer size and count, plus
+// what the device actually gave us and the latency that comes with it.
+// Also where a SoundFont is loaded.
+class AudioSettingsPanel {
+public:
+    AudioSettingsPanel(midi::MidiPlayer& player);
+
+    void render();
+
+    bool isVisible() const { return visible_; }
+    void setVisible(bool visible);
+
+private:
+    midi::MidiPlayer& player_;
+    midi::AudioConfig pending_;  // Edited here until applied
+    std::vector<std::string> backends_;
+    char soundFontPath_[512] = "";
+    bool visible_ = false;
+};
@@ -1,4 +1,5 @@
 #include "main_window.h"
+#include "../profiler.h"
 #include <imgui.h>
 #include <imgui_internal.h>
 #include <cstring>
@@ -8,6 +9,8 @@ MainWindow::MainWindow(App& app)
     , toolbar_(app, midiPlayer_)
     , trackPanel_(app, midiPlayer_)
     , pianoRoll_(app, midiPlayer_)
+    , timingPanel_(midiPlayer_)
+    , audioSettingsPanel_(midiPlayer_)
     , lastFrame_(std::chrono::steady_clock::now())
 {
 }
@@ -21,10 +24,21 @@ void MainWindow::render() {
     lastFrame_ = now;
 
     // Update playback
-    if (app_.isPlaying()) {
+    if (midiPlayer_.isFollowingClock()) {
+        // External master: it owns play state and position
+        const auto& follower = midiPlayer_.getClockFollower();
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        app_.setPlaying(follower.isRunning());
+        app_.setPlayheadTick(follower.tickAt(nowNs, app_.getProject().ticks_per_quarter));
+    } else if (app_.isPlaying()) {
         app_.advancePlayhead(deltaTime);
     }
-    midiPlayer_.update(app_.getProject(), app_.getPlayheadTick(), app_.isPlaying());
+    {
+        PROFILE_SCOPE("MidiPlayer::update");
+        midiPlayer_.update(app_.getProject(), app_.getPlayheadTick(), app_.isPlaying());
+    }
+    updateRecording();
+    timingPanel_.update();
 
     // Handle keyboard shortcuts
     handleKeyboardShortcuts();
@@ -39,10 +53,17 @@ void MainWindow::render() {
     toolbar_.render();
     trackPanel_.render();
     pianoRoll_.render();
+    timingPanel_.render();
+    profilerOverlay_.render();
+    audioSettingsPanel_.render();
 
     // Handle file dialogs
     handleFileDialogs();
 
+    // Offer to restore edits from a session that didn't exit cleanly
+    handleRecoveryDialog();
+    handleHistoryError();
+
     firstFrame_ = false;
 }
 
@@ -93,6 +114,46 @@ void MainWindow::renderMenuBar() {
             if (ImGui::MenuItem("Quantize", "Q")) {
                 app_.quantizeSelectedNotes();
             }
+            if (ImGui::MenuItem("Transpose Up")) {
+                app_.transposeSelectedNotes(1);
+            }
+            if (ImGui::MenuItem("Transpose Down")) {
+                app_.transposeSelectedNotes(-1);
+            }
+            if (ImGui::MenuItem("Octave Up")) {
+                app_.transposeSelectedNotes(12);
+            }
+            if (ImGui::MenuItem("Octave Down")) {
+                app_.transposeSelectedNotes(-12);
+            }
+            if (ImGui::MenuItem("Humanize")) {
+                // A 64th note of timing jitter and +/-8 velocity
+                app_.humanizeSelectedNotes(app_.getProject().ticks_per_quarter / 16, 8);
+            }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Create Clip from Selection", nullptr, false, app_.getEditingClip() < 0)) {
+                app_.createClipFromSelection();
+            }
+            if (ImGui::MenuItem("Repeat Last Clip Instance", nullptr, false, app_.getEditingClip() < 0)) {
+                app_.repeatLastClipInstance();
+            }
+            if (ImGui::MenuItem("Flatten Clips", nullptr, false, app_.getEditingClip() < 0)) {
+                app_.flattenClipInstances();
+            }
+            const auto& clips = app_.getProject().clips;
+            if (ImGui::BeginMenu("Edit Clip", !clips.empty())) {
+                for (size_t i = 0; i < clips.size(); ++i) {
+                    ImGui::PushID(static_cast<int>(i));
+                    if (ImGui::MenuItem(clips[i].name.c_str(), nullptr, app_.getEditingClip() == static_cast<int>(i))) {
+                        app_.editClip(static_cast<int>(i));
+                    }
+                    ImGui::PopID();
+                }
+                ImGui::EndMenu();
+            }
+            if (ImGui::MenuItem("Done Editing Clip", nullptr, false, app_.getEditingClip() >= 0)) {
+                app_.stopEditingClip();
+            }
             ImGui::EndMenu();
         }
 
@@ -118,6 +179,22 @@ void MainWindow::renderMenuBar() {
             if (ImGui::MenuItem("Panic (All Notes Off)")) {
                 midiPlayer_.panic();
             }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Audio Settings...")) {
+                audioSettingsPanel_.setVisible(true);
+            }
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Debug")) {
+            bool showTiming = timingPanel_.isVisible();
+            if (ImGui::MenuItem("Playback Timing", nullptr, &showTiming)) {
+                timingPanel_.setVisible(showTiming);
+            }
+            bool showProfiler = profilerOverlay_.isVisible();
+            if (ImGui::MenuItem("Frame Profiler", "F12", &showProfiler)) {
+                profilerOverlay_.setVisible(showProfiler);
+            }
             ImGui::EndMenu();
         }
 
@@ -175,6 +252,30 @@ void MainWindow::renderDockspace() {
     ImGui::End();
 }
 
+void MainWindow::updateRecording() {
+    const auto& tracks = app_.getProject().tracks;
+    int selected = app_.getSelectedTrackIndex();
+    if (selected >= 0 && selected < static_cast<int>(tracks.size())) {
+        midiPlayer_.setMonitorChannel(tracks[selected].channel);
+    }
+
+    // Whatever was recorded since last frame goes in as one batch. Stopping
+    // (or disarming) ends the held notes first, so the take is complete
+    // before it becomes an undo step.
+    bool capture = app_.isRecordArmed() && app_.isPlaying();
+    if (midiPlayer_.isRecording() != capture) {
+        midiPlayer_.setRecording(capture);
+    }
+    recorded_.clear();
+    midiPlayer_.takeRecordedNotes(recorded_);
+    app_.appendRecordedNotes(recorded_);
+
+    if (!capture) {
+        app_.endRecordedTake();
+        app_.setRecordArmed(false);
+    }
+}
+
 void MainWindow::handleKeyboardShortcuts() {
     ImGuiIO& io = ImGui::GetIO();
 
@@ -184,6 +285,10 @@ void MainWindow::handleKeyboardShortcuts() {
     bool ctrl = io.KeyCtrl;
     bool shift = io.KeyShift;
 
+    if (ImGui::IsKeyPressed(ImGuiKey_F12, false)) {
+        profilerOverlay_.setVisible(!profilerOverlay_.isVisible());
+    }
+
     // File operations
     if (ctrl && !shift && ImGui::IsKeyPressed(ImGuiKey_N)) {
         app_.newProject();
@@ -338,3 +443,48 @@ void MainWindow::handleFileDialogs() {
         ImGui::EndPopup();
     }
 }
+
+void MainWindow::handleRecoveryDialog() {
+    if (firstFrame_ && app_.hasRecoveryData()) {
+        ImGui::OpenPopup("Recover Unsaved Changes");
+    }
+
+    if (ImGui::BeginPopupModal("Recover Unsaved Changes", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::Text("The previous session did not exit cleanly.");
+        ImGui::Text("Recover unsaved changes?");
+
+        ImGui::Separator();
+        if (ImGui::Button("Recover", ImVec2(120, 0))) {
+            if (app_.recoverFromJournal()) {
+                for (const auto& track : app_.getProject().tracks) {
+                    midiPlayer_.sendProgramChange(track.channel, track.program);
+                }
+            }
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Discard", ImVec2(120, 0))) {
+            app_.discardRecoveryData();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+}
+
+void MainWindow::handleHistoryError() {
+    if (!app_.getHistoryError().empty() && !ImGui::IsPopupOpen("Undo History")) {
+        ImGui::OpenPopup("Undo History");
+    }
+
+    if (ImGui::BeginPopupModal("Undo History", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::PushTextWrapPos(400);
+        ImGui::TextWrapped("%s", app_.getHistoryError().c_str());
+        ImGui::PopTextWrapPos();
+        ImGui::Separator();
+        if (ImGui::Button("OK", ImVec2(120, 0))) {
+            app_.clearHistoryError();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+}
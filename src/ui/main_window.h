@@ -4,6 +4,9 @@
 #include "toolbar.h"
 #include "track_panel.h"
 #include "piano_roll.h"
+#include "timing_panel.h"
+#include "profiler_overlay.h"
+#include "audio_settings_panel.h"
 #include "../midi/midi_player.h"
 #include <string>
 #include <chrono>
@@ -14,12 +17,17 @@ public:
     ~MainWindow();
 
     void render();
+    // Bring up audio and MIDI in the background (after the first frame)
+    void startAudio() { midiPlayer_.start(); }
 
 private:
     void renderMenuBar();
     void renderDockspace();
     void handleKeyboardShortcuts();
     void handleFileDialogs();
+    void handleRecoveryDialog();
+    void handleHistoryError();
+    void updateRecording();
 
     // File dialog helpers
     void showOpenDialog();
@@ -30,6 +38,10 @@ private:
     TrackPanel trackPanel_;
     PianoRoll pianoRoll_;
     midi::MidiPlayer midiPlayer_;
+    TimingPanel timingPanel_;
+    ProfilerOverlay profilerOverlay_;
+    AudioSettingsPanel audioSettingsPanel_;
+    std::vector<midi::Note> recorded_;  // Scratch for updateRecording
 
     // Timing
     std::chrono::steady_clock::time_point lastFrame_;
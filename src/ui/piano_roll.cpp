@@ -1,4 +1,6 @@
 #include "piano_roll.h"
+#include "../batch_edit.h"
+#include "../profiler.h"
 #include "../midi/types.h"
 #include <algorithm>
 #include <cmath>
@@ -106,6 +108,7 @@ void PianoRoll::render() {
 }
 
 void PianoRoll::drawGrid(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 canvasSize) {
+    PROFILE_SCOPE("PianoRoll::drawGrid");
     const auto& project = app_.getProject();
 
     // Calculate visible range
@@ -310,13 +313,50 @@ static ImU32 getTrackColor(int trackIndex, int velocity, bool isSelected, bool i
 }
 
 void PianoRoll::drawNotes(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 canvasSize) {
+    PROFILE_SCOPE("PianoRoll::drawNotes");
     const auto& project = app_.getProject();
     int selectedTrackIndex = app_.getSelectedTrackIndex();
+    int editingClip = app_.getEditingClip();
 
     drawList->PushClipRect(canvasPos, ImVec2(canvasPos.x + canvasSize.x, canvasPos.y + canvasSize.y), true);
 
-    // First pass: non-selected tracks (behind)
-    for (int trackIdx = 0; trackIdx < static_cast<int>(project.tracks.size()); ++trackIdx) {
+    uint32_t visibleStart = xToTick(canvasPos.x, canvasPos, canvasSize);
+    uint32_t visibleEnd = xToTick(canvasPos.x + canvasSize.x, canvasPos, canvasSize) + 1;
+
+    // Clip instances are expanded for the visible range only and drawn as
+    // outlines: they're edited through the clip, not here
+    auto drawClipInstances = [&](int trackIdx, const midi::Track& track, bool active) {
+        if (track.clipInstances.empty()) return;
+        clipNotes_.clear();
+        project.expandClips(track, visibleStart, visibleEnd, clipNotes_, true);
+        for (const auto& note : clipNotes_) {
+            float x1 = tickToX(note.start_tick, canvasPos, canvasSize);
+            float x2 = tickToX(note.endTick(), canvasPos, canvasSize);
+            float y = pitchToY(note.pitch, canvasPos, canvasSize);
+            if (y + noteHeight_ < canvasPos.y || y > canvasPos.y + canvasSize.y) continue;
+
+            ImU32 color = getTrackColor(trackIdx, note.velocity, false, active);
+            drawList->AddRectFilled(ImVec2(x1, y + 1), ImVec2(x2, y + noteHeight_ - 1), (color & 0x00FFFFFF) | 0x50000000);
+            drawList->AddRect(ImVec2(x1, y + 1), ImVec2(x2, y + noteHeight_ - 1), color);
+        }
+
+        if (!active) return;
+        // Instance bands along the top edge
+        for (const auto& inst : track.clipInstances) {
+            if (inst.clip < 0 || inst.clip >= static_cast<int>(project.clips.size())) continue;
+            const auto& clip = project.clips[inst.clip];
+            float x1 = tickToX(inst.offset, canvasPos, canvasSize);
+            float x2 = tickToX(inst.offset + clip.length, canvasPos, canvasSize);
+            if (x2 < canvasPos.x || x1 > canvasPos.x + canvasSize.x) continue;
+            drawList->AddRectFilled(ImVec2(x1, canvasPos.y), ImVec2(x2, canvasPos.y + 14), IM_COL32(90, 120, 170, 160));
+            drawList->AddRect(ImVec2(x1, canvasPos.y), ImVec2(x2, canvasPos.y + 14), IM_COL32(150, 180, 230, 200));
+            drawList->AddText(ImVec2(x1 + 3, canvasPos.y), IM_COL32(230, 230, 240, 255), clip.name.c_str());
+        }
+    };
+
+    // First pass: non-selected tracks (behind). Hidden while editing a clip,
+    // since the clip has its own timeline.
+    for (int trackIdx = 0; editingClip < 0 && trackIdx < static_cast<int>(project.tracks.size()); ++trackIdx) {
         if (trackIdx == selectedTrackIndex) continue;
         const auto& track = project.tracks[trackIdx];
         if (track.muted) continue;
@@ -333,14 +373,22 @@ void PianoRoll::drawNotes(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 canvasS
             drawList->AddRectFilled(ImVec2(x1, y + 1), ImVec2(x2, y + noteHeight_ - 1), noteColor);
             drawList->AddRect(ImVec2(x1, y + 1), ImVec2(x2, y + noteHeight_ - 1), IM_COL32(0, 0, 0, 50));
         }
+        drawClipInstances(trackIdx, track, false);
     }
 
-    // Second pass: selected track (on top)
-    if (selectedTrackIndex >= 0 && selectedTrackIndex < static_cast<int>(project.tracks.size())) {
-        const auto& track = project.tracks[selectedTrackIndex];
+    // Second pass: selected track, or the clip being edited (on top)
+    if (const auto* track = app_.getSelectedTrack()) {
+        if (editingClip < 0) {
+            drawClipInstances(selectedTrackIndex, *track, true);
+        } else {
+            // Clip end marker
+            float x = tickToX(project.clips[editingClip].length, canvasPos, canvasSize);
+            drawList->AddLine(ImVec2(x, canvasPos.y), ImVec2(x, canvasPos.y + canvasSize.y),
+                              IM_COL32(150, 180, 230, 200), 2.0f);
+        }
 
-        for (size_t i = 0; i < track.notes.size(); ++i) {
-            const auto& note = track.notes[i];
+        for (size_t i = 0; i < track->notes.size(); ++i) {
+            const auto& note = track->notes[i];
 
             float x1 = tickToX(note.start_tick, canvasPos, canvasSize);
             float x2 = tickToX(note.endTick(), canvasPos, canvasSize);
@@ -424,6 +472,7 @@ void PianoRoll::drawPlayhead(ImDrawList* drawList, ImVec2 canvasPos, ImVec2 canv
 }
 
 void PianoRoll::drawVelocityLane(ImDrawList* drawList, ImVec2 pos, ImVec2 size) {
+    PROFILE_SCOPE("PianoRoll::drawVelocityLane");
     // Background
     drawList->AddRectFilled(pos, ImVec2(pos.x + size.x, pos.y + size.y), IM_COL32(25, 25, 30, 255));
 
@@ -486,17 +535,21 @@ void PianoRoll::drawVelocityLane(ImDrawList* drawList, ImVec2 pos, ImVec2 size)
             uint32_t clickTick = xToTick(mousePos.x, pos, size);
 
             // Find notes near the click position and set their velocity
-            for (auto& note : track->notes) {
+            std::vector<size_t> changed;
+            for (size_t i = 0; i < track->notes.size(); ++i) {
+                auto& note = track->notes[i];
                 if (note.selected ||
                     (clickTick >= note.start_tick && clickTick < note.endTick())) {
-                    if (note.selected) {
-                        note.velocity = newVelocity;
-                    } else if (clickTick >= note.start_tick && clickTick < note.endTick()) {
+                    if (note.velocity != newVelocity) {
                         note.velocity = newVelocity;
+                        changed.push_back(i);
                     }
                 }
             }
-            app_.getProject().modified = true;
+            if (!changed.empty()) {
+                app_.journalNoteEdits(app_.getEditTargetIndex(), changed, false);
+                app_.getProject().modified = true;
+            }
         }
 
         if (ImGui::IsMouseReleased(ImGuiMouseButton_Left)) {
@@ -672,7 +725,7 @@ void PianoRoll::handleNoteCreation(ImVec2 canvasPos, ImVec2 canvasSize) {
 
             track->clearSelection();
 
-            auto cmd = std::make_unique<AddNotesCommand>(app_, app_.getSelectedTrackIndex(),
+            auto cmd = std::make_unique<AddNotesCommand>(app_, app_.getEditTargetIndex(),
                                                          std::vector<midi::Note>{newNote});
             app_.executeCommand(std::move(cmd));
         }
@@ -732,18 +785,10 @@ void PianoRoll::handleNoteDragging(ImVec2 canvasPos, ImVec2 canvasSize) {
 
     if (ImGui::IsMouseReleased(ImGuiMouseButton_Left)) {
         if (hasDragged_ && (pitchDelta != 0 || tickDelta != 0)) {
-            auto* track = app_.getSelectedTrack();
-            if (track) {
-                for (auto& note : track->notes) {
-                    if (note.selected) {
-                        note.pitch = std::clamp(note.pitch + pitchDelta, 0, 127);
-                        int32_t newTick = static_cast<int32_t>(note.start_tick) + tickDelta;
-                        note.start_tick = static_cast<uint32_t>(std::max(0, newTick));
-                    }
-                }
-                track->sortNotes();
-                app_.getProject().modified = true;
-            }
+            BatchTransform transform;
+            transform.transpose = pitchDelta;
+            transform.timeShift = tickDelta;
+            app_.applyBatchTransform(transform, "Move Notes");
         }
 
         mode_ = InteractionMode::None;
@@ -759,25 +804,11 @@ void PianoRoll::handleNoteResizing(ImVec2 canvasPos, ImVec2 canvasSize) {
     int32_t tickDelta = static_cast<int32_t>(currentTick) - static_cast<int32_t>(xToTick(dragStartMouse_.x, canvasPos, canvasSize));
 
     if (ImGui::IsMouseReleased(ImGuiMouseButton_Left)) {
-        auto* track = app_.getSelectedTrack();
-        if (track && tickDelta != 0) {
-            for (auto& note : track->notes) {
-                if (note.selected) {
-                    if (resizingFromRight_) {
-                        int32_t newDuration = static_cast<int32_t>(note.duration) + tickDelta;
-                        note.duration = static_cast<uint32_t>(std::max(1, newDuration));
-                    } else {
-                        int32_t newStart = static_cast<int32_t>(note.start_tick) + tickDelta;
-                        int32_t newDuration = static_cast<int32_t>(note.duration) - tickDelta;
-                        if (newDuration > 0 && newStart >= 0) {
-                            note.start_tick = static_cast<uint32_t>(newStart);
-                            note.duration = static_cast<uint32_t>(newDuration);
-                        }
-                    }
-                }
-            }
-            track->sortNotes();
-            app_.getProject().modified = true;
+        if (tickDelta != 0) {
+            BatchTransform transform;
+            transform.resizeDelta = tickDelta;
+            transform.resizeFromLeft = !resizingFromRight_;
+            app_.applyBatchTransform(transform, "Resize Notes");
         }
 
         mode_ = InteractionMode::None;
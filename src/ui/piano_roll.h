@@ -90,6 +90,7 @@ private:
     // Note resizing
     bool resizingFromRight_ = true;
     std::vector<uint32_t> originalDurations_;
+    std::vector<midi::Note> clipNotes_;  // Scratch for expanded clip instances
     
     // Keyboard interaction
     int previewingPitch_ = -1;
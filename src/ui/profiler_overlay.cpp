@@ -0,0 +1,89 @@
+#include "profiler_overlay.h"
+#include "../profiler.h"
+#include <imgui.h>
+#include <algorithm>
+#include <cstdio>
+
+void ProfilerOverlay::render() {
+    if (!visible_) return;
+
+    ImGui::SetNextWindowSize(ImVec2(360, 420), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.85f);
+    if (!ImGui::Begin("Frame Profiler", &visible_)) {
+        ImGui::End();
+        return;
+    }
+
+#ifndef ENABLE_PROFILER
+    ImGui::TextWrapped("Profiling is compiled out. Configure with -DENABLE_PROFILER=ON "
+                       "(or a Debug build) to enable it.");
+#else
+    const FrameProfiler& profiler = FrameProfiler::get();
+    int frames = profiler.frameCount();
+    if (frames == 0) {
+        ImGui::TextDisabled("No frames yet");
+        ImGui::End();
+        return;
+    }
+
+    // Per-stage last / average / max over the history
+    float avgFrame = 0.0f, maxFrame = 0.0f;
+    float avg[FrameProfiler::MAX_STAGES] = {};
+    float peak[FrameProfiler::MAX_STAGES] = {};
+    for (int age = 0; age < frames; ++age) {
+        const auto& frame = profiler.frame(age);
+        avgFrame += frame.totalMs;
+        maxFrame = std::max(maxFrame, frame.totalMs);
+        for (int s = 0; s < profiler.stageCount(); ++s) {
+            avg[s] += frame.stageMs[s];
+            peak[s] = std::max(peak[s], frame.stageMs[s]);
+        }
+    }
+    avgFrame /= frames;
+
+    const auto& last = profiler.frame(0);
+    ImGui::Text("Frame %.2f ms   avg %.2f ms (%.0f fps)   max %.2f ms",
+                last.totalMs, avgFrame, avgFrame > 0.0f ? 1000.0f / avgFrame : 0.0f, maxFrame);
+
+    // Ring order, oldest first; scale leaves headroom above the slowest frame
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "last %d frames", frames);
+    int offset = frames < FrameProfiler::HISTORY ? 0 : profiler.frameTimesOffset();
+    ImGui::PlotLines("##frametimes", profiler.frameTimes(), frames, offset, overlay,
+                     0.0f, std::max(maxFrame * 1.2f, 20.0f), ImVec2(-1, 80));
+
+    const auto& worst = profiler.worstFrame();
+    if (ImGui::BeginTable("##stages", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+        ImGui::TableSetupColumn("Stage", ImGuiTableColumnFlags_WidthStretch, 3.0f);
+        ImGui::TableSetupColumn("Last");
+        ImGui::TableSetupColumn("Avg");
+        ImGui::TableSetupColumn("Max");
+        ImGui::TableSetupColumn("Worst");
+        ImGui::TableHeadersRow();
+
+        for (int s = 0; s < profiler.stageCount(); ++s) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s", profiler.stageDepth(s) * 2, "", profiler.stageName(s));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", last.stageMs[s]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", avg[s] / frames);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", peak[s]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", worst.stageMs[s]);
+        }
+        ImGui::EndTable();
+    }
+
+    // Worst since the last reset, which can be older than the graph
+    ImGui::Text("Worst frame %.2f ms", worst.totalMs);
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Reset")) {
+        FrameProfiler::get().resetWorst();
+    }
+#endif
+
+    ImGui::End();
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// Debug overlay for FrameProfiler: frame-time graph, per-stage ms and the
+// worst frame so far. Shared by the desktop and mobile UIs.
+class ProfilerOverlay {
+public:
+    void render();
+
+    bool isVisible() const { return visible_; }
+    void setVisible(bool visible) { visible_ = visible; }
+
+private:
+    bool visible_ = false;
+};
@@ -0,0 +1,76 @@
+#include "timing_panel.h"
+#include <imgui.h>
+#include <cfloat>
+#include <cstdio>
+#include <string>
+
+TimingPanel::TimingPanel(midi::MidiPlayer& player)
+    : player_(player)
+{
+}
+
+void TimingPanel::update() {
+    synthStats_.update(player_.getSynthTiming());
+    midiOutStats_.update(player_.getMidiOutTiming());
+}
+
+void TimingPanel::render() {
+    if (!visible_) return;
+
+    ImGui::SetNextWindowSize(ImVec2(420, 460), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Playback Timing", &visible_)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::TextDisabled("Lateness = actual - intended time of scheduled events");
+    renderOutput("Built-in Synth", synthStats_);
+    renderOutput("MIDI Device", midiOutStats_);
+
+    ImGui::Separator();
+    ImGui::SetNextItemWidth(260);
+    ImGui::InputText("##csvpath", csvPathBuffer_, sizeof(csvPathBuffer_));
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV")) {
+        // One file per output, suffixed before the extension
+        std::string path = csvPathBuffer_;
+        size_t dot = path.find_last_of('.');
+        std::string stem = dot == std::string::npos ? path : path.substr(0, dot);
+        std::string ext = dot == std::string::npos ? ".csv" : path.substr(dot);
+        bool ok = synthStats_.exportCsv(stem + "_synth" + ext) &&
+                  midiOutStats_.exportCsv(stem + "_midi" + ext);
+        exportMessage_ = ok ? "Exported " + stem + "_synth" + ext + " and " + stem + "_midi" + ext
+                            : "Export failed";
+    }
+    if (!exportMessage_.empty()) {
+        ImGui::TextDisabled("%s", exportMessage_.c_str());
+    }
+
+    ImGui::End();
+}
+
+void TimingPanel::renderOutput(const char* label, midi::TimingStats& stats) {
+    ImGui::PushID(label);
+    ImGui::Separator();
+    ImGui::Text("%s", label);
+
+    if (stats.count() == 0) {
+        ImGui::TextDisabled("No events yet");
+        ImGui::PopID();
+        return;
+    }
+
+    ImGui::Text("p50 %.3f ms   p99 %.3f ms   max %.3f ms", stats.p50(), stats.p99(), stats.max());
+    ImGui::Text("Jitter (p99 - p50) %.3f ms   %zu samples", stats.jitter(), stats.count());
+
+    const auto& bins = stats.histogram();
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.2f .. %.2f ms", stats.histogramMin(), stats.histogramMax());
+    ImGui::PlotHistogram("##histogram", bins.data(), static_cast<int>(bins.size()), 0, overlay,
+                         0.0f, FLT_MAX, ImVec2(-1, 80));
+
+    if (ImGui::SmallButton("Reset")) {
+        stats.clear();
+    }
+    ImGui::PopID();
+}
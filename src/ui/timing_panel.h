@@ -0,0 +1,27 @@
+#pragma once
+
+#include "../midi/midi_player.h"
+#include "../midi/timing_stats.h"
+
+// Debug window: how late scheduled events reach each output
+class TimingPanel {
+public:
+    TimingPanel(midi::MidiPlayer& player);
+
+    // Drain the recorders; call every frame, shown or not
+    void update();
+    void render();
+
+    bool isVisible() const { return visible_; }
+    void setVisible(bool visible) { visible_ = visible; }
+
+private:
+    void renderOutput(const char* label, midi::TimingStats& stats);
+
+    midi::MidiPlayer& player_;
+    midi::TimingStats synthStats_;
+    midi::TimingStats midiOutStats_;
+    bool visible_ = false;
+    char csvPathBuffer_[512] = "timing.csv";
+    std::string exportMessage_;
+};
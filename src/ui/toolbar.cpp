@@ -31,6 +31,23 @@ void Toolbar::render() {
     }
     ImGui::SameLine();
 
+    // Record: arming while stopped also starts playback
+    bool armed = app_.isRecordArmed();
+    if (armed) {
+        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.7f, 0.15f, 0.15f, 1.0f));
+    }
+    if (ImGui::Button("Rec")) {
+        app_.setRecordArmed(!armed);
+        if (!armed) app_.setPlaying(true);
+    }
+    if (armed) {
+        ImGui::PopStyleColor();
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Record MIDI input into the selected track");
+    }
+    ImGui::SameLine();
+
     ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
     ImGui::SameLine();
 
@@ -158,15 +175,19 @@ void Toolbar::render() {
     ImGui::SameLine();
     ImGui::SetNextItemWidth(150);
 
-    auto devices = player_.getOutputDevices();
+    auto devices = player_.getDevices();
     std::vector<const char*> deviceNames;
     deviceNames.push_back("(None)");
-    for (const auto& d : devices) {
+    for (const auto& d : devices->outputs) {
         deviceNames.push_back(d.c_str());
     }
 
     int deviceIndex = player_.getCurrentDevice() + 1; // +1 because of "(None)" option
-    if (ImGui::Combo("##mididevice", &deviceIndex, deviceNames.data(), static_cast<int>(deviceNames.size()))) {
+    bool deviceChosen = ImGui::Combo("##mididevice", &deviceIndex, deviceNames.data(), static_cast<int>(deviceNames.size()));
+    if (ImGui::IsItemActivated()) {
+        player_.refreshDevices();
+    }
+    if (deviceChosen) {
         if (deviceIndex == 0) {
             player_.closeDevice();
         } else {
@@ -179,7 +200,86 @@ void Toolbar::render() {
         }
     }
 
+    ImGui::SameLine();
+
+    // MIDI input (played through the selected track's channel)
+    ImGui::Text("MIDI In:");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150);
+
+    std::vector<const char*> inputNames;
+    inputNames.push_back("(None)");
+    for (const auto& d : devices->inputs) {
+        inputNames.push_back(d.c_str());
+    }
+
+    int inputIndex = player_.getCurrentInputDevice() + 1;
+    bool inputChosen = ImGui::Combo("##midiinput", &inputIndex, inputNames.data(), static_cast<int>(inputNames.size()));
+    if (ImGui::IsItemActivated()) {
+        player_.refreshDevices();
+    }
+    if (inputChosen) {
+        if (inputIndex == 0) {
+            player_.closeInputDevice();
+        } else {
+            player_.openInputDevice(inputIndex - 1);
+        }
+    }
+    ImGui::SameLine();
+
+    // MIDI clock: send it on Ext MIDI, or follow it from MIDI In
+    ImGui::Text("Sync:");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(90);
+    static const char* syncNames[] = {"Internal", "Send Clock", "Follow"};
+    int syncMode = player_.isFollowingClock() ? 2 : (player_.isSendingClock() ? 1 : 0);
+    if (ImGui::Combo("##sync", &syncMode, syncNames, 3)) {
+        player_.setSendClock(syncMode == 1);
+        player_.setFollowClock(syncMode == 2);
+    }
+    ImGui::SameLine();
+
+    ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
+    ImGui::SameLine();
+
+    renderDspMeter();
+
     ImGui::PopStyleVar();
 
     ImGui::End();
 }
+
+void Toolbar::renderDspMeter() {
+    auto stats = player_.getAudioSynth().getDspStats();
+
+    // Green with headroom, yellow getting close, red over budget
+    ImVec4 color = stats.peakLoad >= 1.0f ? ImVec4(1.0f, 0.35f, 0.3f, 1.0f)
+                 : stats.load >= 0.7f     ? ImVec4(1.0f, 0.8f, 0.3f, 1.0f)
+                                          : ImVec4(0.5f, 0.85f, 0.5f, 1.0f);
+    ImGui::BeginGroup();
+    ImGui::TextColored(color, "DSP %3.0f%%", stats.load * 100.0f);
+    if (stats.underruns > 0) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1.0f, 0.35f, 0.3f, 1.0f), "%u xrun%s", stats.underruns,
+                           stats.underruns == 1 ? "" : "s");
+    }
+    ImGui::EndGroup();
+
+    if (ImGui::IsItemClicked()) {
+        player_.getAudioSynth().resetDspCounters();
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        ImGui::Text("Load %.0f%%   peak %.0f%% (last second)", stats.load * 100.0f, stats.peakLoad * 100.0f);
+        ImGui::Text("Late callbacks %u   underruns %u", stats.lateCallbacks, stats.underruns);
+        ImGui::Separator();
+        // Per track, by channel; tracks sharing a channel share its load
+        for (const auto& track : app_.getProject().tracks) {
+            float load = stats.channelLoad[track.channel & 0x0F];
+            if (load < 0.005f) continue;
+            ImGui::Text("%5.1f%%  Ch %2d  %s", load * 100.0f, track.channel + 1, track.name.c_str());
+        }
+        ImGui::TextDisabled("Click to reset counters");
+        ImGui::EndTooltip();
+    }
+}
@@ -10,6 +10,9 @@ public:
     void render();
 
 private:
+    // Audio callback load, late callbacks and underruns; details on hover
+    void renderDspMeter();
+
     App& app_;
     midi::MidiPlayer& player_;
     int selectedMidiDevice_ = -1;
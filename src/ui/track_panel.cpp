@@ -1,5 +1,6 @@
 #include "track_panel.h"
 #include "../midi/general_midi.h"
+#include "../profiler.h"
 #include <imgui.h>
 #include <algorithm>
 #include <cstring>
@@ -11,6 +12,7 @@ TrackPanel::TrackPanel(App& app, midi::MidiPlayer& player)
 }
 
 void TrackPanel::render() {
+    PROFILE_SCOPE("TrackPanel::render");
     ImGui::Begin("Tracks");
     
     auto& project = app_.getProject();
@@ -174,9 +176,43 @@ void TrackPanel::renderTrackItem(int index, midi::Track& track) {
         if (ImGui::IsItemHovered()) {
             ImGui::SetTooltip("Solo");
         }
-        
+
         ImGui::SameLine();
-        
+
+        // Freeze: played from pre-rendered audio instead of live voices
+        const auto& freezer = player_.getTrackFreezer();
+        auto freezeState = freezer.getState(static_cast<size_t>(index));
+        bool frozen = track.frozen;
+        if (frozen) {
+            ImGui::PushStyleColor(ImGuiCol_Button, freezeState == midi::TrackFreezer::State::Frozen
+                                                       ? ImVec4(0.2f, 0.4f, 0.7f, 1.0f)
+                                                       : ImVec4(0.3f, 0.35f, 0.5f, 1.0f));
+        }
+        if (ImGui::Button("F##freeze", ImVec2(24, 0))) {
+            track.frozen = !track.frozen;
+        }
+        if (frozen) {
+            ImGui::PopStyleColor();
+        }
+        if (ImGui::IsItemHovered()) {
+            switch (freezeState) {
+            case midi::TrackFreezer::State::Off:
+                ImGui::SetTooltip("Freeze (render to audio)");
+                break;
+            case midi::TrackFreezer::State::Rendering:
+                ImGui::SetTooltip("Freezing... %.0f%%", freezer.getProgress(static_cast<size_t>(index)) * 100.0f);
+                break;
+            case midi::TrackFreezer::State::Frozen:
+                ImGui::SetTooltip("Frozen (click to unfreeze)");
+                break;
+            case midi::TrackFreezer::State::NoSoundFont:
+                ImGui::SetTooltip("Frozen once a SoundFont is loaded");
+                break;
+            }
+        }
+
+        ImGui::SameLine();
+
         // Delete button (only if more than one track)
         if (project.tracks.size() > 1) {
             ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.5f, 0.2f, 0.2f, 1.0f));
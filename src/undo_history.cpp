@@ -0,0 +1,230 @@
+#include "undo_history.h"
+#include "app.h"
+#include "midi/binary_io.h"
+
+UndoHistory::UndoHistory(App& app, size_t memoryBudget, uint64_t diskBudget)
+    : app_(app), memoryBudget_(memoryBudget), diskBudget_(diskBudget) {}
+
+UndoHistory::~UndoHistory() {
+    resetSpillFile();
+}
+
+void UndoHistory::push(std::unique_ptr<Command> cmd) {
+    clearRedo();
+    pushEntry(undo_, std::move(cmd));
+    enforceBudget();
+}
+
+std::unique_ptr<Command> UndoHistory::popUndo() {
+    return popEntry(undo_);
+}
+
+std::unique_ptr<Command> UndoHistory::popRedo() {
+    return popEntry(redo_);
+}
+
+void UndoHistory::pushUndo(std::unique_ptr<Command> cmd) {
+    pushEntry(undo_, std::move(cmd));
+    enforceBudget();
+}
+
+void UndoHistory::pushRedo(std::unique_ptr<Command> cmd) {
+    pushEntry(redo_, std::move(cmd));
+    enforceBudget();
+}
+
+void UndoHistory::clear() {
+    undo_.clear();
+    redo_.clear();
+    residentBytes_ = 0;
+    spilledBytes_ = 0;
+    resetSpillFile();
+}
+
+void UndoHistory::clearRedo() {
+    for (auto& entry : redo_) {
+        dropEntry(entry);
+    }
+    redo_.clear();
+    if (spilledBytes_ == 0) resetSpillFile();
+}
+
+void UndoHistory::setMemoryBudget(size_t bytes) {
+    memoryBudget_ = bytes;
+    enforceBudget();
+}
+
+void UndoHistory::pushEntry(std::deque<Entry>& stack, std::unique_ptr<Command> cmd) {
+    if (!cmd) return;
+    Entry entry;
+    entry.bytes = cmd->memoryUsage();
+    entry.cmd = std::move(cmd);
+    residentBytes_ += entry.bytes;
+    stack.push_back(std::move(entry));
+}
+
+std::unique_ptr<Command> UndoHistory::popEntry(std::deque<Entry>& stack) {
+    if (stack.empty()) return nullptr;
+
+    Entry entry = std::move(stack.back());
+    stack.pop_back();
+
+    if (entry.cmd) {
+        residentBytes_ -= entry.bytes;
+        return std::move(entry.cmd);
+    }
+
+    auto cmd = load(entry);
+    spilledBytes_ -= entry.size;
+    if (!cmd) {
+        for (auto& older : stack) dropEntry(older);
+        stack.clear();
+        loadFailed_ = true;
+    }
+    // Nothing left on disk: drop the file instead of letting dead space pile up
+    if (spilledBytes_ == 0) resetSpillFile();
+    return cmd;
+}
+
+void UndoHistory::dropEntry(Entry& entry) {
+    if (entry.cmd) {
+        residentBytes_ -= entry.bytes;
+        entry.cmd.reset();
+    } else {
+        spilledBytes_ -= entry.size;
+    }
+}
+
+void UndoHistory::enforceBudget() {
+    while (residentBytes_ > memoryBudget_) {
+        // Oldest resident entry first: bottom of the undo stack (never the
+        // top, so the next undo is always instant), then the redo entry
+        // furthest from the top
+        Entry* victim = nullptr;
+        for (size_t i = 0; i + 1 < undo_.size() && !victim; ++i) {
+            if (undo_[i].cmd) victim = &undo_[i];
+        }
+        for (size_t i = 0; i + 1 < redo_.size() && !victim; ++i) {
+            if (redo_[i].cmd) victim = &redo_[i];
+        }
+        if (!victim) break;
+
+        if (!spill(*victim)) {
+            // No spill file: fall back to forgetting the oldest undo step
+            if (undo_.empty() || victim != &undo_.front()) break;
+            dropEntry(undo_.front());
+            undo_.pop_front();
+        }
+    }
+
+    // Past the disk cap, drop the oldest history until the live data fits in
+    // half of it, then rewrite the file without the dead space
+    if (spillEnd_ > diskBudget_) {
+        while (spilledBytes_ > diskBudget_ / 2 && !undo_.empty() && !undo_.front().cmd) {
+            dropEntry(undo_.front());
+            undo_.pop_front();
+        }
+        compactSpillFile();
+    }
+}
+
+bool UndoHistory::spill(Entry& entry) {
+    if (!spillFile_) {
+        spillFile_ = std::tmpfile();
+        if (!spillFile_) {
+            fprintf(stderr, "Undo error: Cannot create spill file\n");
+            return false;
+        }
+        spillEnd_ = 0;
+    }
+
+    std::vector<uint8_t> data;
+    midi::ByteWriter out(data);
+    entry.cmd->write(out);
+
+    if (std::fseek(spillFile_, static_cast<long>(spillEnd_), SEEK_SET) != 0 ||
+        std::fwrite(data.data(), 1, data.size(), spillFile_) != data.size()) {
+        fprintf(stderr, "Undo error: Failed to write spill file\n");
+        return false;
+    }
+
+    entry.offset = spillEnd_;
+    entry.size = static_cast<uint32_t>(data.size());
+    spillEnd_ += data.size();
+    spilledBytes_ += data.size();
+
+    residentBytes_ -= entry.bytes;
+    entry.bytes = 0;
+    entry.cmd.reset();
+    return true;
+}
+
+bool UndoHistory::readSpilled(const Entry& entry, std::vector<uint8_t>& out) {
+    out.resize(entry.size);
+    return spillFile_ &&
+           std::fseek(spillFile_, static_cast<long>(entry.offset), SEEK_SET) == 0 &&
+           std::fread(out.data(), 1, out.size(), spillFile_) == out.size();
+}
+
+std::unique_ptr<Command> UndoHistory::load(const Entry& entry) {
+    std::vector<uint8_t> data;
+    if (!readSpilled(entry, data)) {
+        fprintf(stderr, "Undo error: Failed to read spill file\n");
+        return nullptr;
+    }
+    midi::ByteReader in(data.data(), data.size());
+    auto cmd = Command::deserialize(app_, in);
+    if (!cmd || !in.ok()) {
+        fprintf(stderr, "Undo error: Corrupt entry in spill file\n");
+        return nullptr;
+    }
+    return cmd;
+}
+
+void UndoHistory::compactSpillFile() {
+    if (!spillFile_) return;
+    if (spilledBytes_ == 0) {
+        resetSpillFile();
+        return;
+    }
+
+    std::FILE* fresh = std::tmpfile();
+    if (!fresh) return;
+
+    // The new offsets only apply once everything is copied: if this fails
+    // partway, the entries still point into the old file
+    uint64_t pos = 0;
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> offsets;
+    for (auto* stack : {&undo_, &redo_}) {
+        for (const auto& entry : *stack) {
+            if (entry.cmd) continue;
+            if (!readSpilled(entry, data) ||
+                std::fwrite(data.data(), 1, data.size(), fresh) != data.size()) {
+                fprintf(stderr, "Undo error: Failed to compact spill file\n");
+                std::fclose(fresh);
+                return;
+            }
+            offsets.push_back(pos);
+            pos += entry.size;
+        }
+    }
+
+    size_t next = 0;
+    for (auto* stack : {&undo_, &redo_}) {
+        for (auto& entry : *stack) {
+            if (!entry.cmd) entry.offset = offsets[next++];
+        }
+    }
+    std::fclose(spillFile_);
+    spillFile_ = fresh;
+    spillEnd_ = pos;
+}
+
+void UndoHistory::resetSpillFile() {
+    if (spillFile_) {
+        std::fclose(spillFile_);
+        spillFile_ = nullptr;
+    }
+    spillEnd_ = 0;
+}
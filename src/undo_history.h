@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <vector>
+
+class App;
+class Command;
+
+// Undo/redo stacks limited by memory instead of command count.
+//
+// Commands stay in RAM until the resident total goes over the budget; then
+// the oldest ones are serialized (already delta/varint packed) into an
+// anonymous temp file and dropped from memory. They're read back and
+// deserialized when undo/redo reaches them. The spill file has its own,
+// much larger cap; past that the oldest history is finally discarded.
+class UndoHistory {
+public:
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 32 * 1024 * 1024;
+    static constexpr uint64_t DEFAULT_DISK_BUDGET = 1024ull * 1024 * 1024;
+
+    explicit UndoHistory(App& app, size_t memoryBudget = DEFAULT_MEMORY_BUDGET,
+                         uint64_t diskBudget = DEFAULT_DISK_BUDGET);
+    ~UndoHistory();
+
+    UndoHistory(const UndoHistory&) = delete;
+    UndoHistory& operator=(const UndoHistory&) = delete;
+
+    // A newly executed command: goes on the undo stack, clears redo
+    void push(std::unique_ptr<Command> cmd);
+
+    // Pop the next command to undo/redo (loaded back from disk if needed).
+    // Returns null when the stack is empty or a spilled entry can't be
+    // read. Everything under an unreadable entry was recorded against the
+    // state it would have restored, so that goes too; takeLoadFailure()
+    // tells the two apart.
+    std::unique_ptr<Command> popUndo();
+    std::unique_ptr<Command> popRedo();
+    bool takeLoadFailure() { bool failed = loadFailed_; loadFailed_ = false; return failed; }
+
+    // Return a command after undo()/redo() ran on it
+    void pushUndo(std::unique_ptr<Command> cmd);
+    void pushRedo(std::unique_ptr<Command> cmd);
+
+    void clear();
+    void clearRedo();
+
+    bool canUndo() const { return !undo_.empty(); }
+    bool canRedo() const { return !redo_.empty(); }
+    size_t undoCount() const { return undo_.size(); }
+    size_t redoCount() const { return redo_.size(); }
+
+    size_t residentBytes() const { return residentBytes_; }
+    uint64_t spilledBytes() const { return spilledBytes_; }
+
+    void setMemoryBudget(size_t bytes);
+
+private:
+    struct Entry {
+        std::unique_ptr<Command> cmd;  // null while spilled
+        size_t bytes = 0;              // resident size, when cmd is set
+        uint64_t offset = 0;           // spill file location, when cmd is null
+        uint32_t size = 0;
+    };
+
+    void pushEntry(std::deque<Entry>& stack, std::unique_ptr<Command> cmd);
+    std::unique_ptr<Command> popEntry(std::deque<Entry>& stack);
+    void dropEntry(Entry& entry);
+    void enforceBudget();
+    bool spill(Entry& entry);
+    std::unique_ptr<Command> load(const Entry& entry);
+    bool readSpilled(const Entry& entry, std::vector<uint8_t>& out);
+    void compactSpillFile();
+    void resetSpillFile();
+
+    App& app_;
+    size_t memoryBudget_;
+    uint64_t diskBudget_;
+
+    // Back of each deque is the top of the stack
+    std::deque<Entry> undo_;
+    std::deque<Entry> redo_;
+
+    size_t residentBytes_ = 0;
+    uint64_t spilledBytes_ = 0;   // live spilled bytes
+    uint64_t spillEnd_ = 0;       // write position; dead space isn't reused
+    std::FILE* spillFile_ = nullptr;
+    bool loadFailed_ = false;
+};
@@ -12,6 +12,8 @@
    [OPTIONAL] #define TSF_NO_STDIO to remove stdio dependency
    [OPTIONAL] #define TSF_MALLOC, TSF_REALLOC, and TSF_FREE to avoid stdlib.h
    [OPTIONAL] #define TSF_MEMCPY, TSF_MEMSET to avoid string.h
+   [OPTIONAL] #define TSF_LOAD_SAMPLES and TSF_FREE_SAMPLES to supply the float sample pool yourself
+              (e.g. paged in on demand instead of converted up front, see tsf_load_samples)
    [OPTIONAL] #define TSF_POW, TSF_POWF, TSF_EXPF, TSF_LOG, TSF_TAN, TSF_LOG10, TSF_SQRT to avoid math.h
 
    NOT YET IMPLEMENTED
@@ -281,6 +283,13 @@ TSFDEF float tsf_channel_get_tuning(tsf* f, int channel);
 #  define TSF_REALLOC realloc
 #endif
 
+// TSF_LOAD_SAMPLES(float** pFloatBuffer, unsigned int* pSmplCount, struct tsf_riffchunk* chunkSmpl, struct tsf_stream* stream)
+// replaces the 16-bit smpl chunk conversion: it must consume chunkSmpl->size bytes of the stream and
+// return the sample pool (at least *pSmplCount + 1 floats), which is released with TSF_FREE_SAMPLES.
+#ifndef TSF_FREE_SAMPLES
+#  define TSF_FREE_SAMPLES TSF_FREE
+#endif
+
 #if !defined(TSF_MEMCPY) || !defined(TSF_MEMSET)
 #  include <string.h>
 #  define TSF_MEMCPY  memcpy
@@ -989,6 +998,9 @@ static int tsf_load_samples(void** pRawBuffer, float** pFloatBuffer, unsigned in
 	if (!(*pFloatBuffer = (float*)TSF_REALLOC(*pFloatBuffer, resNum * sizeof(float)))) *pFloatBuffer = oldres;
 	*pSmplCount = resNum;
 	return (*pFloatBuffer ? 1 : 0);
+	#elif defined(TSF_LOAD_SAMPLES)
+	(void)pRawBuffer;
+	return TSF_LOAD_SAMPLES(pFloatBuffer, pSmplCount, chunkSmpl, stream);
 	#else
 	// Inline convert the samples from short to float
 	float *res, *out; const short *in;
@@ -1451,7 +1463,7 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 	TSF_FREE(hydra.phdrs); TSF_FREE(hydra.pbags); TSF_FREE(hydra.pmods);
 	TSF_FREE(hydra.pgens); TSF_FREE(hydra.insts); TSF_FREE(hydra.ibags);
 	TSF_FREE(hydra.imods); TSF_FREE(hydra.igens); TSF_FREE(hydra.shdrs);
-	TSF_FREE(rawBuffer);   TSF_FREE(floatBuffer);
+	TSF_FREE(rawBuffer);   TSF_FREE_SAMPLES(floatBuffer);
 	return res;
 }
 
@@ -1483,7 +1495,7 @@ TSFDEF void tsf_close(tsf* f)
 		struct tsf_preset *preset = f->presets, *presetEnd = preset + f->presetNum;
 		for (; preset != presetEnd; preset++) TSF_FREE(preset->regions);
 		TSF_FREE(f->presets);
-		TSF_FREE(f->fontSamples);
+		TSF_FREE_SAMPLES(f->fontSamples);
 		TSF_FREE(f->refCount);
 	}
 	TSF_FREE(f->channels);